@@ -1,236 +1,907 @@
 #include <iostream>
 #include <string>
+#include <string_view>
+#include <vector>
+#include <map>
+#include <tuple>
+#include <memory>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 #include <cstring>
 #include <cstdlib>
+#include <chrono>
+#include <iomanip>
 #include <unistd.h>
-#include <thread>
-#include <sys/socket.h>
-#include <netinet/in.h>
-#include <arpa/inet.h>
-#include <sys/select.h>
+#include <fcntl.h>
+#include <poll.h>
 #include <algorithm> // For std::max
+#include "ie_client.h"
+
+// Build: g++ -std=c++17 -pthread client.cpp ie_client.cpp -o client
 
 // --- Configuration ---
 #define SERVER_IP "127.0.0.1"   // Server IP address
 #define TCP_PORT 5000           // Server TCP Port
 #define BUFFER_SIZE 1024
+#define BATCH_COALESCE_BYTES 65536 // Batch mode: buffered frames are written once this much is queued...
+#define BATCH_COALESCE_MS 5     // ...or once the oldest has waited this long
+#define GATEWAY_CONNECTIONS 4   // Gateway mode: connections the hosted campuses are spread over
+#define OUTPUT_WRITE_BYTES 262144   // JSON output is written once this much is buffered...
+#define OUTPUT_FLUSH_MS 200         // ...or at least this often
+#define OUTPUT_MAX_PENDING 4194304  // Console text held for a slow terminal before messages are skipped
+#define RTT_WINDOW 1000         // Latest probe results kept per target for the RTT histogram
+
+// ====================================================================
+//                            OUTPUT STAGE
+// ====================================================================
+
+enum OutputMode {
+    OUTPUT_CONSOLE, // Render messages for a person
+    OUTPUT_QUIET,   // Count messages, show only connection events
+    OUTPUT_JSON     // One JSON object per message or event, to a file
+};
+
+// Everything the client shows goes through here. The event loop only appends to
+// in-memory buffers; a writer thread renders them with one write() per batch and
+// redraws the prompt once per batch rather than once per message, so a burst of
+// broadcasts costs the loop no terminal I/O and the UDP socket keeps being drained.
+// If the terminal falls more than OUTPUT_MAX_PENDING behind, messages are skipped
+// (and counted) instead of growing the buffer.
+class ConsoleOutput {
+public:
+    ConsoleOutput(OutputMode mode, int json_fd, std::string prompt)
+        : mode(mode), json_fd(json_fd), prompt_text(std::move(prompt)),
+          // JSON on stdout keeps the console text out of the way, on stderr
+          console_fd(json_fd == STDOUT_FILENO ? STDERR_FILENO : STDOUT_FILENO),
+          writer(&ConsoleOutput::writer_loop, this) {}
+    ~ConsoleOutput() { stop(); }
+    ConsoleOutput(const ConsoleOutput&) = delete;
+    ConsoleOutput& operator=(const ConsoleOutput&) = delete;
+
+    // A routed message; 'campus' names the hosted campus it is for (empty: ourselves)
+    void message(std::string_view campus, std::string_view text) {
+        std::lock_guard<std::mutex> lock(mutex);
+        messages++;
+        if (mode == OUTPUT_JSON) return add_record("message", campus, text);
+        if (mode == OUTPUT_QUIET || !room()) return;
+        console_pending.append("\n<-- TCP MESSAGE RECEIVED");
+        if (!campus.empty()) console_pending.append(" [").append(campus).append("]");
+        console_pending.append(" -->\n   ").append(text).append("\n");
+        cv.notify_one();
+    }
+
+    void broadcast(std::string_view text) {
+        std::lock_guard<std::mutex> lock(mutex);
+        broadcasts++;
+        if (mode == OUTPUT_JSON) return add_record("broadcast", {}, text);
+        if (mode == OUTPUT_QUIET || !room()) return;
+        console_pending.append("\n*** UDP BROADCAST RECEIVED ***\n   ").append(text).append("\n");
+        cv.notify_one();
+    }
+
+    // Status lines, shown in every mode; 'event' also records them as JSON
+    void notice(std::string_view text, const char *event = nullptr) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (mode == OUTPUT_JSON && event) add_record(event, {}, text);
+        console_pending.append(text).push_back('\n');
+        cv.notify_one();
+    }
+
+    void error(std::string_view text, const char *event = nullptr) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (mode == OUTPUT_JSON && event) add_record(event, {}, text);
+        errors_pending.append(text).push_back('\n');
+        cv.notify_one();
+    }
+
+    // The prompt is redrawn after the next batch even if it has no text
+    void prompt() {
+        std::lock_guard<std::mutex> lock(mutex);
+        prompt_pending = true;
+        cv.notify_one();
+    }
+
+    // Writes out everything buffered and ends the writer
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (stopping) return;
+            stopping = true;
+        }
+        cv.notify_one();
+        writer.join();
+        if (json_fd >= 0 && json_fd != STDOUT_FILENO) close(json_fd);
+    }
+
+    OutputMode output_mode() const { return mode; }
+    uint64_t message_count() const { return messages; }
+    uint64_t broadcast_count() const { return broadcasts; }
+    uint64_t record_count() const { return records; }
+
+private:
+    bool room() {
+        if (console_pending.size() < OUTPUT_MAX_PENDING) return true;
+        skipped++;
+        return false;
+    }
+
+    // {"time_ms":..,"type":"..","campus":"..","text":".."}; strings are escaped per RFC 8259
+    void add_record(const char *type, std::string_view campus, std::string_view text) {
+        int64_t now_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                             std::chrono::system_clock::now().time_since_epoch()).count();
+        bool was_empty = json_pending.empty();
+        json_pending.append("{\"time_ms\":").append(std::to_string(now_ms)).append(",\"type\":\"").append(type).append("\"");
+        if (!campus.empty()) append_json_string(json_pending.append(",\"campus\":"), campus);
+        append_json_string(json_pending.append(",\"text\":"), text);
+        json_pending.append("}\n");
+        records++;
+        // The first record starts the writer's OUTPUT_FLUSH_MS clock; a full buffer goes at once
+        if (was_empty || json_pending.size() >= OUTPUT_WRITE_BYTES) cv.notify_one();
+    }
+
+    static void append_json_string(std::string& out, std::string_view text) {
+        out.push_back('"');
+        for (unsigned char c : text) {
+            if (c == '"' || c == '\\') {
+                out.push_back('\\');
+                out.push_back(c);
+            } else if (c < 0x20) {
+                char escaped[8];
+                snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                out.append(escaped);
+            } else {
+                out.push_back(c); // UTF-8 passes through; the server only routes valid UTF-8
+            }
+        }
+        out.push_back('"');
+    }
 
-// --- Global Variables ---
-int tcp_sock = -1;
-int udp_sock = -1;
-std::string campus_name;
-bool running = true;
-int local_udp_port = -1; // New global variable for the unique port
+    static void write_all(int fd, const std::string& data) {
+        size_t done = 0;
+        while (done < data.size()) {
+            ssize_t written = write(fd, data.data() + done, data.size() - done);
+            if (written < 0 && errno == EINTR) continue;
+            if (written <= 0) return; // Output closed; nothing useful left to do with it
+            done += written;
+        }
+    }
+
+    // Swaps the pending buffers out and writes them without holding the lock, so the
+    // event loop keeps appending while a slow terminal is being written
+    void writer_loop() {
+        std::string console, errors, json;
+        auto last_json_write = std::chrono::steady_clock::now();
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            auto now = std::chrono::steady_clock::now();
+            bool json_due = !json_pending.empty() &&
+                            (stopping || json_pending.size() >= OUTPUT_WRITE_BYTES ||
+                             now - last_json_write >= std::chrono::milliseconds(OUTPUT_FLUSH_MS));
+            if (console_pending.empty() && errors_pending.empty() && !prompt_pending && !json_due) {
+                if (stopping) break;
+                if (json_pending.empty()) {
+                    cv.wait(lock);
+                } else {
+                    cv.wait_until(lock, last_json_write + std::chrono::milliseconds(OUTPUT_FLUSH_MS));
+                }
+                continue;
+            }
+            console.swap(console_pending);
+            errors.swap(errors_pending);
+            if (json_due) {
+                json.swap(json_pending);
+                last_json_write = now;
+            }
+            if (skipped > 0) {
+                console.append("[OUTPUT] " + std::to_string(skipped) + " message(s) not shown; the terminal could not keep up.\n");
+                skipped = 0;
+            }
+            if ((!console.empty() || prompt_pending) && !stopping) console.append(prompt_text);
+            prompt_pending = false;
+
+            lock.unlock();
+            write_all(STDERR_FILENO, errors);
+            write_all(console_fd, console);
+            if (json_fd >= 0) write_all(json_fd, json);
+            console.clear(); // The buffers keep their capacity for the next swap
+            errors.clear();
+            json.clear();
+            lock.lock();
+        }
+    }
+
+    const OutputMode mode;
+    const int json_fd;
+    const std::string prompt_text;
+    const int console_fd;
+    std::mutex mutex;                   // Protects everything below
+    std::condition_variable cv;         // Wakes the writer
+    std::string console_pending, errors_pending, json_pending;
+    bool prompt_pending = false;
+    bool stopping = false;
+    uint64_t skipped = 0;               // Messages not shown since the last batch
+    uint64_t messages = 0, broadcasts = 0, records = 0;
+    std::thread writer;                 // Last: starts once the rest is constructed
+};
+
+// ====================================================================
+//                          LATENCY TRACKING
+// ====================================================================
+
+// Rolling window of one latency series (the last RTT_WINDOW samples), in microseconds
+class RttWindow {
+public:
+    void add(int64_t us) {
+        if (samples.size() < RTT_WINDOW) {
+            samples.push_back(us);
+        } else {
+            samples[next] = us;
+        }
+        next = (next + 1) % RTT_WINDOW;
+    }
+    bool empty() const { return samples.empty(); }
+    size_t size() const { return samples.size(); }
+
+    // "p50 .. us, p90 .. us, p99 .. us, max .. us"
+    std::string percentiles() const {
+        std::vector<int64_t> sorted(samples);
+        std::sort(sorted.begin(), sorted.end());
+        auto at = [&](double q) { return std::to_string(sorted[std::min(sorted.size() - 1, (size_t)(q * sorted.size()))]); };
+        return "p50 " + at(0.50) + " us, p90 " + at(0.90) + " us, p99 " + at(0.99) + " us, max " +
+               std::to_string(sorted.back()) + " us";
+    }
+
+    // One bar per power-of-two bucket that has samples
+    std::string histogram() const {
+        std::vector<size_t> buckets(64, 0);
+        for (int64_t us : samples) buckets[us > 0 ? 63 - __builtin_clzll((uint64_t)us) : 0]++;
+        size_t peak = *std::max_element(buckets.begin(), buckets.end());
+        std::ostringstream out;
+        for (int b = 0; b < 64; ++b) {
+            if (!buckets[b]) continue;
+            std::string range = std::to_string(b == 0 ? 0 : 1ULL << b) + "-" + std::to_string((2ULL << b) - 1);
+            out << "   " << std::setw(17) << range << " us |"
+                << std::string((buckets[b] * 40 + peak - 1) / peak, '#') << " " << buckets[b] << "\n";
+        }
+        return out.str();
+    }
+
+private:
+    std::vector<int64_t> samples;
+    size_t next = 0;
+};
+
+// Probe results per target ("server", or the campus probed), printed on demand by RTT.
+// The round trip is split into the part the server measured (time in the server for a
+// server probe, the wait for the destination for a campus probe) and the rest.
+struct LatencyTracker {
+    struct Target {
+        RttWindow rtt, measured;
+        bool server = false;        // 'measured' is time in the server, not at a destination
+        uint64_t unreachable = 0;
+    };
+    std::map<std::string, Target> targets;
+
+    void record(const PingResult& result, ConsoleOutput& output) {
+        std::string name = result.destination.empty() ? "server" : result.destination;
+        std::string label = (result.identity.empty() ? "" : result.identity + " -> ") + name;
+        Target& target = targets[label];
+        target.server = result.destination.empty();
+        if (!result.reachable) {
+            target.unreachable++;
+            output.notice("\n[PING] " + label + ": not currently active.", "ping");
+            return;
+        }
+        int64_t measured = result.destination.empty() ? result.server_us : result.destination_us;
+        target.rtt.add(result.rtt_us);
+        target.measured.add(measured);
+        if (result.destination.empty()) {
+            output.notice("\n[PING] " + label + ": " + std::to_string(result.rtt_us) + " us round trip (" +
+                          std::to_string(measured) + " us in the server, " + std::to_string(result.rtt_us - measured) +
+                          " us network and queues)", "ping");
+        } else {
+            output.notice("\n[PING] " + label + ": " + std::to_string(result.rtt_us) + " us round trip (" +
+                          std::to_string(measured) + " us waiting on " + name + ", " +
+                          std::to_string(result.rtt_us - measured) + " us to and through the server)", "ping");
+        }
+    }
+
+    void print(ConsoleOutput& output) const {
+        if (targets.empty()) {
+            output.notice("\n[RTT] No probes answered yet. Use PING or PING:<DESTINATION>.");
+            return;
+        }
+        for (const auto& entry : targets) {
+            const Target& target = entry.second;
+            std::string text = "\n[RTT] " + entry.first + ": " + std::to_string(target.rtt.size()) + " sample(s)";
+            if (target.unreachable) text += ", " + std::to_string(target.unreachable) + " unreachable";
+            if (!target.rtt.empty()) {
+                text += "\n   round trip: " + target.rtt.percentiles();
+                text += "\n   " + std::string(target.server ? "in server: " : "at destination: ") + target.measured.percentiles();
+                text += "\n" + target.rtt.histogram();
+                text.pop_back();
+            }
+            output.notice(text);
+        }
+    }
+};
 
 // --- Function Prototypes ---
-void receive_handler(int tcp_fd, int udp_fd);
-int setup_udp_listener(int port_num); // Now accepts a port number
-int setup_tcp_connection(const std::string& name, int udp_port);
+void attach_console_output(ExchangeClient& client, ConsoleOutput& output, LatencyTracker& latency);
+bool handle_latency_command(std::string_view line, ExchangeClient& client, std::string_view identity,
+                            ConsoleOutput& output, const LatencyTracker& latency);
+bool handle_file_command(std::string_view line, ExchangeClient& client, ConsoleOutput& output);
+std::string describe_transfer(const FileProgress& progress, double seconds);
+void report_output(ConsoleOutput& output, const std::string& target);
+int run_interactive(ExchangeClient& client, ConsoleOutput& output, LatencyTracker& latency);
+int run_batch(ExchangeClient& client, const std::string& path, ConsoleOutput& output);
+int run_gateway(const ClientConfig& base, const std::string& path, int connection_count, ConsoleOutput& output,
+                LatencyTracker& latency);
+bool split_message(std::string_view line, std::string_view& destination, std::string_view& message);
 
 // ====================================================================
 //                           MAIN CLIENT LOGIC
 // ====================================================================
 
 int main(int argc, char *argv[]) {
-    // Must now expect 3 arguments: ./client <CampusName> <Local_UDP_Port>
-    if (argc != 3) { 
-        std::cerr << "Usage: " << argv[0] << " <CampusName> <Local_UDP_Port (e.g., 5001, 5002)>" << std::endl;
+    // Must now expect 3 arguments: ./client <CampusName> <Local_UDP_Port>, optionally
+    // followed by --batch <file|-> [--coalesce-bytes <n>] [--coalesce-ms <ms>], or
+    // by --gateway <campus list> [--connections <n>], and by --output <console|quiet|file|->,
+    // --downloads <dir> and --accept-files <max bytes> (offered files are refused without it)
+    std::string batch_path, gateway_path, output_target = "console", download_dir = ClientConfig().download_dir;
+    uint64_t accept_files = 0;
+    size_t coalesce_bytes = BATCH_COALESCE_BYTES;
+    int coalesce_ms = BATCH_COALESCE_MS;
+    int connections = GATEWAY_CONNECTIONS;
+    bool usage_ok = argc >= 3 && argc % 2 == 1;
+    for (int i = 3; usage_ok && i + 1 < argc; i += 2) {
+        std::string flag = argv[i];
+        try {
+            if (flag == "--batch") batch_path = argv[i + 1];
+            else if (flag == "--coalesce-bytes") coalesce_bytes = std::stoul(argv[i + 1]);
+            else if (flag == "--coalesce-ms") coalesce_ms = std::stoi(argv[i + 1]);
+            else if (flag == "--gateway") gateway_path = argv[i + 1];
+            else if (flag == "--connections") connections = std::stoi(argv[i + 1]);
+            else if (flag == "--output") output_target = argv[i + 1];
+            else if (flag == "--downloads") download_dir = argv[i + 1];
+            else if (flag == "--accept-files") accept_files = std::stoull(argv[i + 1]);
+            else usage_ok = false;
+        } catch (...) {
+            usage_ok = false;
+        }
+    }
+    if (!usage_ok || (!batch_path.empty() && !gateway_path.empty()) || connections < 1) {
+        std::cerr << "Usage: " << argv[0] << " <CampusName> <Local_UDP_Port (e.g., 5001, 5002)>"
+                  << " [--batch <file|-> [--coalesce-bytes <n>] [--coalesce-ms <ms>]]"
+                  << " [--gateway <campus list> [--connections <n>]]"
+                  << " [--output <console|quiet|json file|->] [--downloads <dir>] [--accept-files <max bytes>]" << std::endl;
         return EXIT_FAILURE;
     }
 
-    campus_name = argv[1];
-    
+    ClientConfig config;
+    config.campus_name = argv[1];
+    config.server_ip = SERVER_IP;
+    config.server_port = TCP_PORT;
+    config.download_dir = download_dir;
+    if (accept_files > 0) config.max_file_bytes = accept_files;
+
     // 1. Get the unique UDP port from arguments
     try {
-        local_udp_port = std::stoi(argv[2]);
+        config.udp_port = std::stoi(argv[2]);
     } catch (...) {
         std::cerr << "Invalid port number provided: " << argv[2] << std::endl;
         return EXIT_FAILURE;
     }
-    
-    // 2. Setup UDP Listener Socket (for Server Broadcasts)
-    udp_sock = setup_udp_listener(local_udp_port); // Pass the unique port
-    if (udp_sock < 0) return EXIT_FAILURE;
+    if (!batch_path.empty()) {
+        config.coalesce_bytes = coalesce_bytes;
+        config.coalesce_ms = coalesce_ms;
+    }
 
-    // 3. Setup TCP Connection (for Routing)
-    tcp_sock = setup_tcp_connection(campus_name, local_udp_port); // Pass the unique port for registration
-    if (tcp_sock < 0) {
-        close(udp_sock);
+    // 2. Where received messages go
+    OutputMode output_mode = OUTPUT_CONSOLE;
+    int json_fd = -1;
+    if (output_target == "quiet") {
+        output_mode = OUTPUT_QUIET;
+    } else if (output_target != "console") {
+        output_mode = OUTPUT_JSON;
+        json_fd = output_target == "-" ? STDOUT_FILENO
+                                       : open(output_target.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (json_fd < 0) {
+            perror(("Cannot open output file " + output_target).c_str());
+            return EXIT_FAILURE;
+        }
+    }
+    ConsoleOutput output(output_mode, json_fd, config.campus_name + " > ");
+    LatencyTracker latency;
+    if (!gateway_path.empty()) {
+        int status = run_gateway(config, gateway_path, connections, output, latency);
+        report_output(output, output_target);
+        return status;
+    }
+
+    // 3. Setup the session: UDP listener (for Server Broadcasts) and TCP connection
+    // (for Routing), registering with the unique port
+    ExchangeClient client(config);
+    attach_console_output(client, output, latency);
+    if (accept_files > 0) client.on_file_offer = [](const FileOffer&) { return true; }; // Up to max_file_bytes
+    if (!client.start()) {
+        output.error(client.last_error());
         return EXIT_FAILURE;
     }
-    
-    std::cout << "🚀 Client '" << campus_name << "' started (TCP:" << TCP_PORT << ", UDP:" << local_udp_port << ")" << std::endl;
+    output.notice("[INFO] UDP listener bound to port " + std::to_string(config.udp_port));
+    while (!client.connected() && client.process_events(-1)) {
+    }
+    if (client.closed()) return EXIT_FAILURE; // The first connection failed (already reported)
 
-    // 4. Start dedicated thread for receiving TCP & UDP messages
-    std::thread receiver_thread(receive_handler, tcp_sock, udp_sock);
-    
-    // 5. Main Thread: User Input and TCP Sending
-    std::string line;
-    std::cout << "\n[HELP] Commands:" << std::endl;
-    std::cout << "       <DESTINATION>:<MESSAGE>  (e.g., Karachi:Hello)" << std::endl;
-    std::cout << "       BROADCAST:<MESSAGE>      (Sends routing message to Server)" << std::endl;
-    std::cout << "       exit / quit" << std::endl;
-
-    while (running) {
-        std::cout << "\n" << campus_name << " > ";
-        // Clear input stream if needed, then get line
-        if (!(std::getline(std::cin, line))) break; 
-
-        if (line == "exit" || line == "quit") {
-            running = false;
-            shutdown(tcp_sock, SHUT_RDWR); 
-            break;
-        }
+    output.notice("🚀 Client '" + config.campus_name + "' started (TCP:" + std::to_string(TCP_PORT) +
+                  ", UDP:" + std::to_string(config.udp_port) + ")");
+
+    // 4. Non-interactive: stream the file (or stdin) through, then leave
+    if (!batch_path.empty()) {
+        int status = run_batch(client, batch_path, output);
+        report_output(output, output_target);
+        return status;
+    }
 
-        if (line.empty()) continue;
+    // 5. Interactive: user input and received messages on one thread
+    int status = run_interactive(client, output, latency);
+    output.notice("\nClient '" + config.campus_name + "' shutting down.");
+    report_output(output, output_target);
+    return status;
+}
 
-        if (send(tcp_sock, line.c_str(), line.length(), 0) < 0) {
-            perror("TCP send failed");
+// Routes what arrives, and connection changes, to the output stage; the console
+// text is what the client has always printed
+void attach_console_output(ExchangeClient& client, ConsoleOutput& output, LatencyTracker& latency) {
+    client.on_message = [&output](std::string_view message) { output.message({}, message); };
+    client.on_pong = [&output, &latency](const PingResult& result) { latency.record(result, output); };
+    client.on_broadcast = [&output](std::string_view broadcast) { output.broadcast(broadcast); };
+    std::map<std::tuple<bool, std::string, uint64_t>, std::chrono::steady_clock::time_point> transfer_starts;
+    client.on_file = [&output, transfer_starts](const FileProgress& progress) mutable {
+        auto key = std::make_tuple(progress.incoming, progress.peer, progress.id);
+        auto now = std::chrono::steady_clock::now();
+        if (progress.event == FILE_STARTED) transfer_starts[key] = now;
+        auto it = transfer_starts.find(key);
+        double seconds = it == transfer_starts.end() ? 0 : std::chrono::duration<double>(now - it->second).count();
+        if (progress.event == FILE_COMPLETED || progress.event == FILE_FAILED) {
+            if (it != transfer_starts.end()) transfer_starts.erase(it);
         }
+        output.notice(describe_transfer(progress, seconds), "file");
+    };
+    bool first_connection = true;
+    client.on_event = [first_connection, &output, &client](ClientEvent event, const std::string& detail) mutable {
+        switch (event) {
+            case CLIENT_CONNECTED:
+                if (first_connection) {
+                    output.notice("[INFO] TCP connection established with server.", "connected");
+                } else {
+                    output.notice("[RECONNECT] Connected again" + (detail.empty() ? "" : "; " + detail) + ".", "connected");
+                }
+                first_connection = false;
+                break;
+            case CLIENT_CONNECTION_LOST:
+                output.notice("\n[SERVER] " + detail + ". Reconnecting...", "connection_lost");
+                break;
+            case CLIENT_RECONNECT_SCHEDULED:
+                output.notice("[RECONNECT] Attempt " + detail + "...");
+                break;
+            case CLIENT_ERROR:
+                output.error("[ERROR] " + detail, "error");
+                break;
+            case CLIENT_ATTACHED:
+                break; // Gateway mode keeps its own count
+            case CLIENT_CLOSED:
+                if (client.close_status() != CLOSE_FINISHED) output.error("\n[SERVER] " + detail + ". Exiting...", "closed");
+                break;
+        }
+    };
+}
+
+// Where the messages went, for the modes that did not show them
+void report_output(ConsoleOutput& output, const std::string& target) {
+    if (output.output_mode() == OUTPUT_QUIET) {
+        output.notice("[OUTPUT] Quiet mode: " + std::to_string(output.message_count()) + " message(s) and " +
+                      std::to_string(output.broadcast_count()) + " broadcast(s) received.");
+    } else if (output.output_mode() == OUTPUT_JSON) {
+        output.notice("[OUTPUT] " + std::to_string(output.record_count()) + " JSON record(s) written to " +
+                      (target == "-" ? "stdout" : target) + ".");
+    }
+}
+
+// "<DESTINATION>:<MESSAGE>"; false if there is no ':'
+bool split_message(std::string_view line, std::string_view& destination, std::string_view& message) {
+    size_t colon_pos = line.find(':');
+    if (colon_pos == std::string_view::npos || colon_pos == 0) return false;
+    destination = line.substr(0, colon_pos);
+    message = line.substr(colon_pos + 1);
+    return true;
+}
+
+// PING, PING:<DESTINATION> and RTT; false for anything else
+bool handle_latency_command(std::string_view line, ExchangeClient& client, std::string_view identity,
+                            ConsoleOutput& output, const LatencyTracker& latency) {
+    if (line == "RTT") {
+        latency.print(output);
+        return true;
     }
+    if (line != "PING" && line.compare(0, 5, "PING:") != 0) return false;
+    std::string_view destination = line.size() > 5 ? line.substr(5) : std::string_view();
+    if (!client.ping(destination, identity)) output.notice("\n[PING] Not sent: " + client.last_error() + ".");
+    return true;
+}
 
-    if (receiver_thread.joinable()) {
-        receiver_thread.join();
+// SENDFILE:<DESTINATION>:<PATH> and FILES; false for anything else
+bool handle_file_command(std::string_view line, ExchangeClient& client, ConsoleOutput& output) {
+    if (line == "FILES") {
+        std::vector<FileProgress> transfers = client.transfers();
+        if (transfers.empty()) output.notice("\n[FILE] No transfers in progress.");
+        for (const FileProgress& transfer : transfers) output.notice("\n" + describe_transfer(transfer, 0));
+        return true;
     }
-    
-    close(tcp_sock);
-    close(udp_sock);
-    std::cout << "\nClient '" << campus_name << "' shutting down." << std::endl;
+    if (line.compare(0, 9, "SENDFILE:") != 0) return false;
+    std::string_view destination, path;
+    if (!split_message(line.substr(9), destination, path) || path.empty()) {
+        output.notice("[WARNING] Use SENDFILE:<DESTINATION>:<PATH>.");
+    } else if (!client.send_file(destination, std::string(path))) {
+        output.notice("\n[FILE] Not sent: " + client.last_error() + ".");
+    } else {
+        output.notice("\n[FILE] Offering " + std::string(path) + " to " + std::string(destination) + "...");
+    }
+    return true;
+}
 
-    return EXIT_SUCCESS;
+static std::string format_bytes(uint64_t bytes) {
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(1);
+    if (bytes < 1048576) {
+        out << bytes / 1024.0 << " KB";
+    } else {
+        out << bytes / 1048576.0 << " MB";
+    }
+    return out.str();
+}
+
+// One status line per transfer event; 'seconds' since it started, for the rate (0 = unknown)
+std::string describe_transfer(const FileProgress& progress, double seconds) {
+    std::string direction = progress.incoming ? " from " : " to ";
+    std::string line = "[FILE] " + progress.name + direction + progress.peer + ": ";
+    int percent = progress.size ? (int)(progress.bytes * 100 / progress.size) : 100;
+    switch (progress.event) {
+        case FILE_STARTED:
+            line += (progress.incoming ? "receiving " : "sending ") + format_bytes(progress.size);
+            if (progress.resumed_from > 0) line += ", resuming at " + format_bytes(progress.resumed_from);
+            break;
+        case FILE_PROGRESS:
+            line += format_bytes(progress.bytes) + " / " + format_bytes(progress.size) + " (" + std::to_string(percent) + "%)";
+            break;
+        case FILE_COMPLETED:
+            line += (progress.incoming ? "received " : "delivered ") + format_bytes(progress.size);
+            break;
+        case FILE_FAILED:
+            line += "failed at " + format_bytes(progress.bytes) + " (" + progress.detail + ")";
+            break;
+    }
+    if (seconds > 0 && progress.event != FILE_FAILED) {
+        uint64_t moved = progress.bytes > progress.resumed_from ? progress.bytes - progress.resumed_from : 0;
+        line += " in " + std::to_string((int)(seconds * 1000)) + " ms, " + format_bytes((uint64_t)(moved / seconds)) + "/s";
+    }
+    return line;
 }
 
 // ====================================================================
-//                         SOCKET SETUP FUNCTIONS
+//                          INTERACTIVE MODE
 // ====================================================================
 
-// UDP listener now takes a port number
-int setup_udp_listener(int port_num) {
-    int sock;
-    struct sockaddr_in addr;
-    
-    if ((sock = socket(AF_INET, SOCK_DGRAM, 0)) < 0) {
-        perror("UDP socket creation failed");
-        return -1;
-    }
-    
-    // Set socket options for reuse (optional but good practice)
-    int opt = 1;
-    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
-
-    memset(&addr, 0, sizeof(addr));
-    addr.sin_family = AF_INET;
-    addr.sin_addr.s_addr = INADDR_ANY; 
-    addr.sin_port = htons(port_num); // Use the provided unique port
-
-    if (bind(sock, (const struct sockaddr *)&addr, sizeof(addr)) < 0) {
-        // The error will be reported here if the port is in use
-        perror("UDP bind failed");
-        close(sock);
-        return -1;
-    }
-    
-    std::cout << "[INFO] UDP listener bound to port " << port_num << std::endl;
-    return sock;
-}
+// One poll() covers the keyboard and the session, so no receiver thread is needed
+int run_interactive(ExchangeClient& client, ConsoleOutput& output, LatencyTracker& latency) {
+    output.notice("\n[HELP] Commands:\n"
+                  "       <DESTINATION>:<MESSAGE>  (e.g., Karachi:Hello)\n"
+                  "       #<ID>:<MESSAGE>          (Addresses a campus by its ID; names are resolved automatically)\n"
+                  "       BROADCAST:<MESSAGE>      (Sends routing message to Server)\n"
+                  "       PING / PING:<DESTINATION> (Round trip to the server / through it to a campus)\n"
+                  "       RTT                      (Latency histograms of the answered probes)\n"
+                  "       SENDFILE:<DESTINATION>:<PATH> (Streams a file; an interrupted one resumes)\n"
+                  "       FILES                    (Transfers in progress)\n"
+                  "       exit / quit\n");
+
+    char chunk[BUFFER_SIZE];
+    std::string partial_line;   // Typed (or piped) input still waiting for its '\n'
+    struct pollfd fds[2] = {{STDIN_FILENO, POLLIN, 0}, {client.fd(), POLLIN, 0}};
+    while (!client.closed()) {
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            perror("poll error");
+            return EXIT_FAILURE;
+        }
+        if (fds[1].revents) client.process_events(0);
+        if (!fds[0].revents) continue;
 
-// TCP connection logic remains mostly the same, just passing the port along
-int setup_tcp_connection(const std::string& name, int udp_port) {
-    int sock;
-    struct sockaddr_in server_addr;
+        ssize_t got = read(STDIN_FILENO, chunk, sizeof(chunk));
+        if (got <= 0) {
+            // End of input: end the session as 'exit' would
+            fds[0].fd = -1;
+            client.quit();
+            continue;
+        }
+        partial_line.append(chunk, got);
+        size_t newline_pos;
+        while ((newline_pos = partial_line.find('\n')) != std::string::npos) {
+            std::string line = partial_line.substr(0, newline_pos);
+            partial_line.erase(0, newline_pos + 1);
+            if (!line.empty() && line.back() == '\r') line.pop_back();
 
-    if ((sock = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
-        perror("TCP socket creation failed");
-        return -1;
+            if (line == "exit" || line == "quit") {
+                fds[0].fd = -1; // Stop reading input; the session ends once the server closes
+                client.quit(); // End the session instead of leaving it resumable
+                break;
+            }
+            if (!line.empty() && !handle_latency_command(line, client, {}, output, latency) &&
+                !handle_file_command(line, client, output)) {
+                std::string_view destination, message;
+                if (!split_message(line, destination, message)) {
+                    output.notice("[WARNING] Use <DESTINATION>:<MESSAGE>.");
+                } else if (!client.send(destination, message)) {
+                    output.notice("[OUTBOX] Message dropped: " + client.last_error() + ".");
+                } else if (!client.connected()) {
+                    output.notice("[OUTBOX] Not connected; message held until the server is back.");
+                }
+            }
+            output.notice("");
+        }
     }
+    return EXIT_SUCCESS;
+}
 
-    memset(&server_addr, 0, sizeof(server_addr));
-    server_addr.sin_family = AF_INET;
-    server_addr.sin_port = htons(TCP_PORT);
+// ====================================================================
+//                              BATCH MODE
+// ====================================================================
 
-    if (inet_pton(AF_INET, SERVER_IP, &server_addr.sin_addr) <= 0) {
-        std::cerr << "Invalid address/Address not supported" << std::endl;
-        close(sock);
-        return -1;
+// Streams one message per line from 'path' ("-" for stdin) without waiting for any
+// reply. The session coalesces frames into large gathered writes; input is only read
+// while its send queue has room, so a slow server (or an outage) pushes back on the
+// file or pipe instead of growing memory.
+int run_batch(ExchangeClient& client, const std::string& path, ConsoleOutput& output) {
+    int input_fd = path == "-" ? STDIN_FILENO : open(path.c_str(), O_RDONLY);
+    if (input_fd < 0) {
+        perror(("Cannot open batch input " + path).c_str());
+        return EXIT_FAILURE;
     }
 
-    if (connect(sock, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0) {
-        perror("TCP connection failed");
-        close(sock);
-        return -1;
-    }
-    
-    std::cout << "[INFO] TCP connection established with server." << std::endl;
+    std::vector<char> read_buffer(BATCH_COALESCE_BYTES);
+    size_t queue_limit = ClientConfig().max_queued_bytes;
+    std::string partial_line;   // Input line still waiting for its '\n'
+    uint64_t skipped = 0;
+    bool input_done = false;
+    auto start = std::chrono::steady_clock::now();
+
+    auto add_line = [&](std::string_view line) {
+        if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+        if (line.empty()) return;
+        std::string_view destination, message;
+        if (!split_message(line, destination, message) || !client.send(destination, message)) skipped++;
+    };
 
-    // Send initial registration message: <CAMPUS_NAME>:<UDP_PORT>
-    std::string registration_msg = name + ":" + std::to_string(udp_port);
-    if (send(sock, registration_msg.c_str(), registration_msg.length(), 0) < 0) {
-        perror("Registration send failed");
-        close(sock);
-        return -1;
+    while (!client.closed()) {
+        // Read more only while a whole read's worth of frames still fits in the queue
+        bool room = client.queued_bytes() + 2 * read_buffer.size() <= queue_limit;
+        struct pollfd fds[2] = {{input_done || !room ? -1 : input_fd, POLLIN, 0}, {client.fd(), POLLIN, 0}};
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            perror("poll error");
+            break;
+        }
+        if (fds[1].revents) client.process_events(0);
+        if (!input_done && fds[0].revents) {
+            ssize_t got = read(input_fd, read_buffer.data(), read_buffer.size());
+            if (got < 0 && errno == EINTR) continue;
+            if (got <= 0) {
+                if (got < 0) perror("Batch input read failed");
+                input_done = true;
+                if (!partial_line.empty()) add_line(partial_line); // Last line without a '\n'
+            } else {
+                size_t line_start = 0;
+                for (ssize_t i = 0; i < got; ++i) {
+                    if (read_buffer[i] != '\n') continue;
+                    if (partial_line.empty()) {
+                        add_line(std::string_view(&read_buffer[line_start], i - line_start));
+                    } else {
+                        partial_line.append(&read_buffer[line_start], i - line_start);
+                        add_line(partial_line);
+                        partial_line.clear();
+                    }
+                    line_start = i + 1;
+                }
+                partial_line.append(&read_buffer[line_start], got - line_start);
+            }
+        }
+        // Everything handed over and written (an outage waits for the reconnect): QUIT,
+        // and the session closes once the server has processed it all
+        if (input_done && client.connected() && client.queued_bytes() == 0) client.quit();
     }
-    
-    return sock;
+    if (input_fd != STDIN_FILENO) close(input_fd);
+
+    const ClientStats& stats = client.stats();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::ostringstream summary;
+    summary << std::fixed << std::setprecision(2);
+    summary << "\n[BATCH] Sent " << stats.messages_sent << " messages (" << stats.bytes_sent << " bytes) in " << stats.writes
+            << " writes over " << seconds << " s: " << (uint64_t)(stats.messages_sent / std::max(seconds, 1e-9))
+            << " msgs/sec, " << stats.bytes_sent / std::max(seconds, 1e-9) / 1e6 << " MB/sec, "
+            << (stats.writes ? stats.messages_sent / stats.writes : 0) << " messages/write";
+    if (skipped) summary << ", " << skipped << " line(s) skipped (not <DESTINATION>:<MESSAGE>)";
+    summary << ".";
+    output.notice(summary.str());
+    return input_done && client.close_status() == CLOSE_FINISHED ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
 // ====================================================================
-//                         RECEIVER THREAD LOGIC
+//                             GATEWAY MODE
 // ====================================================================
 
-void receive_handler(int tcp_fd, int udp_fd) {
-    char buffer[BUFFER_SIZE];
-    fd_set readfds;
-    int max_sd = std::max(tcp_fd, udp_fd);
-    
-    while (running) {
-        FD_ZERO(&readfds);
-        if (tcp_fd > 0) FD_SET(tcp_fd, &readfds);
-        if (udp_fd > 0) FD_SET(udp_fd, &readfds);
-
-        // Blocking call waits for activity on either socket
-        int activity = select(max_sd + 1, &readfds, NULL, NULL, NULL);
-
-        if ((activity < 0) && (errno != EINTR)) {
-            if (running) {
-                 perror("select error");
+// One campus hosted by this process. It has no socket of its own: its traffic is
+// multiplexed over one of the gateway's connections, and inbound messages tagged with
+// its name are demultiplexed to it.
+struct HostedCampus {
+    ExchangeClient *connection = nullptr;
+    bool attached = false;
+    uint64_t received = 0;
+};
+
+// Per-campus inbound handler
+void handle_hosted_message(const std::string& name, HostedCampus& campus, std::string_view message,
+                           ConsoleOutput& output) {
+    campus.received++;
+    output.message(name, message);
+}
+
+// Hosts every campus listed in 'path' (one name per line, '#' starts a comment) over
+// 'connection_count' sessions registered as <GatewayName>-1, -2, ... on consecutive UDP
+// ports. Typed lines are "@<CAMPUS>:<DESTINATION>:<MESSAGE>", or "<DESTINATION>:<MESSAGE>"
+// sent as the gateway itself.
+int run_gateway(const ClientConfig& base, const std::string& path, int connection_count, ConsoleOutput& output,
+                LatencyTracker& latency) {
+    std::ifstream file(path);
+    if (!file) {
+        perror(("Cannot open gateway campus list " + path).c_str());
+        return EXIT_FAILURE;
+    }
+    std::map<std::string, HostedCampus, std::less<>> hosted;
+    std::vector<std::string> order;   // Campus names in file order, for round-robin placement
+    std::string line;
+    while (std::getline(file, line)) {
+        line = line.substr(0, line.find('#'));
+        line.erase(0, line.find_first_not_of(" \t\r"));
+        line.erase(line.find_last_not_of(" \t\r") + 1);
+        if (!line.empty() && hosted.emplace(line, HostedCampus()).second) order.push_back(line);
+    }
+
+    // 1. The connections, each an ordinary session with the console output
+    std::vector<std::unique_ptr<ExchangeClient>> connections;
+    size_t attached_count = 0;
+    for (int i = 0; i < connection_count; ++i) {
+        ClientConfig config = base;
+        config.campus_name = base.campus_name + "-" + std::to_string(i + 1);
+        config.udp_port = base.udp_port + i;
+        connections.emplace_back(new ExchangeClient(config));
+        ExchangeClient& connection = *connections.back();
+        attach_console_output(connection, output, latency);
+        if (i > 0) connection.on_broadcast = nullptr; // Every connection gets each broadcast; show it once
+
+        auto console_event = connection.on_event;
+        connection.on_event = [&, console_event](ClientEvent event, const std::string& detail) {
+            if (event != CLIENT_ATTACHED) {
+                console_event(event, detail);
+                return;
             }
-            break;
+            auto it = hosted.find(detail);
+            if (it == hosted.end() || it->second.attached) return; // Re-attached after a reconnect
+            it->second.attached = true;
+            if (++attached_count == hosted.size()) {
+                output.notice("[GATEWAY] All " + std::to_string(hosted.size()) + " campuses attached over " +
+                              std::to_string(connection_count) + " connection(s).");
+            }
+        };
+        connection.on_identity_message = [&](std::string_view identity, std::string_view message) {
+            auto it = hosted.find(identity);
+            if (it != hosted.end()) handle_hosted_message(it->first, it->second, message, output);
+        };
+    }
+
+    // 2. Spread the campuses over the connections; they attach as each one registers
+    for (size_t i = 0; i < order.size(); ++i) {
+        HostedCampus& campus = hosted[order[i]];
+        campus.connection = connections[i % connections.size()].get();
+        if (!campus.connection->attach(order[i])) {
+            output.error("[GATEWAY] Skipping '" + order[i] + "': " + campus.connection->last_error() + ".");
+        }
+    }
+    for (auto& connection : connections) {
+        if (!connection->start()) {
+            output.error(connection->last_error());
+            return EXIT_FAILURE;
         }
+    }
+    output.notice("🚀 Gateway '" + base.campus_name + "' hosting " + std::to_string(hosted.size()) + " campuses over " +
+                  std::to_string(connection_count) + " connection(s) (UDP:" + std::to_string(base.udp_port) + "-" +
+                  std::to_string(base.udp_port + connection_count - 1) + ")");
+    output.notice("\n[HELP] Commands:\n"
+                  "       @<CAMPUS>:<DESTINATION>:<MESSAGE>  (Sends as a hosted campus)\n"
+                  "       <DESTINATION>:<MESSAGE>            (Sends as the gateway)\n"
+                  "       [@<CAMPUS>:]PING[:<DESTINATION>]    (Latency probe; RTT shows the histograms)\n"
+                  "       exit / quit");
 
-        // 1. Check TCP Socket (Inter-Campus Messages)
-        if (FD_ISSET(tcp_fd, &readfds)) {
-            int bytes_received = recv(tcp_fd, buffer, BUFFER_SIZE - 1, 0);
-            if (bytes_received > 0) {
-                buffer[bytes_received] = '\0';
-                std::cout << "\n<-- TCP MESSAGE RECEIVED -->" << std::endl;
-                std::cout << "   " << buffer << std::endl;
-                std::cout << campus_name << " > " << std::flush;
-            } else if (bytes_received == 0) {
-                std::cout << "\n[SERVER] Server closed the connection. Exiting..." << std::endl;
-                running = false;
-                break;
-            } else {
-                if (running) {
-                    perror("TCP recv failed");
-                }
-                running = false;
+    // 3. One poll() over the keyboard and every connection
+    std::vector<struct pollfd> fds(connections.size() + 1);
+    fds[0] = {STDIN_FILENO, POLLIN, 0};
+    for (size_t i = 0; i < connections.size(); ++i) fds[i + 1] = {connections[i]->fd(), POLLIN, 0};
+    char chunk[BUFFER_SIZE];
+    std::string partial_line;
+    auto quit_all = [&] {
+        fds[0].fd = -1;
+        for (auto& connection : connections) connection->quit();
+    };
+    auto all_closed = [&] {
+        return std::all_of(connections.begin(), connections.end(), [](const auto& c) { return c->closed(); });
+    };
+    while (!all_closed()) {
+        if (poll(fds.data(), fds.size(), -1) < 0) {
+            if (errno == EINTR) continue;
+            perror("poll error");
+            return EXIT_FAILURE;
+        }
+        for (size_t i = 0; i < connections.size(); ++i) {
+            if (fds[i + 1].revents) connections[i]->process_events(0);
+        }
+        if (!fds[0].revents) continue;
+
+        ssize_t got = read(STDIN_FILENO, chunk, sizeof(chunk));
+        if (got <= 0) {
+            quit_all();
+            continue;
+        }
+        partial_line.append(chunk, got);
+        size_t newline_pos;
+        while ((newline_pos = partial_line.find('\n')) != std::string::npos) {
+            std::string input = partial_line.substr(0, newline_pos);
+            partial_line.erase(0, newline_pos + 1);
+            if (!input.empty() && input.back() == '\r') input.pop_back();
+            if (input == "exit" || input == "quit") {
+                quit_all();
                 break;
             }
-        }
+            if (input.empty()) continue;
 
-        // 2. Check UDP Socket (Broadcast/Status Messages)
-        if (FD_ISSET(udp_fd, &readfds)) {
-            struct sockaddr_in server_addr;
-            socklen_t addr_len = sizeof(server_addr);
-            
-            int bytes_received = recvfrom(udp_fd, buffer, BUFFER_SIZE - 1, 0, (struct sockaddr*)&server_addr, &addr_len);
-            
-            if (bytes_received > 0) {
-                buffer[bytes_received] = '\0';
-                std::cout << "\n*** UDP BROADCAST RECEIVED ***" << std::endl;
-                std::cout << "   " << buffer << std::endl;
-                std::cout << campus_name << " > " << std::flush;
+            std::string_view text(input), destination, message;
+            ExchangeClient *connection = connections[0].get();
+            std::string_view identity;
+            if (text[0] == '@') {
+                size_t colon_pos = text.find(':');
+                auto it = colon_pos == std::string_view::npos ? hosted.end() : hosted.find(text.substr(1, colon_pos - 1));
+                if (it == hosted.end()) {
+                    output.notice("[WARNING] Not a hosted campus. Use @<CAMPUS>:<DESTINATION>:<MESSAGE>.");
+                    continue;
+                }
+                identity = it->first;
+                connection = it->second.connection;
+                text.remove_prefix(colon_pos + 1);
             }
+            if (handle_latency_command(text, *connection, identity, output, latency)) {
+                // Probe sent (or histograms shown)
+            } else if (!split_message(text, destination, message)) {
+                output.notice("[WARNING] Use <DESTINATION>:<MESSAGE>.");
+            } else if (!connection->send_as(identity, destination, message)) {
+                output.notice("[OUTBOX] Message dropped: " + connection->last_error() + ".");
+            }
+            output.prompt();
         }
     }
-}
\ No newline at end of file
+
+    uint64_t received = 0;
+    for (const auto& entry : hosted) received += entry.second.received;
+    output.notice("\nGateway '" + base.campus_name + "' shutting down (" + std::to_string(attached_count) +
+                  " campuses attached, " + std::to_string(received) + " messages delivered to them).");
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,549 @@
+// Information Exchange benchmarks: reproduces the measurements behind the server's
+// hot-path changes on the code the server actually runs (ie_memory.h, ie_phf.h,
+// ie_frames.h), and the socket paths behind its FILE relay and zero-copy sends over
+// loopback TCP. Kept out of the server so it can count heap allocations by replacing
+// the global operator new without touching the production binary.
+//
+// Usage: ie_bench [alloc|lookup|scan|relay|zerocopy|all] [count] [campus directory file]
+//        (count is messages, lookups, 64 KB chunks or 60 KB payloads, per benchmark)
+//
+// Build: cmake -S . -B build && cmake --build build --target ie_bench
+//    or: g++ -std=c++17 -O2 -pthread ie_bench.cpp -o ie_bench
+#include <iostream>
+#include <vector>
+#include <map>
+#include <string>
+#include <string_view>
+#include <fstream>
+#include <chrono>
+#include <functional>
+#include <thread>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <linux/errqueue.h>
+#include "ie_memory.h"
+#include "ie_phf.h"
+#include "ie_frames.h"
+
+// --- Configuration ---
+#define PER_MESSAGE_READ_BYTES 1024     // The handler's read size before read batching (BUFFER_SIZE)
+#define BATCH_READ_BYTES 65536          // The handler's read size now (RECV_BATCH_BYTES)
+#define DEFAULT_COUNT 100000            // Messages (or lookups) per benchmark
+#define RELAY_CHUNK_BYTES 65536         // FILE chunk body size (the server's FILE_CHUNK_MAX)
+#define RELAY_PIPE_BYTES 131072         // Relay pipe capacity asked for (the server's SPLICE_PIPE_BYTES)
+#define RELAY_DEFAULT_CHUNKS 16384      // Chunks relayed by default: 1 GB
+#define ZEROCOPY_PAYLOAD_BYTES 60000    // Payload size for the zero-copy benchmark (above ZEROCOPY_MIN_BYTES)
+#define ZEROCOPY_DEFAULT_SENDS 20000    // Payloads sent by default: 1.2 GB
+
+// ====================================================================
+//                        ALLOCATION COUNTING
+// ====================================================================
+
+// Every operator new on a thread bumps its counter, so a benchmark counts only the
+// heap allocations its own thread makes
+static thread_local uint64_t thread_allocations = 0;
+
+// Both out of line, so GCC never pairs an inlined malloc() with an operator delete
+__attribute__((noinline)) void *operator new(size_t size) {
+    thread_allocations++;
+    if (void *pointer = malloc(size ? size : 1)) return pointer;
+    throw std::bad_alloc();
+}
+
+__attribute__((noinline)) void operator delete(void *pointer) noexcept { free(pointer); }
+__attribute__((noinline)) void operator delete(void *pointer, size_t) noexcept { free(pointer); }
+
+// ====================================================================
+//                      ROUTED MESSAGE ALLOCATIONS
+// ====================================================================
+
+// Pops one '\n'-terminated frame (without the terminator or a trailing '\r') from 'pending'.
+// The handler's framing before read batching, unchanged.
+static bool next_frame(std::string& pending, std::string& frame) {
+    size_t newline_pos = pending.find('\n');
+    if (newline_pos == std::string::npos) return false;
+    size_t frame_len = newline_pos;
+    if (frame_len > 0 && pending[frame_len - 1] == '\r') frame_len--;
+    frame.assign(pending, 0, frame_len);
+    pending.erase(0, newline_pos + 1);
+    return true;
+}
+
+// Feeds one synthetic stream of routed frames through the handler's receive path as it
+// was before read batching (1 KB reads, each frame copied out of the pending buffer,
+// payload built by the router) and as it is now (RECV_BATCH_BYTES reads, one scan per
+// read into arena spans, payload built from the interned "FROM <sender>: " prefix).
+// Destination lookup and queueing are the same for both and are left out.
+static void run_allocation_benchmark(int messages) {
+    const std::string sender_name = "Bench";
+    const std::string from_prefix = "FROM " + sender_name + ": ";
+    std::string stream;
+    for (int i = 0; i < messages; ++i) {
+        stream += "Campus" + std::to_string(i % 16) + ":benchmark payload number " + std::to_string(i) + " padded to a typical size\n";
+    }
+    size_t sink = 0; // Keeps the work observable
+
+    auto per_message = [&] {
+        std::string pending, frame;
+        for (size_t offset = 0; offset < stream.size(); offset += PER_MESSAGE_READ_BYTES) {
+            pending.append(stream, offset, PER_MESSAGE_READ_BYTES);
+            while (next_frame(pending, frame)) {
+                // route_tcp_message() up to the lookup
+                size_t colon_pos = frame.find(':');
+                std::string_view destination(frame.data(), colon_pos);
+                std::string_view content(frame.data() + colon_pos + 1, frame.size() - colon_pos - 1);
+                PooledString final_msg;
+                final_msg.reserve(5 + sender_name.size() + 2 + content.size() + 1);
+                final_msg.append("FROM ").append(sender_name).append(": ").append(content).push_back('\n');
+                Payload payload = make_payload(std::move(final_msg));
+                sink += destination.size() + payload->size();
+            }
+        }
+    };
+
+    Arena scratch;
+    auto batched = [&] {
+        std::string pending;
+        for (size_t offset = 0; offset < stream.size(); offset += BATCH_READ_BYTES) {
+            pending.append(stream, offset, BATCH_READ_BYTES);
+            {
+                ArenaVector<FrameSpan> spans{ArenaAllocator<char>(scratch)};
+                size_t consumed = scan_frames(pending.data(), pending.size(), spans);
+                for (const FrameSpan& span : spans) {
+                    std::string_view frame(pending.data() + span.offset, span.length);
+                    std::string_view destination = frame.substr(0, span.colon);
+                    Payload payload = format_routed_message(from_prefix, frame.substr(span.colon + 1));
+                    sink += destination.size() + payload->size();
+                }
+                pending.erase(0, consumed);
+            }
+            scratch.reset();
+        }
+    };
+
+    auto measure = [&](const char *label, const std::function<void()>& run) {
+        uint64_t allocations_before = thread_allocations;
+        auto start = std::chrono::steady_clock::now();
+        run();
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        uint64_t allocations = thread_allocations - allocations_before;
+        printf("%-22s %10.2f allocations/msg  %8.1f ns/msg\n", label, (double)allocations / messages,
+               (double)std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count() / messages);
+    };
+
+    // Warm the pool and the arena, as a long-running handler's would be
+    per_message();
+    batched();
+    std::cout << "\n--- ALLOCATION BENCHMARK (" << messages << " messages, " << stream.size() << " bytes) ---" << std::endl;
+    measure("Per-message (before):", per_message);
+    measure("Arena batch (after):", batched);
+    std::cout << "Arena reserved: " << scratch.reserved_bytes() << " bytes (checksum " << sink << ")" << std::endl;
+    std::cout << "--------------------\n" << std::endl;
+}
+
+// ====================================================================
+//                          CAMPUS LOOKUPS
+// ====================================================================
+
+// Names from a campus directory file, parsed as the server does
+static std::vector<std::string> load_directory(const char *path) {
+    std::vector<std::string> names;
+    std::ifstream file(path);
+    if (!file) {
+        perror("[ERROR] Failed to open campus directory");
+        return names;
+    }
+    std::string line;
+    while (std::getline(file, line)) {
+        line = line.substr(0, line.find('#'));
+        line.erase(0, line.find_first_not_of(" \t\r"));
+        line.erase(line.find_last_not_of(" \t\r") + 1);
+        if (line.empty() || line.find(':') != std::string::npos) continue;
+        if (std::find(names.begin(), names.end(), line) == names.end()) names.push_back(line);
+    }
+    return names;
+}
+
+// Destination lookups: the std::map the campus table used to be against the perfect hash.
+// Uses the directory's names when one is given, otherwise a synthetic set of 256.
+static void run_lookup_benchmark(int lookups, const char *directory) {
+    std::vector<std::string> names;
+    if (directory) names = load_directory(directory);
+    if (names.empty()) {
+        for (int i = 0; i < 256; ++i) names.push_back("Campus-" + std::to_string(i * 7919));
+    }
+
+    std::map<std::string, CampusId, std::less<>> tree;
+    std::vector<CampusId> ids;
+    for (CampusId id = 0; id < names.size(); ++id) {
+        tree.emplace(names[id], id);
+        ids.push_back(id);
+    }
+    PerfectHash table;
+    if (!table.build(names, ids)) {
+        std::cout << "[WARNING] Perfect hash build failed; lookup benchmark skipped." << std::endl;
+        return;
+    }
+
+    // Destinations as they arrive: views into a frame buffer, in a scrambled order
+    std::string frames;
+    std::vector<std::pair<size_t, size_t>> spans;
+    for (int i = 0; i < 4096; ++i) {
+        const std::string& name = names[(i * 2654435761u) % names.size()];
+        spans.push_back({frames.size(), name.size()});
+        frames += name;
+    }
+
+    uint64_t checksum = 0;
+    auto measure = [&](const char *label, auto find) {
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < lookups; ++i) {
+            const auto& span = spans[i & 4095];
+            checksum += find(std::string_view(frames.data() + span.first, span.second));
+        }
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        printf("%-22s %8.1f ns/lookup\n", label,
+               (double)std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count() / lookups);
+    };
+
+    std::cout << "\n--- LOOKUP BENCHMARK (" << names.size() << " campuses, " << lookups << " lookups) ---" << std::endl;
+    measure("std::map:", [&](std::string_view name) {
+        auto it = tree.find(name);
+        return it != tree.end() ? it->second : NO_CAMPUS;
+    });
+    measure("Perfect hash:", [&](std::string_view name) { return table.find(name); });
+    std::cout << "(checksum " << checksum << ")" << std::endl;
+    std::cout << "--------------------\n" << std::endl;
+}
+
+// ====================================================================
+//                           FRAME SCANNING
+// ====================================================================
+
+// Frame scanning throughput of every implementation this CPU can run, over a
+// BATCH_READ_BYTES read of mixed ASCII and UTF-8 frames, repeated until 'messages'
+// frames have been scanned
+static void run_scanner_benchmark(int messages) {
+    std::string read;
+    for (int i = 0; read.size() + 128 < BATCH_READ_BYTES; ++i) {
+        read += "Campus" + std::to_string(i % 16) + (i % 8 ? ":benchmark payload " : ":caf\xc3\xa9 payload ") +
+                std::to_string(i) + " padded to a typical size\n";
+    }
+    Arena scratch;
+    size_t frames_per_read;
+    {
+        ArenaVector<FrameSpan> spans{ArenaAllocator<char>(scratch)};
+        scan_frames_scalar(read.data(), read.size(), spans);
+        frames_per_read = spans.size();
+    }
+    scratch.reset();
+    int reads = std::max<int>(1, messages / frames_per_read);
+
+    uint64_t checksum = 0;
+    auto measure = [&](const char *label, FrameScanner scanner) {
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < reads; ++i) {
+            {
+                ArenaVector<FrameSpan> spans{ArenaAllocator<char>(scratch)};
+                checksum += scanner(read.data(), read.size(), spans);
+                for (const FrameSpan& span : spans) checksum += span.colon + span.valid_utf8;
+            }
+            scratch.reset();
+        }
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        double ns = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+        printf("%-22s %8.2f GB/s  %8.1f ns/frame\n", label, (double)read.size() * reads / ns,
+               ns / ((double)frames_per_read * reads));
+    };
+
+    std::cout << "\n--- FRAME SCANNER BENCHMARK (" << reads << " reads of " << read.size() << " bytes, "
+              << frames_per_read << " frames each; the server would use " << frame_scanner_name << ") ---" << std::endl;
+    measure("Scalar:", scan_frames_scalar);
+#if defined(__x86_64__) || defined(__i386__)
+    if (__builtin_cpu_supports("sse2")) measure("SSE2:", scan_frames_sse2);
+    if (__builtin_cpu_supports("avx2")) measure("AVX2:", scan_frames_avx2);
+#endif
+    std::cout << "(checksum " << checksum << ")" << std::endl;
+    std::cout << "--------------------\n" << std::endl;
+}
+
+// ====================================================================
+//                       SOCKET BENCHMARK HELPERS
+// ====================================================================
+
+// A connected loopback TCP pair: fds[0] connects, fds[1] is accepted. Loopback is the
+// same path as the server's local test setup; on a real NIC both relays do better.
+static bool loopback_pair(int fds[2]) {
+    int listener = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t length = sizeof(addr);
+    bool ok = listener >= 0 && bind(listener, (struct sockaddr *)&addr, sizeof(addr)) == 0 && listen(listener, 1) == 0 &&
+              getsockname(listener, (struct sockaddr *)&addr, &length) == 0;
+    fds[0] = ok ? socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0) : -1;
+    ok = ok && fds[0] >= 0 && connect(fds[0], (struct sockaddr *)&addr, sizeof(addr)) == 0;
+    fds[1] = ok ? accept4(listener, nullptr, nullptr, SOCK_CLOEXEC) : -1;
+    if (listener >= 0) close(listener);
+    if (!ok || fds[1] < 0) {
+        perror("[ERROR] Loopback connection failed");
+        return false;
+    }
+    return true;
+}
+
+static bool write_all(int fd, const char *data, size_t length) {
+    while (length > 0) {
+        ssize_t written = write(fd, data, length);
+        if (written < 0 && errno == EINTR) continue;
+        if (written <= 0) return false;
+        data += written;
+        length -= written;
+    }
+    return true;
+}
+
+// Reads and discards until the peer closes
+static void drain_socket(int fd) {
+    std::vector<char> buffer(1 << 20);
+    while (read(fd, buffer.data(), buffer.size()) > 0) {}
+}
+
+// CPU time (user + system) used by the calling thread so far
+static double thread_cpu_seconds() {
+    struct rusage usage;
+    getrusage(RUSAGE_THREAD, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+static void print_socket_result(const char *label, double cpu, double seconds, uint64_t bytes) {
+    printf("%-22s %8.3f s CPU/GB  %9.1f MB/s\n", label, cpu * 1e9 / bytes, bytes / seconds / 1e6);
+}
+
+// ====================================================================
+//                          FILE CHUNK RELAY
+// ====================================================================
+
+// The handler's two ways of relaying a FILE chunk body from the sender's socket to the
+// destination's: read into user space and written out again, or spliced through a pipe
+// so the bytes never leave the kernel. A producer writes 'chunks' bodies into one loopback
+// connection, the relay moves each to a second one, and a consumer drains that. The CPU
+// counted is the relay thread's, which is what the server spends per relayed byte.
+static void run_relay_benchmark(int chunks) {
+    uint64_t total = (uint64_t)chunks * RELAY_CHUNK_BYTES;
+
+    auto relay = [&](const char *label, bool use_splice) {
+        int in[2], out[2];
+        if (!loopback_pair(in) || !loopback_pair(out)) return;
+        int pipe_fds[2] = {-1, -1};
+        if (use_splice) {
+            if (pipe2(pipe_fds, O_CLOEXEC) < 0) {
+                perror("[ERROR] Failed to create relay pipe");
+                return;
+            }
+            if (fcntl(pipe_fds[1], F_SETPIPE_SZ, RELAY_PIPE_BYTES) < 0) perror("[WARNING] Failed to enlarge relay pipe");
+        }
+        std::thread producer([&] {
+            std::vector<char> chunk(RELAY_CHUNK_BYTES, 'x');
+            for (int i = 0; i < chunks && write_all(in[0], chunk.data(), chunk.size()); ++i) {}
+            shutdown(in[0], SHUT_WR);
+        });
+        std::thread consumer([&] { drain_socket(out[0]); });
+
+        std::vector<char> buffer(RELAY_CHUNK_BYTES);
+        uint64_t moved = 0;
+        double cpu_before = thread_cpu_seconds();
+        auto start = std::chrono::steady_clock::now();
+        while (moved < total) {
+            size_t body = RELAY_CHUNK_BYTES, got = 0;
+            if (use_splice) {
+                // Socket -> pipe until the body is in, then pipe -> socket
+                while (got < body) {
+                    ssize_t n = splice(in[1], nullptr, pipe_fds[1], nullptr, body - got, SPLICE_F_MOVE);
+                    if (n <= 0) break;
+                    got += n;
+                }
+                for (size_t sent = 0; sent < got;) {
+                    ssize_t n = splice(pipe_fds[0], nullptr, out[1], nullptr, got - sent, SPLICE_F_MOVE);
+                    if (n <= 0) break;
+                    sent += n;
+                }
+            } else {
+                while (got < body) {
+                    ssize_t n = read(in[1], buffer.data() + got, body - got);
+                    if (n <= 0) break;
+                    got += n;
+                }
+                if (!write_all(out[1], buffer.data(), got)) break;
+            }
+            if (got < body) break;
+            moved += got;
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        double cpu = thread_cpu_seconds() - cpu_before;
+        shutdown(out[1], SHUT_WR);
+        producer.join();
+        consumer.join();
+        for (int fd : {in[0], in[1], out[0], out[1], pipe_fds[0], pipe_fds[1]}) {
+            if (fd >= 0) close(fd);
+        }
+        if (moved < total) {
+            std::cout << "[ERROR] " << label << " relay stopped after " << moved << " bytes." << std::endl;
+            return;
+        }
+        print_socket_result(label, cpu, seconds, moved);
+    };
+
+    std::cout << "\n--- FILE RELAY BENCHMARK (" << chunks << " chunks of " << RELAY_CHUNK_BYTES << " bytes, "
+              << total / 1000000 << " MB over loopback TCP) ---" << std::endl;
+    relay("Copy (before):", false);
+    relay("Splice (after):", true);
+    std::cout << "--------------------\n" << std::endl;
+}
+
+// ====================================================================
+//                          ZERO-COPY SENDS
+// ====================================================================
+
+// The I/O thread's two ways of writing a large payload: send() copying it into the
+// socket buffer, or MSG_ZEROCOPY pinning its pages until the completion arrives on the
+// error queue (reaped as flush_outbound does). The CPU counted is the sender's. Over
+// loopback the kernel copies at delivery anyway and says so in the completions, which
+// is why the server turns zero-copy off for such sessions; the copied count shows it.
+static void run_zerocopy_benchmark(int sends) {
+    uint64_t total = (uint64_t)sends * ZEROCOPY_PAYLOAD_BYTES;
+    std::vector<char> payload(ZEROCOPY_PAYLOAD_BYTES, 'y');
+
+    auto measure = [&](const char *label, bool zerocopy) {
+        int fds[2];
+        if (!loopback_pair(fds)) return;
+        int on = 1;
+        if (zerocopy && setsockopt(fds[1], SOL_SOCKET, SO_ZEROCOPY, &on, sizeof(on)) < 0) {
+            perror("[WARNING] SO_ZEROCOPY not supported; zero-copy benchmark skipped");
+            close(fds[0]);
+            close(fds[1]);
+            return;
+        }
+        std::thread consumer([&] { drain_socket(fds[0]); });
+
+        uint64_t completed = 0, copied = 0, refused = 0, sent_bytes = 0;
+        auto reap = [&] {
+            char control[CMSG_SPACE(sizeof(struct sock_extended_err)) + 64];
+            while (true) {
+                struct msghdr msg = {};
+                msg.msg_control = control;
+                msg.msg_controllen = sizeof(control);
+                if (recvmsg(fds[1], &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) return;
+                for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+                    struct sock_extended_err err;
+                    memcpy(&err, CMSG_DATA(cmsg), sizeof(err));
+                    if (err.ee_errno != 0 || err.ee_origin != SO_EE_ORIGIN_ZEROCOPY) continue;
+                    uint32_t span = err.ee_data - err.ee_info + 1;
+                    completed += span;
+                    if (err.ee_code & SO_EE_CODE_ZEROCOPY_COPIED) copied += span;
+                }
+            }
+        };
+
+        double cpu_before = thread_cpu_seconds();
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < sends; ++i) {
+            size_t offset = 0;
+            while (offset < payload.size()) {
+                ssize_t written = send(fds[1], payload.data() + offset, payload.size() - offset,
+                                       MSG_NOSIGNAL | (zerocopy ? MSG_ZEROCOPY : 0));
+                if (written > 0) {
+                    offset += written;
+                    continue;
+                }
+                if (written < 0 && errno == EINTR) continue;
+                if (written < 0 && errno == ENOBUFS && zerocopy) {
+                    // Too many pinned pages (optmem): wait for completions to release some
+                    refused++;
+                    struct pollfd error_queue = {fds[1], 0, 0};
+                    poll(&error_queue, 1, 100);
+                    reap();
+                    continue;
+                }
+                perror("[ERROR] Benchmark send failed");
+                i = sends;
+                break;
+            }
+            sent_bytes += offset;
+            if (zerocopy) reap();
+        }
+        while (zerocopy && completed < (uint64_t)sends + refused && std::chrono::steady_clock::now() - start < std::chrono::seconds(10)) {
+            struct pollfd error_queue = {fds[1], 0, 0};
+            poll(&error_queue, 1, 100);
+            reap();
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        double cpu = thread_cpu_seconds() - cpu_before;
+        shutdown(fds[1], SHUT_WR);
+        consumer.join();
+        close(fds[0]);
+        close(fds[1]);
+        print_socket_result(label, cpu, seconds, sent_bytes);
+        if (zerocopy) {
+            printf("%-22s %llu completions, %llu copied by the kernel, %llu sends refused (ENOBUFS)\n", "",
+                   (unsigned long long)completed, (unsigned long long)copied, (unsigned long long)refused);
+        }
+    };
+
+    std::cout << "\n--- ZERO-COPY BENCHMARK (" << sends << " payloads of " << ZEROCOPY_PAYLOAD_BYTES << " bytes, "
+              << total / 1000000 << " MB over loopback TCP) ---" << std::endl;
+    measure("send() (before):", false);
+    measure("MSG_ZEROCOPY (after):", true);
+    std::cout << "--------------------\n" << std::endl;
+}
+
+// ====================================================================
+//                                MAIN
+// ====================================================================
+
+int main(int argc, char *argv[]) {
+    std::string which = argc > 1 ? argv[1] : "all";
+    int count = argc > 2 ? atoi(argv[2]) : 0; // 0: each benchmark's own default
+    const char *directory = argc > 3 ? argv[3] : nullptr;
+    if (count < 0 || (argc > 2 && count == 0)) {
+        std::cerr << "Usage: " << argv[0] << " [alloc|lookup|scan|relay|zerocopy|all] [count] [campus directory file]" << std::endl;
+        return 1;
+    }
+    select_frame_scanner();
+
+    bool all = which == "all", known = false;
+    if (all || which == "alloc") {
+        run_allocation_benchmark(count ? count : DEFAULT_COUNT);
+        known = true;
+    }
+    if (all || which == "lookup") {
+        run_lookup_benchmark(count ? count : DEFAULT_COUNT, directory);
+        known = true;
+    }
+    if (all || which == "scan") {
+        run_scanner_benchmark(count ? count : DEFAULT_COUNT);
+        known = true;
+    }
+    if (all || which == "relay") {
+        run_relay_benchmark(count ? count : RELAY_DEFAULT_CHUNKS);
+        known = true;
+    }
+    if (all || which == "zerocopy") {
+        run_zerocopy_benchmark(count ? count : ZEROCOPY_DEFAULT_SENDS);
+        known = true;
+    }
+    if (!known) {
+        std::cerr << "Usage: " << argv[0] << " [alloc|lookup|scan|relay|zerocopy|all] [count] [campus directory file]" << std::endl;
+        return 1;
+    }
+    return 0;
+}
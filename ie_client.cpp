@@ -0,0 +1,1221 @@
+#include "ie_client.h"
+
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <charconv>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+// --- Configuration ---
+#define UDP_BUFFER_SIZE 65536   // Largest UDP payload (65507) and a terminator: longer broadcasts travel unsegmented
+#define UDP_BATCH 32            // Datagrams drained per recvmmsg call
+#define TCP_RING_INITIAL 16384  // Starting size of the TCP receive ring (doubles as needed)
+#define TCP_RING_MAX 16777216   // Largest a single unterminated frame may grow the ring
+#define WRITE_IOV_MAX 1024      // iovecs gathered per sendmsg (2-3 per queued frame)
+#define FILE_CHUNK_BYTES 65536  // Raw bytes per FILE chunk (the server relays at most 65536)
+#define FILE_WINDOW_BYTES 262144 // Queued bytes below which the next file chunks are queued
+#define ACK_EVERY_FRAMES 64     // Sequenced frames received before we acknowledge them unprompted...
+#define ACK_EVERY_BYTES 65536   // ...or bytes (the server retains 256 KB for replay)
+
+// ====================================================================
+//                           RECEIVE RING
+// ====================================================================
+
+// Growable ring for the TCP byte stream. recv() writes into the free space after the
+// tail and frames are decoded from the head; the '\n' search resumes where it last
+// stopped, so a frame arriving in many pieces is only scanned once.
+class ExchangeClient::ByteRing {
+public:
+    explicit ByteRing(size_t capacity) : buffer(capacity) {}
+
+    // Contiguous free space after the tail, doubling the ring first if it is full.
+    // Returns a zero length once a single frame would need more than TCP_RING_MAX.
+    std::pair<char *, size_t> writable() {
+        if (tail - head == buffer.size()) {
+            if (buffer.size() * 2 > TCP_RING_MAX) return {nullptr, 0};
+            grow();
+        }
+        size_t position = tail & (buffer.size() - 1);
+        size_t available = buffer.size() - (tail - head);
+        return {&buffer[position], std::min(available, buffer.size() - position)};
+    }
+
+    void commit(size_t bytes) { tail += bytes; }
+
+    void clear() { head = scan = tail = 0; } // A new connection starts a new stream
+
+    // Raw bytes (a FILE chunk) are taken straight from the ring rather than as frames
+    size_t readable() const { return tail - head; }
+
+    // The next 'length' unread bytes as one or two runs (two if they wrap)
+    int peek(size_t length, struct iovec iov[2]) const {
+        size_t position = head & (buffer.size() - 1);
+        size_t first = std::min(length, buffer.size() - position);
+        iov[0] = {(void *)&buffer[position], first};
+        iov[1] = {(void *)buffer.data(), length - first};
+        return length > first ? 2 : 1;
+    }
+
+    void skip(size_t length) {
+        head += length;
+        scan = std::max(scan, head);
+    }
+
+    // Pops the next complete frame (without the '\n' or a trailing '\r') into 'frame'
+    bool next_frame(std::string& frame) {
+        while (scan < tail) {
+            size_t position = scan & (buffer.size() - 1);
+            size_t run = std::min<size_t>(tail - scan, buffer.size() - position);
+            const char *newline = static_cast<const char *>(memchr(&buffer[position], '\n', run));
+            if (!newline) {
+                scan += run;
+                continue;
+            }
+            uint64_t end = scan + (newline - &buffer[position]);
+            copy_out(head, end - head, frame);
+            if (!frame.empty() && frame.back() == '\r') frame.pop_back();
+            head = scan = end + 1;
+            return true;
+        }
+        return false;
+    }
+
+private:
+    // Linearizes the unread bytes at the start of a ring twice the size
+    void grow() {
+        std::vector<char> larger(buffer.size() * 2);
+        std::string unread;
+        copy_out(head, tail - head, unread);
+        memcpy(larger.data(), unread.data(), unread.size());
+        scan -= head;
+        tail -= head;
+        head = 0;
+        buffer.swap(larger);
+    }
+
+    void copy_out(uint64_t from, size_t length, std::string& out) const {
+        size_t position = from & (buffer.size() - 1);
+        size_t first = std::min(length, buffer.size() - position);
+        out.assign(&buffer[position], first);
+        out.append(buffer.data(), length - first); // Wrapped part, if any
+    }
+
+    std::vector<char> buffer;   // Power-of-two size
+    uint64_t head = 0;          // Next unread byte (positions are absolute stream offsets)
+    uint64_t scan = 0;          // Bytes before this are known to hold no '\n' past 'head'
+    uint64_t tail = 0;          // End of received data
+};
+
+// A file shared by a transfer and its queued chunks: a transfer that ends early must not
+// close the descriptor under a chunk that is half written
+struct ExchangeClient::OpenFile {
+    int fd;
+    explicit OpenFile(int fd) : fd(fd) {}
+    ~OpenFile() { close(fd); }
+};
+
+// Splits at ':' into at most 'max_fields' fields; the last one keeps any further ':'
+static std::vector<std::string_view> split_fields(std::string_view frame, size_t max_fields = SIZE_MAX) {
+    std::vector<std::string_view> fields;
+    for (size_t start = 0;;) {
+        size_t end = fields.size() + 1 == max_fields ? std::string_view::npos : frame.find(':', start);
+        fields.push_back(frame.substr(start, end == std::string_view::npos ? std::string_view::npos : end - start));
+        if (end == std::string_view::npos) break;
+        start = end + 1;
+    }
+    return fields;
+}
+
+// A decimal field; false unless it is all digits
+static bool parse_number(std::string_view field, uint64_t& value) {
+    auto result = std::from_chars(field.data(), field.data() + field.size(), value);
+    return !field.empty() && result.ec == std::errc() && result.ptr == field.data() + field.size();
+}
+
+// ====================================================================
+//                         SESSION LIFECYCLE
+// ====================================================================
+
+ExchangeClient::ExchangeClient(ClientConfig config)
+    : config(std::move(config)), tcp_ring(new ByteRing(TCP_RING_INITIAL)),
+      udp_buffers(new char[UDP_BATCH * UDP_BUFFER_SIZE]), jitter(std::random_device{}()) {}
+
+ExchangeClient::~ExchangeClient() {
+    for (int fd : {tcp_fd, udp_fd, timer_fd, epoll_fd}) {
+        if (fd >= 0) close(fd);
+    }
+}
+
+bool ExchangeClient::start() {
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (epoll_fd < 0 || timer_fd < 0) {
+        error_text = std::string("epoll/timerfd setup failed: ") + strerror(errno);
+        return false;
+    }
+    struct epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.fd = timer_fd;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, timer_fd, &event);
+
+    // 1. UDP listener for server broadcasts
+    udp_fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (udp_fd < 0) {
+        error_text = std::string("UDP socket creation failed: ") + strerror(errno);
+        return false;
+    }
+    int opt = 1;
+    setsockopt(udp_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    // Room for a burst of broadcasts while the owner is busy with the last batch
+    setsockopt(udp_fd, SOL_SOCKET, SO_RCVBUF, &config.udp_rcvbuf_bytes, sizeof(config.udp_rcvbuf_bytes));
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = INADDR_ANY;
+    addr.sin_port = htons(config.udp_port);
+    if (bind(udp_fd, (const struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        error_text = std::string("UDP bind failed: ") + strerror(errno);
+        return false;
+    }
+    event.data.fd = udp_fd;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, udp_fd, &event);
+
+    // 2. TCP connection for routing
+    return begin_connect();
+}
+
+// Starts a non-blocking connect; it completes (or fails) in process_events()
+bool ExchangeClient::begin_connect() {
+    struct sockaddr_in server_addr;
+    memset(&server_addr, 0, sizeof(server_addr));
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_port = htons(config.server_port);
+    if (inet_pton(AF_INET, config.server_ip.c_str(), &server_addr.sin_addr) <= 0) {
+        error_text = "Invalid server address " + config.server_ip;
+        close_session(error_text, CLOSE_FAILED);
+        return false;
+    }
+
+    tcp_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (tcp_fd < 0) {
+        error_text = std::string("TCP socket creation failed: ") + strerror(errno);
+        close_session(error_text, CLOSE_FAILED);
+        return false;
+    }
+    tcp_events = EPOLLIN | EPOLLOUT;
+    struct epoll_event event = {};
+    event.events = tcp_events;
+    event.data.fd = tcp_fd;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, tcp_fd, &event);
+
+    state = STATE_CONNECTING;
+    if (connect(tcp_fd, (struct sockaddr *)&server_addr, sizeof(server_addr)) == 0) {
+        finish_connect();
+    } else if (errno != EINPROGRESS) {
+        connection_lost(std::string("TCP connection failed: ") + strerror(errno));
+        return ever_registered;
+    }
+    return true;
+}
+
+// Connected: register, then send whatever was held during the outage
+void ExchangeClient::finish_connect() {
+    state = STATE_REGISTERED;
+    ever_registered = true;
+    tcp_ring->clear();
+
+    // Registration: <CAMPUS_NAME>:<UDP_PORT>[:RESUME[:<TOKEN>:<LAST_SEQ>]]
+    std::string registration = config.campus_name + ":" + std::to_string(config.udp_port);
+    if (config.resumable) {
+        registration += ":RESUME";
+        if (!session_token.empty()) registration += ":" + session_token + ":" + std::to_string(last_seq);
+    }
+    push_control(registration + "\n");
+    // A resumed session still has its identities; attaching again is harmless
+    for (const std::string& identity : identities) push_control("ATTACH:" + identity + "\n");
+    // Unfinished transfers are offered again; each receiver answers with what it has
+    for (const auto& entry : outgoing) offer_file(entry.second);
+
+    size_t held = outbox.size();
+    while (!outbox.empty()) {
+        OutFrame frame = std::move(outbox.front());
+        outbox.pop_front();
+        outbox_bytes -= frame.size();
+        push_write(std::move(frame));
+    }
+    flush_writes();
+    if (on_event) {
+        on_event(CLIENT_CONNECTED, held ? "sending " + std::to_string(held) + " held message(s)" : "");
+    }
+}
+
+// The connection is gone (or never came up). Unsent messages move back to the outbox;
+// cached campus IDs are dropped too, since a restarted server may number campuses
+// differently. Messages in a write that failed may reach the server twice.
+void ExchangeClient::connection_lost(const std::string& reason) {
+    if (tcp_fd >= 0) {
+        close(tcp_fd); // Also takes it out of the epoll set
+        tcp_fd = -1;
+    }
+    tcp_events = 0;
+    for (OutFrame& frame : write_queue) {
+        if (frame.destination.empty()) continue; // Control frames belong to the old connection
+        frame.header.clear();
+        frame.sent = 0;
+        outbox_bytes += frame.size();
+        outbox.push_back(std::move(frame));
+    }
+    write_queue.clear();
+    write_queue_bytes = 0;
+    pings.clear();
+    campus_ids.clear();
+    resolving.clear();
+    chunk_in.active = false;
+    for (auto& entry : outgoing) entry.second.accepted = false; // Chunks in flight may be lost
+
+    if (state == STATE_QUITTING || !ever_registered || !config.auto_reconnect) {
+        close_session(reason, CLOSE_FAILED);
+        return;
+    }
+    if (on_event) on_event(CLIENT_CONNECTION_LOST, reason);
+    schedule_reconnect();
+}
+
+void ExchangeClient::schedule_reconnect() {
+    // Equal jitter: half of each delay is the exponential step, the other half is
+    // random, so campuses cut off by the same restart do not return in lockstep
+    int ceiling = (int)std::min<int64_t>(config.reconnect_max_ms,
+                                         (int64_t)config.reconnect_base_ms << std::min(reconnect_failures, 20));
+    int delay_ms = ceiling / 2 + std::uniform_int_distribution<int>(0, ceiling / 2)(jitter);
+    reconnect_failures++;
+    state = STATE_BACKOFF;
+    reconnect_at = std::chrono::steady_clock::now() + std::chrono::milliseconds(delay_ms);
+    arm_timer();
+    if (on_event) {
+        on_event(CLIENT_RECONNECT_SCHEDULED,
+                 std::to_string(reconnect_failures) + " in " + std::to_string(delay_ms) + " ms");
+    }
+}
+
+void ExchangeClient::close_session(const std::string& reason, ClientCloseStatus status) {
+    if (state == STATE_CLOSED) return;
+    error_text = reason;
+    close_reason = status;
+    if (tcp_fd >= 0) {
+        close(tcp_fd);
+        tcp_fd = -1;
+    }
+    state = STATE_CLOSED;
+    if (on_event) on_event(CLIENT_CLOSED, reason);
+}
+
+bool ExchangeClient::attach(std::string_view identity) {
+    if (identity.empty() || identity.find_first_of(":\n") != std::string_view::npos || identity == config.campus_name) {
+        error_text = "Invalid identity";
+        return false;
+    }
+    if (state == STATE_QUITTING || state == STATE_CLOSED) {
+        error_text = "Session is closing";
+        return false;
+    }
+    if (!identities.insert(std::string(identity)).second) return true;
+    if (state == STATE_REGISTERED) {
+        push_control("ATTACH:" + std::string(identity) + "\n");
+        maybe_flush();
+    }
+    return true;
+}
+
+void ExchangeClient::detach(std::string_view identity) {
+    auto it = identities.find(identity);
+    if (it == identities.end()) return;
+    identities.erase(it);
+    if (state == STATE_REGISTERED) {
+        push_control("@" + std::string(identity) + ":QUIT\n");
+        maybe_flush();
+    }
+}
+
+bool ExchangeClient::ping(std::string_view destination, std::string_view identity) {
+    if (state != STATE_REGISTERED || destination.find_first_of(":\n") != std::string_view::npos ||
+        (!identity.empty() && identities.find(identity) == identities.end())) {
+        error_text = state != STATE_REGISTERED ? "Not connected" : "Invalid probe destination or identity";
+        return false;
+    }
+    uint64_t token = next_ping_token++;
+    pings[token] = {std::string(destination), std::string(identity), std::chrono::steady_clock::now()};
+    // PING:<token> (server) or PING:<destination>:<token> (campus), optionally as an identity
+    std::string probe = identity.empty() ? "PING:" : "@" + std::string(identity) + ":PING:";
+    if (!destination.empty()) probe += std::string(destination) + ":";
+    push_control(probe + std::to_string(token) + "\n");
+    flush_writes(); // Coalescing would add to the measurement
+    return true;
+}
+
+void ExchangeClient::quit() {
+    if (state == STATE_REGISTERED) {
+        // The QUIT goes after everything queued; our FIN follows once it is written
+        push_control("QUIT\n");
+        state = STATE_QUITTING;
+        flush_writes();
+    } else if (state != STATE_QUITTING) {
+        close_session("Quit while disconnected", CLOSE_ABANDONED);
+    }
+}
+
+// ====================================================================
+//                           EVENT LOOP
+// ====================================================================
+
+bool ExchangeClient::process_events(int timeout_ms) {
+    if (state == STATE_CLOSED) return false;
+    struct epoll_event events[4];
+    int ready = epoll_wait(epoll_fd, events, 4, timeout_ms);
+    if (ready < 0 && errno != EINTR) {
+        error_text = std::string("epoll_wait failed: ") + strerror(errno);
+        close_session(error_text, CLOSE_FAILED);
+    }
+    for (int i = 0; i < ready && state != STATE_CLOSED; ++i) {
+        int fd = events[i].data.fd;
+        if (fd == timer_fd) {
+            on_timer();
+        } else if (fd == udp_fd) {
+            read_udp();
+        } else if (fd == tcp_fd && state == STATE_CONNECTING) {
+            int error = 0;
+            socklen_t length = sizeof(error);
+            getsockopt(tcp_fd, SOL_SOCKET, SO_ERROR, &error, &length);
+            if (error) {
+                connection_lost(std::string("TCP connection failed: ") + strerror(error));
+            } else if (events[i].events & EPOLLOUT) {
+                finish_connect();
+            }
+        } else if (fd == tcp_fd) {
+            if (events[i].events & EPOLLOUT) flush_writes();
+            if (tcp_fd == fd && (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))) read_tcp();
+        }
+    }
+    return state != STATE_CLOSED;
+}
+
+void ExchangeClient::on_timer() {
+    uint64_t expirations;
+    if (read(timer_fd, &expirations, sizeof(expirations)) < 0 && errno != EAGAIN) {
+        error_text = std::string("timerfd read failed: ") + strerror(errno);
+    }
+    auto now = std::chrono::steady_clock::now();
+    if (state == STATE_BACKOFF && now >= reconnect_at) {
+        begin_connect();
+    } else if (!write_queue.empty()) {
+        maybe_flush(); // A coalescing window has run out
+    }
+    arm_timer();
+}
+
+// Next deadline: the reconnect, or the end of the oldest queued write's coalescing window
+void ExchangeClient::arm_timer() {
+    std::chrono::steady_clock::time_point deadline;
+    bool armed = false;
+    if (state == STATE_BACKOFF) {
+        deadline = reconnect_at;
+        armed = true;
+    } else if (!write_queue.empty() && config.coalesce_bytes > 0 && state == STATE_REGISTERED) {
+        deadline = oldest_write + std::chrono::milliseconds(config.coalesce_ms);
+        armed = true;
+    }
+    struct itimerspec spec = {};
+    if (armed) {
+        auto wait = std::max<std::chrono::nanoseconds>(deadline - std::chrono::steady_clock::now(),
+                                                       std::chrono::nanoseconds(1)); // 0 would disarm it
+        spec.it_value.tv_sec = wait.count() / 1000000000;
+        spec.it_value.tv_nsec = wait.count() % 1000000000;
+    }
+    timerfd_settime(timer_fd, 0, &spec, nullptr);
+}
+
+// ====================================================================
+//                             SENDING
+// ====================================================================
+
+bool ExchangeClient::send_as(std::string_view identity, std::string_view destination, std::string_view message) {
+    OutFrame frame;
+    frame.identity = std::string(identity);
+    frame.destination = std::string(destination);
+    frame.borrowed = message.data() ? message : std::string_view("", 0);
+    if (!enqueue(std::move(frame))) return false;
+
+    // Whatever could not be written straight away stops borrowing the caller's memory.
+    // Only the frame just queued can be borrowing: at the back of the write queue (or
+    // just before its RESOLVE), or in the outbox if the write lost the connection.
+    for (std::deque<OutFrame> *queue : {&write_queue, &outbox}) {
+        for (auto it = queue->rbegin(); it != queue->rend() && it - queue->rbegin() < 2; ++it) {
+            if (!it->borrowed.data()) continue;
+            it->owned.assign(it->borrowed);
+            it->borrowed = std::string_view();
+        }
+    }
+    return true;
+}
+
+bool ExchangeClient::send_as(std::string_view identity, std::string_view destination,
+                             std::shared_ptr<const std::string> message) {
+    if (!message) return false;
+    OutFrame frame;
+    frame.identity = std::string(identity);
+    frame.destination = std::string(destination);
+    frame.shared = std::move(message);
+    return enqueue(std::move(frame));
+}
+
+bool ExchangeClient::enqueue(OutFrame frame) {
+    if (frame.destination.empty() || frame.destination.find_first_of(":\n") != std::string::npos ||
+        frame.body().find('\n') != std::string_view::npos) {
+        error_text = "Message or destination would break framing";
+        return false;
+    }
+    if (!frame.identity.empty() && identities.find(frame.identity) == identities.end()) {
+        error_text = "Identity '" + frame.identity + "' is not attached";
+        return false;
+    }
+    if (state == STATE_QUITTING || state == STATE_CLOSED) {
+        error_text = "Session is closing";
+        return false;
+    }
+    if (queued_bytes() + frame.size() > config.max_queued_bytes) {
+        counters.dropped++;
+        error_text = "Send queue full";
+        return false;
+    }
+    if (state != STATE_REGISTERED) {
+        // Held for the reconnect; the header is worked out then
+        outbox_bytes += frame.size();
+        outbox.push_back(std::move(frame));
+        return true;
+    }
+    push_write(std::move(frame));
+    maybe_flush();
+    return true;
+}
+
+// Destinations whose ID is known are sent as "#<id>", which the server routes without a
+// name lookup; the first message to a name is followed by a request for its ID
+void ExchangeClient::push_write(OutFrame frame) {
+    const std::string& destination = frame.destination;
+    std::string resolve;
+    frame.header = destination + ":";
+    if (destination[0] != '#' && destination != "BROADCAST" && destination != "RESOLVE") {
+        auto it = campus_ids.find(destination);
+        if (it != campus_ids.end()) {
+            frame.header = "#" + it->second + ":";
+        } else if (resolving.insert(destination).second) {
+            resolve = "RESOLVE:" + destination + "\n";
+        }
+    }
+    if (!frame.identity.empty()) frame.header.insert(0, "@" + frame.identity + ":");
+    if (write_queue.empty()) oldest_write = std::chrono::steady_clock::now();
+    write_queue_bytes += frame.size();
+    write_queue.push_back(std::move(frame));
+    if (!resolve.empty()) push_control(resolve);
+}
+
+// Control lines (registration, heartbeat replies, RESOLVE, QUIT) are complete frames
+void ExchangeClient::push_control(const std::string& line) {
+    OutFrame frame;
+    frame.header = line;
+    if (write_queue.empty()) oldest_write = std::chrono::steady_clock::now();
+    write_queue_bytes += frame.size();
+    write_queue.push_back(std::move(frame));
+}
+
+// Writes now unless coalescing wants to wait for more
+void ExchangeClient::maybe_flush() {
+    bool due = config.coalesce_bytes == 0 || write_queue_bytes >= config.coalesce_bytes ||
+               std::chrono::steady_clock::now() - oldest_write >= std::chrono::milliseconds(config.coalesce_ms);
+    if (due) {
+        flush_writes();
+    } else {
+        arm_timer();
+    }
+}
+
+// Gathers queued frames straight from their buffers into as few sendmsg calls as the
+// socket accepts; a short write leaves the rest for EPOLLOUT
+void ExchangeClient::flush_writes() {
+    static const char newline = '\n';
+    pump_files();
+    while (!write_queue.empty() && tcp_fd >= 0) {
+        OutFrame& first = write_queue.front();
+        if (first.file && first.sent >= first.header.size()) {
+            // A chunk's bytes go from the page cache to the socket without passing through here
+            off_t offset = first.file_offset + (first.sent - first.header.size());
+            ssize_t written = sendfile(tcp_fd, first.file->fd, &offset, first.size() - first.sent);
+            if (written < 0) {
+                if (errno == EINTR) continue;
+                if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+                connection_lost(std::string("TCP sendfile failed: ") + strerror(errno));
+                return;
+            }
+            if (written == 0) {
+                // The file shrank: the chunk's length is promised, so the stream is lost with it
+                uint64_t id = first.file_id;
+                connection_lost("A file being sent shrank");
+                auto it = outgoing.find(id);
+                if (it != outgoing.end()) {
+                    report_file(it->second, FILE_FAILED, "the file shrank while it was being sent");
+                    outgoing.erase(it);
+                }
+                return;
+            }
+            counters.bytes_sent += written;
+            write_queue_bytes -= written;
+            first.sent += written;
+            if (first.sent == first.size()) {
+                auto it = outgoing.find(first.file_id);
+                uint64_t end = first.file_offset + first.file_length;
+                write_queue.pop_front(); // Before the callback, which may queue and write more
+                if (it != outgoing.end()) {
+                    it->second.done = std::max(it->second.done, end);
+                    report_file(it->second, FILE_PROGRESS);
+                }
+                pump_files();
+            }
+            continue;
+        }
+
+        struct iovec iov[WRITE_IOV_MAX];
+        int iov_count = 0;
+        for (auto it = write_queue.begin(); it != write_queue.end() && iov_count + 3 <= WRITE_IOV_MAX; ++it) {
+            std::string_view body = it->body();
+            std::string_view pieces[3] = {it->header, body,
+                                          it->destination.empty() ? std::string_view() : std::string_view(&newline, 1)};
+            size_t skip = it->sent;
+            for (std::string_view piece : pieces) {
+                if (skip >= piece.size()) {
+                    skip -= piece.size();
+                    continue;
+                }
+                iov[iov_count++] = {(void *)(piece.data() + skip), piece.size() - skip};
+                skip = 0;
+            }
+            if (it->file) break; // Its bytes follow with sendfile()
+        }
+        struct msghdr msg = {};
+        msg.msg_iov = iov;
+        msg.msg_iovlen = iov_count;
+        ssize_t written = sendmsg(tcp_fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            connection_lost(std::string("TCP send failed: ") + strerror(errno));
+            return;
+        }
+        counters.writes++;
+        counters.bytes_sent += written;
+        write_queue_bytes -= written;
+        size_t remaining = written;
+        while (remaining > 0) {
+            OutFrame& front = write_queue.front();
+            size_t left = front.size() - front.sent;
+            if (remaining < left) {
+                front.sent += remaining;
+                break;
+            }
+            remaining -= left;
+            if (!front.destination.empty()) counters.messages_sent++;
+            write_queue.pop_front();
+        }
+        if (!write_queue.empty()) oldest_write = std::chrono::steady_clock::now();
+        pump_files();
+    }
+
+    // EPOLLOUT only while a write is pending
+    uint32_t wanted = write_queue.empty() ? (uint32_t)EPOLLIN : (uint32_t)(EPOLLIN | EPOLLOUT);
+    if (tcp_fd >= 0 && wanted != tcp_events) {
+        tcp_events = wanted;
+        struct epoll_event event = {};
+        event.events = wanted;
+        event.data.fd = tcp_fd;
+        epoll_ctl(epoll_fd, EPOLL_CTL_MOD, tcp_fd, &event);
+    }
+    if (state == STATE_QUITTING && write_queue.empty() && !write_shut && tcp_fd >= 0) {
+        shutdown(tcp_fd, SHUT_WR); // The server closes once it has processed our QUIT
+        write_shut = true;
+    }
+}
+
+// ====================================================================
+//                            RECEIVING
+// ====================================================================
+
+// Reads until the socket is dry, decoding frames as they complete
+void ExchangeClient::read_tcp() {
+    int fd = tcp_fd;
+    std::string frame;
+    while (tcp_fd == fd) {
+        std::pair<char *, size_t> space = tcp_ring->writable();
+        if (space.second == 0) {
+            connection_lost("Server frame exceeds " + std::to_string(TCP_RING_MAX) + " bytes");
+            return;
+        }
+        ssize_t bytes_received = recv(fd, space.first, space.second, MSG_DONTWAIT);
+        if (bytes_received > 0) {
+            reconnect_failures = 0; // This connection works; the next outage backs off from scratch
+            tcp_ring->commit(bytes_received);
+            // A callback may send, and a failed send can drop the connection mid-batch.
+            // A FILE chunk's raw bytes are taken whole once they have all arrived.
+            while (tcp_fd == fd) {
+                if (chunk_in.active) {
+                    if (!receive_chunk()) break;
+                } else if (tcp_ring->next_frame(frame)) {
+                    handle_frame(frame);
+                } else {
+                    break;
+                }
+            }
+            continue;
+        }
+        if (bytes_received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
+        if (bytes_received < 0 && errno == EINTR) continue;
+        if (state == STATE_QUITTING) {
+            close_session("Session ended", CLOSE_FINISHED); // The server has closed after our QUIT
+        } else {
+            connection_lost(bytes_received == 0 ? "Server closed the connection"
+                                                : std::string("TCP recv failed: ") + strerror(errno));
+        }
+        return;
+    }
+}
+
+void ExchangeClient::handle_frame(std::string& frame) {
+    if (frame == "HEARTBEAT") {
+        // Server liveness probe: answer it (acknowledging what we have) so the
+        // server sees us as alive and can let go of delivered messages. After our
+        // QUIT the session is ending and nothing more may follow it.
+        if (state != STATE_REGISTERED) return;
+        send_ack();
+        return;
+    }
+    if (frame.compare(0, 8, "RESOLVE:") == 0) {
+        // RESOLVE:<name>:<id>, or <id> "none" for a campus the server does not know
+        size_t colon_pos = frame.rfind(':');
+        std::string name = frame.substr(8, colon_pos - 8), id = frame.substr(colon_pos + 1);
+        resolving.erase(name);
+        if (id != "none") campus_ids[name] = id;
+        return;
+    }
+    if (frame.compare(0, 9, "ATTACHED:") == 0) {
+        if (on_event) on_event(CLIENT_ATTACHED, frame.substr(9));
+        return;
+    }
+    if (frame.compare(0, 8, "SESSION:") == 0) {
+        // A different token means a new session, whose numbering starts over
+        if (frame.substr(8) != session_token) last_seq = 0;
+        session_token = frame.substr(8);
+        return;
+    }
+    if (frame.size() > 1 && frame[0] == '#') {
+        // Sequenced frame: "#<seq> <message>"; replays we already have are skipped
+        size_t space = frame.find(' ');
+        uint64_t seq = strtoull(frame.c_str() + 1, nullptr, 10);
+        if (seq <= last_seq) return;
+        last_seq = seq;
+        unacked_frames++;
+        unacked_bytes += frame.size() + 1;
+        // Acknowledge steadily, so the server can let go of its replay copies before
+        // the next heartbeat (a busy session may not be probed at all)
+        if ((unacked_frames >= ACK_EVERY_FRAMES || unacked_bytes >= ACK_EVERY_BYTES) && state == STATE_REGISTERED) {
+            send_ack();
+        }
+        frame.erase(0, space == std::string::npos ? frame.size() : space + 1);
+    }
+    // "@<identity>:<frame>" is for a campus we host
+    std::string_view identity, message(frame);
+    size_t colon_pos = frame[0] == '@' ? frame.find(':') : std::string::npos;
+    if (colon_pos != std::string::npos) {
+        identity = message.substr(1, colon_pos - 1);
+        message.remove_prefix(colon_pos + 1);
+    }
+    if (message.compare(0, 5, "FILE:") == 0) {
+        // A chunk header: its raw bytes come next in the stream (see receive_chunk())
+        if (!begin_chunk(identity, message)) connection_lost("Malformed FILE chunk from the server");
+        return;
+    }
+    if (message.compare(0, 8, "FILECTL:") == 0) {
+        handle_file_control(identity, message);
+        return;
+    }
+    if ((message.compare(0, 5, "PING:") == 0 || message.compare(0, 5, "PONG:") == 0) && handle_probe(identity, message)) return;
+    if (message.compare(0, 24, "SERVER: Error: Campus '#") == 0) {
+        // A cached ID the server no longer issues (its campus left and the ID was
+        // reclaimed): forget it, so the next message to the name resolves it again
+        std::string_view id = message.substr(24, message.find('\'', 24) - 24);
+        for (auto it = campus_ids.begin(); it != campus_ids.end();) {
+            it = it->second == id ? campus_ids.erase(it) : std::next(it);
+        }
+    }
+
+    counters.messages_received++;
+    if (!identity.empty() && on_identity_message) {
+        on_identity_message(identity, message);
+        return;
+    }
+    if (on_message) on_message(frame);
+}
+
+// "HEARTBEAT:<seq>" both answers a probe and acknowledges everything up to <seq>
+void ExchangeClient::send_ack() {
+    push_control("HEARTBEAT:" + std::to_string(last_seq) + "\n");
+    unacked_frames = 0;
+    unacked_bytes = 0;
+    maybe_flush();
+}
+
+// Probe traffic; false if the frame only looks like a probe (it is then a message)
+bool ExchangeClient::handle_probe(std::string_view identity, std::string_view frame) {
+    std::vector<std::string_view> fields = split_fields(frame);
+    if (fields[0] == "PING") {
+        // PING:<origin>:<token>:<stamp> from a campus probing us: answer at once
+        if (fields.size() != 4) return false;
+        if (state == STATE_REGISTERED) {
+            std::string reply = identity.empty() ? "" : "@" + std::string(identity) + ":";
+            reply.append("PONG:").append(frame.substr(5)).push_back('\n');
+            push_control(reply);
+            flush_writes();
+        }
+        return true;
+    }
+
+    // PONG:<token>:<server_us> (server probe) or PONG:<destination>:<token>:<dest_us|unreachable>
+    if (fields.size() != 3 && fields.size() != 4) return false;
+    uint64_t token = strtoull(std::string(fields[fields.size() - 2]).c_str(), nullptr, 10);
+    auto it = pings.find(token);
+    if (it == pings.end()) return true; // Sent on a connection that has since dropped
+    PingResult result;
+    result.destination = std::move(it->second.destination);
+    result.identity = std::move(it->second.identity);
+    result.rtt_us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() -
+                                                                          it->second.sent_at).count();
+    pings.erase(it);
+    std::string measured(fields.back());
+    if (fields.size() == 3) {
+        result.server_us = strtoll(measured.c_str(), nullptr, 10);
+    } else if (measured == "unreachable") {
+        result.reachable = false;
+    } else {
+        result.destination_us = strtoll(measured.c_str(), nullptr, 10);
+    }
+    if (on_pong) on_pong(result);
+    return true;
+}
+
+// Whole batches of datagrams per recvmmsg, until the socket is dry
+void ExchangeClient::read_udp() {
+    struct mmsghdr messages[UDP_BATCH];
+    struct iovec iovs[UDP_BATCH];
+    int received;
+    do {
+        for (int k = 0; k < UDP_BATCH; ++k) {
+            iovs[k] = {&udp_buffers[k * UDP_BUFFER_SIZE], UDP_BUFFER_SIZE - 1};
+            memset(&messages[k].msg_hdr, 0, sizeof(messages[k].msg_hdr));
+            messages[k].msg_hdr.msg_iov = &iovs[k];
+            messages[k].msg_hdr.msg_iovlen = 1;
+        }
+        received = recvmmsg(udp_fd, messages, UDP_BATCH, MSG_DONTWAIT, nullptr);
+        for (int k = 0; k < received; ++k) {
+            char *datagram = &udp_buffers[k * UDP_BUFFER_SIZE];
+            datagram[messages[k].msg_len] = '\0';
+            // The server may coalesce several broadcasts into one datagram, one per line
+            std::string_view records(datagram, messages[k].msg_len);
+            size_t start = 0;
+            while (start < records.size()) {
+                size_t end = records.find('\n', start);
+                if (end == std::string_view::npos) end = records.size();
+                if (end > start) {
+                    counters.broadcasts_received++;
+                    if (on_broadcast) on_broadcast(records.substr(start, end - start));
+                }
+                start = end + 1;
+            }
+        }
+    } while (received == UDP_BATCH); // A short batch means the socket is drained
+}
+
+// ====================================================================
+//                           FILE TRANSFER
+// ====================================================================
+
+// Between the two clients, as FILECTL:<peer>:<verb>:<id>:... frames relayed by the server:
+//   sender -> receiver:  OFFER:<id>:<size>:<version>:<name> (<version>: the file's mtime in ns)
+//   receiver -> sender:  ACCEPT:<id>:<offset> (send from here), RECEIVED:<id>:<size>,
+//                        REFUSE:<id>:<reason>, UNKNOWN:<id> (a chunk for a transfer it
+//                        has no record of, e.g. after a restart: offer it again)
+//   server -> either:    UNREACHABLE:<id>:<verb> (the peer is not active)
+// and the data as FILE:<peer>:<id>:<offset>:<len> frames followed by <len> raw bytes.
+// The receiver only takes files its on_file_offer accepts, up to max_file_bytes, and
+// never replaces a file it already has. It writes into "<name>.<key>.part", where <key>
+// hashes the sender, size and version, and answers every OFFER with the size of that
+// partial copy. An interrupted transfer (a reconnect, or the same file sent again) so
+// only sends what is missing, and a different file of the same name starts afresh.
+// Chunks that arrive out of place are answered with another ACCEPT, and the sender
+// rewinds to it.
+
+uint64_t ExchangeClient::send_file(std::string_view destination, const std::string& path) {
+    if (destination.empty() || destination.find_first_of(":\n") != std::string_view::npos || destination == "BROADCAST") {
+        error_text = "Invalid destination";
+        return 0;
+    }
+    if (state == STATE_QUITTING || state == STATE_CLOSED) {
+        error_text = "Session is closing";
+        return 0;
+    }
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        error_text = "Cannot open " + path + ": " + strerror(errno);
+        return 0;
+    }
+    auto file = std::make_shared<OpenFile>(fd);
+    struct stat info;
+    if (fstat(fd, &info) < 0 || !S_ISREG(info.st_mode)) {
+        error_text = path + " is not a regular file";
+        return 0;
+    }
+    std::string name = path.substr(path.find_last_of('/') + 1);
+    if (name.empty() || name.find('\n') != std::string::npos) {
+        error_text = "Invalid file name";
+        return 0;
+    }
+
+    FileTransfer& transfer = outgoing[next_file_id];
+    transfer.id = next_file_id++;
+    transfer.peer = std::string(destination);
+    transfer.name = std::move(name);
+    transfer.path = path;
+    transfer.file = std::move(file);
+    transfer.size = info.st_size;
+    transfer.version = (uint64_t)info.st_mtim.tv_sec * 1000000000 + info.st_mtim.tv_nsec;
+    if (state == STATE_REGISTERED) {
+        offer_file(transfer);
+        flush_writes();
+    } // Otherwise it is offered on connecting
+    return transfer.id;
+}
+
+std::vector<FileProgress> ExchangeClient::transfers() const {
+    std::vector<FileProgress> list;
+    for (const auto& entry : outgoing) {
+        const FileTransfer& transfer = entry.second;
+        list.push_back({FILE_PROGRESS, transfer.id, false, transfer.peer, transfer.name, transfer.size,
+                        transfer.done, transfer.resumed_from, {}});
+    }
+    for (const auto& entry : incoming) {
+        const FileTransfer& transfer = entry.second;
+        list.push_back({FILE_PROGRESS, transfer.id, true, transfer.peer, transfer.path, transfer.size,
+                        transfer.done, transfer.resumed_from, {}});
+    }
+    return list;
+}
+
+void ExchangeClient::offer_file(const FileTransfer& transfer) {
+    push_control("FILECTL:" + transfer.peer + ":OFFER:" + std::to_string(transfer.id) + ":" +
+                 std::to_string(transfer.size) + ":" + std::to_string(transfer.version) + ":" + transfer.name + "\n");
+}
+
+// Names the partial copy of one version of a file from one sender (FNV-1a, in hex)
+static std::string part_file_key(const std::string& peer, uint64_t size, uint64_t version) {
+    std::string identity = peer + ":" + std::to_string(size) + ":" + std::to_string(version);
+    uint64_t hash = 14695981039346656037ull;
+    for (unsigned char c : identity) hash = (hash ^ c) * 1099511628211ull;
+    char hex[17];
+    snprintf(hex, sizeof(hex), "%016llx", (unsigned long long)hash);
+    return hex;
+}
+
+// Queues chunks of accepted transfers, one per transfer in turn, while fewer than
+// FILE_WINDOW_BYTES are waiting; flush_writes() calls it as the queue drains, so a large
+// file is read from disk only as fast as the connection takes it
+void ExchangeClient::pump_files() {
+    bool queued = true;
+    while (queued && state == STATE_REGISTERED && write_queue_bytes < FILE_WINDOW_BYTES) {
+        queued = false;
+        for (auto& entry : outgoing) {
+            FileTransfer& transfer = entry.second;
+            if (!transfer.accepted || transfer.next_offset >= transfer.size) continue;
+            OutFrame frame;
+            frame.file = transfer.file;
+            frame.file_id = transfer.id;
+            frame.file_offset = transfer.next_offset;
+            frame.file_length = std::min<uint64_t>(FILE_CHUNK_BYTES, transfer.size - transfer.next_offset);
+            frame.header = "FILE:" + transfer.peer + ":" + std::to_string(transfer.id) + ":" +
+                           std::to_string(frame.file_offset) + ":" + std::to_string(frame.file_length) + "\n";
+            transfer.next_offset += frame.file_length;
+            if (write_queue.empty()) oldest_write = std::chrono::steady_clock::now();
+            write_queue_bytes += frame.size();
+            write_queue.push_back(std::move(frame));
+            queued = true;
+        }
+    }
+}
+
+void ExchangeClient::handle_file_control(std::string_view identity, std::string_view frame) {
+    // FILECTL:<peer>:<verb>:<id>[:<rest>]
+    std::vector<std::string_view> fields = split_fields(frame, 5);
+    uint64_t id = 0;
+    if (fields.size() < 4 || !parse_number(fields[3], id)) return;
+    std::string peer(fields[1]);
+    std::string_view verb = fields[2], rest = fields.size() == 5 ? fields[4] : std::string_view();
+    std::string reply_prefix = "FILECTL:" + peer + ":";
+    if (!identity.empty()) {
+        // A hosted identity has nowhere to put a file
+        if (verb == "OFFER") {
+            push_control("@" + std::string(identity) + ":" + reply_prefix + "REFUSE:" + std::to_string(id) + ":" +
+                         std::string(identity) + " is hosted by a gateway and cannot receive files\n");
+            maybe_flush();
+        }
+        return;
+    }
+
+    if (verb == "OFFER") {
+        // <size>:<version>:<name>; only the last path component is used, so a name cannot climb out
+        std::vector<std::string_view> offer = split_fields(rest, 3);
+        uint64_t size = 0, version = 0;
+        std::string name = offer.size() == 3 ? std::string(offer[2].substr(offer[2].find_last_of('/') + 1)) : "";
+        auto refuse = [&](const std::string& reason) {
+            push_control(reply_prefix + "REFUSE:" + std::to_string(id) + ":" + reason + "\n");
+            maybe_flush();
+            if (on_event) on_event(CLIENT_ERROR, "Refused file '" + name + "' from " + peer + ": " + reason);
+        };
+        if (offer.size() != 3 || !parse_number(offer[0], size) || !parse_number(offer[1], version) ||
+            name.empty() || name == "." || name == "..") {
+            refuse("invalid offer");
+            return;
+        }
+        auto key = std::make_pair(peer, id);
+        auto it = incoming.find(key);
+        if (it != incoming.end() && (it->second.name != name || it->second.size != size || it->second.version != version)) {
+            incoming.erase(it); // The sender restarted and reused the ID for another file
+            it = incoming.end();
+        }
+        if (it == incoming.end()) {
+            std::string final_path = config.download_dir + "/" + name;
+            struct stat existing;
+            if (size > config.max_file_bytes) {
+                refuse("larger than the " + std::to_string(config.max_file_bytes) + " byte limit");
+                return;
+            }
+            if (lstat(final_path.c_str(), &existing) == 0) {
+                refuse(name + " already exists");
+                return;
+            }
+            if (!on_file_offer || !on_file_offer(FileOffer{peer, name, size})) {
+                refuse("not accepted");
+                return;
+            }
+            std::string part_path = final_path + "." + part_file_key(peer, size, version) + ".part";
+            for (const auto& entry : incoming) {
+                if (entry.second.path == part_path) {
+                    refuse("another transfer is writing " + name);
+                    return;
+                }
+            }
+            if (mkdir(config.download_dir.c_str(), 0755) < 0 && errno != EEXIST) {
+                refuse("cannot create the download directory");
+                return;
+            }
+            int fd = open(part_path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+            struct stat info;
+            if (fd < 0 || fstat(fd, &info) < 0) {
+                if (fd >= 0) close(fd);
+                refuse(std::string("cannot open the file: ") + strerror(errno));
+                return;
+            }
+            FileTransfer& transfer = incoming[key];
+            transfer.id = id;
+            transfer.incoming = true;
+            transfer.peer = peer;
+            transfer.name = name;
+            transfer.path = part_path;
+            transfer.file = std::make_shared<OpenFile>(fd);
+            transfer.size = size;
+            transfer.version = version;
+            // A partial copy from an earlier attempt is resumed; one too large is not this file
+            transfer.done = (uint64_t)info.st_size <= size ? info.st_size : 0;
+            if ((uint64_t)info.st_size > size && ftruncate(fd, 0) < 0) {
+                incoming.erase(key);
+                refuse(std::string("cannot truncate the file: ") + strerror(errno));
+                return;
+            }
+            transfer.resumed_from = transfer.done;
+            it = incoming.find(key);
+            report_file(it->second, FILE_STARTED);
+        }
+        FileTransfer& transfer = it->second;
+        transfer.resyncing = false;
+        transfer.last_offset = transfer.done;
+        push_control(reply_prefix + "ACCEPT:" + std::to_string(id) + ":" + std::to_string(transfer.done) + "\n");
+        maybe_flush();
+        if (transfer.done == transfer.size) finish_file(it);
+        return;
+    }
+
+    if (verb == "UNREACHABLE" && (rest == "ACCEPT" || rest == "RECEIVED" || rest == "REFUSE" || rest == "UNKNOWN")) {
+        // The sender has gone; the partial copy stays for a later attempt
+        auto it = incoming.find(std::make_pair(peer, id));
+        if (it == incoming.end()) return;
+        report_file(it->second, FILE_FAILED, peer + " is not currently active");
+        incoming.erase(it);
+        return;
+    }
+
+    auto it = outgoing.find(id);
+    if (it == outgoing.end() || it->second.peer != peer) return;
+    FileTransfer& transfer = it->second;
+    if (verb == "ACCEPT") {
+        uint64_t offset = 0;
+        if (!parse_number(rest, offset)) return;
+        // The answer to an OFFER starts (or, after a reconnect, resumes) the transfer; a
+        // later one asks for a resend from that offset
+        bool answer = !transfer.accepted;
+        transfer.accepted = true;
+        transfer.next_offset = transfer.done = std::min(offset, transfer.size);
+        if (answer) {
+            transfer.resumed_from = transfer.done;
+            report_file(transfer, FILE_STARTED);
+        }
+        flush_writes();
+    } else if (verb == "UNKNOWN") {
+        // Only the first of these (one per chunk in flight) is answered
+        if (!transfer.accepted) return;
+        transfer.accepted = false;
+        offer_file(transfer);
+        flush_writes();
+    } else if (verb == "RECEIVED") {
+        transfer.done = transfer.size;
+        report_file(transfer, FILE_COMPLETED);
+        outgoing.erase(it);
+    } else if (verb == "REFUSE" || verb == "UNREACHABLE") {
+        report_file(transfer, FILE_FAILED, verb == "REFUSE" ? std::string(rest) : peer + " is not currently active");
+        outgoing.erase(it);
+    }
+}
+
+// FILE:<origin>:<id>:<offset>:<len>; false if the header cannot be trusted to say how
+// many raw bytes follow
+bool ExchangeClient::begin_chunk(std::string_view identity, std::string_view frame) {
+    std::vector<std::string_view> fields = split_fields(frame);
+    uint64_t id = 0, offset = 0, length = 0;
+    if (fields.size() != 5 || !parse_number(fields[2], id) || !parse_number(fields[3], offset) ||
+        !parse_number(fields[4], length) || length == 0 || length > TCP_RING_MAX / 2) {
+        return false;
+    }
+    chunk_in.active = true;
+    chunk_in.origin = std::string(fields[1]);
+    chunk_in.id = id;
+    chunk_in.offset = offset;
+    chunk_in.length = length;
+    chunk_in.discard = !identity.empty(); // Refused at the OFFER; these are only skipped
+    return true;
+}
+
+// Writes the current chunk with one positioned write straight from the receive ring,
+// once all of its bytes are in; false until then
+bool ExchangeClient::receive_chunk() {
+    if (tcp_ring->readable() < chunk_in.length) return false;
+    chunk_in.active = false;
+    auto it = chunk_in.discard ? incoming.end() : incoming.find(std::make_pair(chunk_in.origin, chunk_in.id));
+    if (it == incoming.end()) {
+        tcp_ring->skip(chunk_in.length);
+        if (!chunk_in.discard && state == STATE_REGISTERED) {
+            push_control("FILECTL:" + chunk_in.origin + ":UNKNOWN:" + std::to_string(chunk_in.id) + "\n");
+            maybe_flush();
+        }
+        return true;
+    }
+    FileTransfer& transfer = it->second;
+    std::string reply_prefix = "FILECTL:" + transfer.peer + ":";
+    if (chunk_in.offset != transfer.done) {
+        // A chunk went missing (dropped on the way, or lost with a connection): ask for
+        // everything from what we have. Offsets only go backwards once the sender has
+        // rewound, so one request per rewind is enough.
+        if (!transfer.resyncing || chunk_in.offset <= transfer.last_offset) {
+            transfer.resyncing = true;
+            push_control(reply_prefix + "ACCEPT:" + std::to_string(transfer.id) + ":" + std::to_string(transfer.done) + "\n");
+            maybe_flush();
+        }
+        transfer.last_offset = chunk_in.offset;
+        tcp_ring->skip(chunk_in.length);
+        return true;
+    }
+
+    struct iovec iov[2];
+    int count = tcp_ring->peek(chunk_in.length, iov);
+    ssize_t written = pwritev(transfer.file->fd, iov, count, chunk_in.offset);
+    tcp_ring->skip(chunk_in.length);
+    if (written != (ssize_t)chunk_in.length) {
+        std::string reason = written < 0 ? std::string("write failed: ") + strerror(errno) : "write failed: disk full";
+        push_control(reply_prefix + "REFUSE:" + std::to_string(transfer.id) + ":" + reason + "\n");
+        maybe_flush();
+        report_file(transfer, FILE_FAILED, reason);
+        incoming.erase(it);
+        return true;
+    }
+    transfer.done += chunk_in.length;
+    transfer.last_offset = chunk_in.offset;
+    transfer.resyncing = false;
+    if (transfer.done == transfer.size) {
+        finish_file(it);
+    } else {
+        report_file(transfer, FILE_PROGRESS);
+    }
+    return true;
+}
+
+// Receiver: every byte is in, so the partial copy takes the file's name, unless a file
+// of that name has appeared since the OFFER (it is never replaced)
+void ExchangeClient::finish_file(std::map<std::pair<std::string, uint64_t>, FileTransfer>::iterator it) {
+    FileTransfer transfer = std::move(it->second);
+    incoming.erase(it);
+    transfer.file.reset();
+    std::string final_path = config.download_dir + "/" + transfer.name;
+    std::string reply_prefix = "FILECTL:" + transfer.peer + ":";
+    if (renameat2(AT_FDCWD, transfer.path.c_str(), AT_FDCWD, final_path.c_str(), RENAME_NOREPLACE) < 0) {
+        std::string reason = errno == EEXIST ? transfer.name + " already exists"
+                                             : std::string("cannot rename the finished file: ") + strerror(errno);
+        push_control(reply_prefix + "REFUSE:" + std::to_string(transfer.id) + ":" + reason + "\n");
+        maybe_flush();
+        report_file(transfer, FILE_FAILED, reason);
+        return;
+    }
+    push_control(reply_prefix + "RECEIVED:" + std::to_string(transfer.id) + ":" + std::to_string(transfer.size) + "\n");
+    maybe_flush();
+    transfer.path = final_path;
+    report_file(transfer, FILE_COMPLETED);
+}
+
+// FILE_PROGRESS is only passed on when another tenth of the file is done
+void ExchangeClient::report_file(FileTransfer& transfer, FileEvent event, const std::string& detail) {
+    int tenths = transfer.size ? (int)(transfer.done * 10 / transfer.size) : 10;
+    if (event == FILE_PROGRESS && (tenths <= transfer.reported_tenths || tenths >= 10)) return;
+    transfer.reported_tenths = tenths; // A resumed transfer counts on from where it starts
+
+    if (!on_file) return;
+    FileProgress progress;
+    progress.event = event;
+    progress.id = transfer.id;
+    progress.incoming = transfer.incoming;
+    progress.peer = transfer.peer;
+    progress.name = transfer.incoming ? transfer.path : transfer.name;
+    progress.size = transfer.size;
+    progress.bytes = transfer.done;
+    progress.resumed_from = transfer.resumed_from;
+    progress.detail = detail;
+    on_file(progress);
+}
@@ -0,0 +1,303 @@
+// Information Exchange client library: one campus session with the server (TCP routing
+// plus UDP broadcasts), with framing, resumable sessions, campus ID caching, reconnects,
+// write coalescing and file transfer. No global state, so a process can run any number
+// of sessions.
+//
+// The client is non-blocking and single-threaded: the owner polls fd() for readability
+// (or just calls process_events() with a timeout) and every callback runs inside
+// process_events(). Calls on one client must not race with each other.
+//
+// Build: g++ -std=c++17 -pthread <your sources> ie_client.cpp
+#ifndef IE_CLIENT_H
+#define IE_CLIENT_H
+
+#include <string>
+#include <string_view>
+#include <memory>
+#include <deque>
+#include <map>
+#include <set>
+#include <vector>
+#include <chrono>
+#include <functional>
+#include <random>
+#include <cstdint>
+
+// --- Configuration ---
+struct ClientConfig {
+    std::string campus_name;
+    int udp_port = -1;                      // Local port for broadcasts (must be free)
+    std::string server_ip = "127.0.0.1";
+    int server_port = 5000;
+    bool resumable = true;                  // Register as RESUME; the server holds our queue across drops
+    bool auto_reconnect = true;             // After the first registration, reconnect when the server goes away
+    int reconnect_base_ms = 250;            // First reconnect delay; doubles per failed attempt...
+    int reconnect_max_ms = 30000;           // ...up to this cap (each delay is jittered over its upper half)
+    size_t max_queued_bytes = 1048576;      // Unsent messages (write queue + outbox) before send() refuses
+    size_t coalesce_bytes = 0;              // Hold writes until this much is queued... (0 = write at once)
+    int coalesce_ms = 0;                    // ...or the oldest queued frame has waited this long
+    int udp_rcvbuf_bytes = 4194304;         // Kernel receive buffer for broadcast bursts between drains
+    std::string download_dir = "downloads"; // Where received files are written (created when needed)
+    uint64_t max_file_bytes = 1073741824;   // Offers of larger files are refused before on_file_offer
+};
+
+enum ClientEvent {
+    CLIENT_CONNECTED,           // Registered (detail says whether held messages were sent)
+    CLIENT_CONNECTION_LOST,     // Server went away; messages are held from here on
+    CLIENT_RECONNECT_SCHEDULED, // Detail: attempt number and delay
+    CLIENT_ERROR,               // Non-fatal problem (detail says what)
+    CLIENT_ATTACHED,            // The server accepted an attach(); detail is the identity
+    CLIENT_CLOSED               // Session over: after quit(), or a failure we do not retry
+};
+
+// How the session ended (see close_status())
+enum ClientCloseStatus {
+    CLOSE_OPEN,                 // Not closed yet
+    CLOSE_FINISHED,             // After quit(): the server processed everything and closed
+    CLOSE_ABANDONED,            // quit() while disconnected: held messages were discarded
+    CLOSE_FAILED                // A failure we do not retry (last_error() says what)
+};
+
+struct ClientStats {
+    uint64_t messages_sent = 0;     // Messages fully written to the socket
+    uint64_t bytes_sent = 0;
+    uint64_t writes = 0;            // sendmsg calls that wrote something
+    uint64_t messages_received = 0;
+    uint64_t broadcasts_received = 0;
+    uint64_t dropped = 0;           // Refused by send() because the queue was full
+};
+
+// The answer to one ping()
+struct PingResult {
+    std::string destination;        // Campus probed (empty: the server itself)
+    std::string identity;           // Hosted identity it was sent as (empty: ourselves)
+    bool reachable = true;          // False if the destination was not active
+    int64_t rtt_us = 0;             // Probe sent to answer received, measured here
+    int64_t server_us = -1;         // Server probe: time the probe spent in the server
+    int64_t destination_us = -1;    // Campus probe: server-measured wait for the destination's answer
+};
+
+enum FileEvent {
+    FILE_STARTED,               // The receiver accepted; resumed_from says where it picked up
+    FILE_PROGRESS,              // Another tenth of the file sent or written
+    FILE_COMPLETED,             // Receiver: the file is in place. Sender: the receiver has it all.
+    FILE_FAILED                 // Transfer abandoned (detail says why); a partial copy is kept
+};
+
+// One file transfer, as reported through on_file and listed by transfers()
+struct FileProgress {
+    FileEvent event = FILE_PROGRESS;
+    uint64_t id = 0;                // The sender's transfer ID
+    bool incoming = false;
+    std::string peer;               // The campus at the other end
+    std::string name;               // Sender: the file's name. Receiver: where it is written.
+    uint64_t size = 0;
+    uint64_t bytes = 0;             // Written to the socket (sender) or to disk (receiver)
+    uint64_t resumed_from = 0;      // Offset the receiver already had
+    std::string detail;             // FILE_FAILED: the reason
+};
+
+// A file another campus wants to send, as put to on_file_offer
+struct FileOffer {
+    std::string peer;               // The sending campus
+    std::string name;               // The file's name (its last path component only)
+    uint64_t size = 0;
+};
+
+class ExchangeClient {
+public:
+    // Routed messages ("FROM <campus>: ..." or "SERVER: ..."), without sequence numbers
+    std::function<void(std::string_view message)> on_message;
+    // One broadcast record (a coalesced datagram is split into its records)
+    std::function<void(std::string_view broadcast)> on_broadcast;
+    std::function<void(ClientEvent event, const std::string& detail)> on_event;
+    // Routed messages for an identity this session hosts (see attach()); without it
+    // they go to on_message as "@<identity>:<message>"
+    std::function<void(std::string_view identity, std::string_view message)> on_identity_message;
+    std::function<void(const PingResult& result)> on_pong;
+    std::function<void(const FileProgress& progress)> on_file;
+    // Decides whether to take an offered file; without it every offer is refused. Offers
+    // over max_file_bytes, or for a name download_dir already has, never reach it.
+    std::function<bool(const FileOffer& offer)> on_file_offer;
+
+    explicit ExchangeClient(ClientConfig config);
+    ~ExchangeClient();
+    ExchangeClient(const ExchangeClient&) = delete;
+    ExchangeClient& operator=(const ExchangeClient&) = delete;
+
+    // Binds the UDP port and starts connecting. False (with the reason in last_error())
+    // if either fails outright; registration completes inside process_events().
+    bool start();
+
+    // Readable whenever process_events() has work (socket data, writability, timers)
+    int fd() const { return epoll_fd; }
+
+    // Handles whatever is ready, waiting up to 'timeout_ms' (-1 = until something is).
+    // Returns false once the session is closed.
+    bool process_events(int timeout_ms = 0);
+
+    // Queue a message. While disconnected it waits in the outbox for the reconnect.
+    // False if the message contains '\n' or max_queued_bytes is reached (try again
+    // after process_events() has drained some). The string_view overloads copy the
+    // message only if it cannot be written straight away; the shared overloads never
+    // copy it, so one payload can be fanned out to many destinations.
+    bool send(std::string_view destination, std::string_view message) { return send_as({}, destination, message); }
+    bool send(std::string_view destination, std::shared_ptr<const std::string> message) {
+        return send_as({}, destination, std::move(message));
+    }
+    bool broadcast(std::string_view message) { return send("BROADCAST", message); }
+    bool broadcast(std::shared_ptr<const std::string> message) { return send("BROADCAST", std::move(message)); }
+
+    // Gateway mode: this session also speaks for 'identity', a campus with no connection
+    // of its own. Its traffic is multiplexed over ours and it is attached again after
+    // every reconnect; CLIENT_ATTACHED reports the server's acceptance.
+    bool attach(std::string_view identity);
+    void detach(std::string_view identity);
+    // send() on behalf of an attached identity
+    bool send_as(std::string_view identity, std::string_view destination, std::string_view message);
+    bool send_as(std::string_view identity, std::string_view destination, std::shared_ptr<const std::string> message);
+
+    // Latency probe to the server (empty destination) or through it to a campus, which
+    // answers automatically; the result arrives through on_pong. False while not
+    // connected. Probes in flight when the connection drops are forgotten.
+    bool ping(std::string_view destination = {}, std::string_view identity = {});
+
+    // Streams the file at 'path' to 'destination', whose client writes it into its
+    // download_dir if its on_file_offer agrees. The data goes from the page cache to the socket with sendfile(), a
+    // chunk at a time behind the other queued frames. A transfer cut off by a reconnect
+    // continues where the receiver's partial copy ends, and so does sending the same
+    // file again later. Returns the transfer ID, or 0 (see last_error()).
+    uint64_t send_file(std::string_view destination, const std::string& path);
+    std::vector<FileProgress> transfers() const;    // Transfers in progress, both ways
+
+    // Ends the session for good: queued messages go out, then QUIT, and the session
+    // closes when the server does
+    void quit();
+
+    bool connected() const { return state == STATE_REGISTERED; }
+    bool closed() const { return state == STATE_CLOSED; }
+    size_t queued_bytes() const { return write_queue_bytes + outbox_bytes; }
+    const ClientStats& stats() const { return counters; }
+    const std::string& last_error() const { return error_text; }
+    ClientCloseStatus close_status() const { return close_reason; }
+
+private:
+    enum State { STATE_IDLE, STATE_CONNECTING, STATE_REGISTERED, STATE_BACKOFF, STATE_QUITTING, STATE_CLOSED };
+
+    struct OpenFile;
+
+    // One queued frame: header + body + '\n', written with gather I/O; a FILE chunk is
+    // its header followed by a range of a file, written with sendfile()
+    struct OutFrame {
+        std::string destination;                    // As given by the caller (empty for control frames)
+        std::string identity;                       // Gateway identity it is sent as (empty for ourselves)
+        std::string header;                         // "<destination or #id>:", or a whole control line
+        std::shared_ptr<const std::string> shared;  // Body, when it is shared...
+        std::string_view borrowed;                  // ...or the caller's, only during send()...
+        std::string owned;                          // ...or copied
+        size_t sent = 0;                            // Bytes of this frame already written
+        std::shared_ptr<OpenFile> file;             // FILE chunk: source of the bytes after the header
+        uint64_t file_id = 0;
+        uint64_t file_offset = 0;
+        size_t file_length = 0;
+        std::string_view body() const {
+            if (shared) return *shared;
+            return borrowed.data() ? borrowed : std::string_view(owned);
+        }
+        size_t size() const { return header.size() + body().size() + file_length + (destination.empty() ? 0 : 1); }
+    };
+
+    // Either end of a file transfer
+    struct FileTransfer {
+        uint64_t id = 0;
+        bool incoming = false;
+        std::string peer, name;
+        std::string path;                           // Source file, or the partial copy being written
+        uint64_t version = 0;                       // The source's mtime (ns), sent in the OFFER
+        std::shared_ptr<OpenFile> file;
+        uint64_t size = 0;
+        uint64_t done = 0;                          // Bytes written to the socket / to disk
+        uint64_t resumed_from = 0;
+        int reported_tenths = 0;                    // Progress already reported
+        uint64_t next_offset = 0;                   // Sender: next chunk to queue...
+        bool accepted = false;                      // ...once the receiver has said where to start
+        uint64_t last_offset = 0;                   // Receiver: offset of the latest chunk...
+        bool resyncing = false;                     // ...and whether it has asked for a resend
+    };
+
+    class ByteRing;
+
+    bool begin_connect();
+    void finish_connect();
+    void connection_lost(const std::string& reason);
+    void schedule_reconnect();
+    void close_session(const std::string& reason, ClientCloseStatus status);
+    bool enqueue(OutFrame frame);
+    void push_write(OutFrame frame);
+    void push_control(const std::string& line);
+    void maybe_flush();
+    void flush_writes();
+    void on_timer();
+    void arm_timer();
+    void read_tcp();
+    void read_udp();
+    void handle_frame(std::string& frame);
+    void send_ack();
+    bool handle_probe(std::string_view identity, std::string_view frame);
+    void handle_file_control(std::string_view identity, std::string_view frame);
+    bool begin_chunk(std::string_view identity, std::string_view frame);
+    bool receive_chunk();
+    void offer_file(const FileTransfer& transfer);
+    void pump_files();
+    void finish_file(std::map<std::pair<std::string, uint64_t>, FileTransfer>::iterator it);
+    void report_file(FileTransfer& transfer, FileEvent event, const std::string& detail = {});
+
+    ClientConfig config;
+    State state = STATE_IDLE;
+    bool ever_registered = false;
+    int epoll_fd = -1, tcp_fd = -1, udp_fd = -1, timer_fd = -1;
+    uint32_t tcp_events = 0;                        // Interest currently registered for tcp_fd
+    bool write_shut = false;                        // Sent our FIN after QUIT
+    std::unique_ptr<ByteRing> tcp_ring;
+    std::unique_ptr<char[]> udp_buffers;            // recvmmsg slots; left uninitialized, so untouched pages stay unmapped
+
+    std::deque<OutFrame> write_queue;               // Bound to the current connection
+    size_t write_queue_bytes = 0;
+    std::chrono::steady_clock::time_point oldest_write;
+    std::deque<OutFrame> outbox;                    // Held while disconnected
+    size_t outbox_bytes = 0;
+
+    std::string session_token;                      // Resume token issued by the server
+    uint64_t last_seq = 0;                          // Last sequenced frame received
+    size_t unacked_frames = 0, unacked_bytes = 0;   // Received since we last acknowledged
+    std::map<std::string, std::string, std::less<>> campus_ids; // Name -> server-issued ID
+    std::set<std::string, std::less<>> resolving;   // Names with a RESOLVE in flight
+    std::set<std::string, std::less<>> identities;  // Attached gateway identities
+
+    struct PendingPing {
+        std::string destination, identity;
+        std::chrono::steady_clock::time_point sent_at;
+    };
+    std::map<uint64_t, PendingPing> pings;          // By token
+    uint64_t next_ping_token = 1;
+
+    std::map<uint64_t, FileTransfer> outgoing;      // By our transfer ID
+    std::map<std::pair<std::string, uint64_t>, FileTransfer> incoming; // By sender and its ID
+    uint64_t next_file_id = 1;
+    struct {
+        bool active = false;                        // Raw bytes of a FILE chunk come next
+        bool discard = false;                       // ...for a transfer we are not receiving
+        std::string origin;
+        uint64_t id = 0, offset = 0;
+        size_t length = 0;
+    } chunk_in;
+
+    int reconnect_failures = 0;
+    std::chrono::steady_clock::time_point reconnect_at;
+    std::mt19937 jitter;
+    ClientStats counters;
+    std::string error_text;
+    ClientCloseStatus close_reason = CLOSE_OPEN;
+};
+
+#endif
@@ -0,0 +1,209 @@
+// Information Exchange framing: the vectorized scanner that indexes the '\n'-terminated
+// frames of a read (with their first ':' and a UTF-8 check), and the formatting of
+// routed frames. Header-only.
+#ifndef IE_FRAMES_H
+#define IE_FRAMES_H
+
+#include "ie_memory.h"
+#include <string_view>
+#include <iostream>
+#include <algorithm>
+#include <cstdint>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+// One frame found in a receive buffer, as offsets into it
+struct FrameSpan {
+    static constexpr uint32_t NO_COLON = UINT32_MAX;
+    uint32_t offset;            // First byte of the frame
+    uint32_t length;            // Without the '\n' terminator (or a '\r' before it)
+    uint32_t colon;             // First ':' relative to 'offset', or NO_COLON
+    bool valid_utf8;
+};
+
+// Strict UTF-8 check (no overlongs, surrogates or code points past U+10FFFF). Only
+// frames the vector pass saw non-ASCII bytes in get here.
+inline bool utf8_valid(const unsigned char *text, size_t length) {
+    size_t i = 0;
+    while (i < length) {
+        unsigned char lead = text[i];
+        if (lead < 0x80) {
+            i++;
+            continue;
+        }
+        size_t sequence;
+        uint32_t code_point;
+        if ((lead & 0xE0) == 0xC0) {
+            sequence = 2;
+            code_point = lead & 0x1F;
+        } else if ((lead & 0xF0) == 0xE0) {
+            sequence = 3;
+            code_point = lead & 0x0F;
+        } else if ((lead & 0xF8) == 0xF0) {
+            sequence = 4;
+            code_point = lead & 0x07;
+        } else {
+            return false;
+        }
+        if (i + sequence > length) return false;
+        for (size_t k = 1; k < sequence; ++k) {
+            if ((text[i + k] & 0xC0) != 0x80) return false;
+            code_point = (code_point << 6) | (text[i + k] & 0x3F);
+        }
+        static const uint32_t min_code_point[] = {0, 0, 0x80, 0x800, 0x10000};
+        if (code_point < min_code_point[sequence] || code_point > 0x10FFFF ||
+            (code_point >= 0xD800 && code_point <= 0xDFFF)) {
+            return false;
+        }
+        i += sequence;
+    }
+    return true;
+}
+
+// Turns per-64-byte-block bitmasks ('\n', ':' and bytes >= 0x80) into frame spans.
+// Each frame costs O(1) mask operations however many ':' or non-ASCII bytes it has.
+class FrameIndexer {
+public:
+    FrameIndexer(const char *data, ArenaVector<FrameSpan>& spans) : data(data), spans(spans) {}
+
+    void block(size_t base, uint64_t newline, uint64_t colon, uint64_t high) {
+        while (true) {
+            uint64_t terminator = newline & (0 - newline); // Lowest '\n' bit, if any
+            uint64_t before = terminator ? terminator - 1 : ~0ULL;
+            if (frame_colon == FrameSpan::NO_COLON && (colon & before)) {
+                frame_colon = base + __builtin_ctzll(colon & before) - frame_start;
+            }
+            if (high & before) frame_non_ascii = true;
+            if (!terminator) return;
+            emit(base + __builtin_ctzll(terminator));
+            uint64_t done = before | terminator;
+            newline &= ~done;
+            colon &= ~done;
+            high &= ~done;
+        }
+    }
+
+    // Bytes covered by complete frames
+    size_t consumed() const { return frame_start; }
+
+private:
+    void emit(size_t newline_pos) {
+        size_t end = newline_pos;
+        if (end > frame_start && data[end - 1] == '\r') end--;
+        bool valid = !frame_non_ascii || utf8_valid((const unsigned char *)data + frame_start, end - frame_start);
+        spans.push_back({(uint32_t)frame_start, (uint32_t)(end - frame_start), frame_colon, valid});
+        frame_start = newline_pos + 1;
+        frame_colon = FrameSpan::NO_COLON;
+        frame_non_ascii = false;
+    }
+
+    const char *data;
+    ArenaVector<FrameSpan>& spans;
+    size_t frame_start = 0;
+    uint32_t frame_colon = FrameSpan::NO_COLON;
+    bool frame_non_ascii = false;
+};
+
+// Masks for up to 64 bytes, a byte at a time (the fallback, and every vector scanner's tail)
+inline void scalar_block(const char *data, size_t length, uint64_t& newline, uint64_t& colon, uint64_t& high) {
+    newline = colon = high = 0;
+    for (size_t i = 0; i < length; ++i) {
+        unsigned char c = data[i];
+        newline |= (uint64_t)(c == '\n') << i;
+        colon |= (uint64_t)(c == ':') << i;
+        high |= (uint64_t)(c >= 0x80) << i;
+    }
+}
+
+// Indexes every complete frame in data[0, length) into 'spans'. Returns the bytes they
+// cover; whatever follows is an incomplete frame for the next read.
+typedef size_t (*FrameScanner)(const char *data, size_t length, ArenaVector<FrameSpan>& spans);
+
+inline size_t scan_frames_scalar(const char *data, size_t length, ArenaVector<FrameSpan>& spans) {
+    FrameIndexer indexer(data, spans);
+    uint64_t newline, colon, high;
+    for (size_t base = 0; base < length; base += 64) {
+        scalar_block(data + base, std::min<size_t>(64, length - base), newline, colon, high);
+        indexer.block(base, newline, colon, high);
+    }
+    return indexer.consumed();
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("sse2")))
+inline size_t scan_frames_sse2(const char *data, size_t length, ArenaVector<FrameSpan>& spans) {
+    FrameIndexer indexer(data, spans);
+    const __m128i newline_byte = _mm_set1_epi8('\n'), colon_byte = _mm_set1_epi8(':');
+    size_t base = 0;
+    for (; base + 64 <= length; base += 64) {
+        uint64_t newline = 0, colon = 0, high = 0;
+        for (int lane = 0; lane < 4; ++lane) {
+            __m128i chunk = _mm_loadu_si128((const __m128i *)(data + base + lane * 16));
+            newline |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, newline_byte)) << (lane * 16);
+            colon |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, colon_byte)) << (lane * 16);
+            high |= (uint64_t)(uint16_t)_mm_movemask_epi8(chunk) << (lane * 16);
+        }
+        indexer.block(base, newline, colon, high);
+    }
+    if (base < length) {
+        uint64_t newline, colon, high;
+        scalar_block(data + base, length - base, newline, colon, high);
+        indexer.block(base, newline, colon, high);
+    }
+    return indexer.consumed();
+}
+
+__attribute__((target("avx2")))
+inline size_t scan_frames_avx2(const char *data, size_t length, ArenaVector<FrameSpan>& spans) {
+    FrameIndexer indexer(data, spans);
+    const __m256i newline_byte = _mm256_set1_epi8('\n'), colon_byte = _mm256_set1_epi8(':');
+    size_t base = 0;
+    for (; base + 64 <= length; base += 64) {
+        __m256i low_half = _mm256_loadu_si256((const __m256i *)(data + base));
+        __m256i high_half = _mm256_loadu_si256((const __m256i *)(data + base + 32));
+        uint64_t newline = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(low_half, newline_byte)) |
+                           (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(high_half, newline_byte)) << 32;
+        uint64_t colon = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(low_half, colon_byte)) |
+                         (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(high_half, colon_byte)) << 32;
+        uint64_t high = (uint32_t)_mm256_movemask_epi8(low_half) |
+                        (uint64_t)(uint32_t)_mm256_movemask_epi8(high_half) << 32;
+        indexer.block(base, newline, colon, high);
+    }
+    if (base < length) {
+        uint64_t newline, colon, high;
+        scalar_block(data + base, length - base, newline, colon, high);
+        indexer.block(base, newline, colon, high);
+    }
+    return indexer.consumed();
+}
+#endif
+
+// Chosen once at startup by select_frame_scanner()
+inline FrameScanner scan_frames = scan_frames_scalar;
+inline const char *frame_scanner_name = "scalar";
+
+inline void select_frame_scanner() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        scan_frames = scan_frames_avx2;
+        frame_scanner_name = "avx2";
+    } else if (__builtin_cpu_supports("sse2")) {
+        scan_frames = scan_frames_sse2;
+        frame_scanner_name = "sse2";
+    }
+#endif
+    std::cout << "[INFO] Frame scanner: " << frame_scanner_name << "." << std::endl;
+}
+
+// The frame a recipient gets: "FROM <sender>: <content>\n", built with one reservation
+// from the sender's interned "FROM <sender>: " prefix
+inline Payload format_routed_message(std::string_view from_prefix, std::string_view content) {
+    PooledString final_msg;
+    final_msg.reserve(from_prefix.size() + content.size() + 1);
+    final_msg.append(from_prefix).append(content).push_back('\n');
+    return make_payload(std::move(final_msg));
+}
+
+#endif
@@ -0,0 +1,415 @@
+// Information Exchange server memory: the huge-page backed PageHeap, the size-classed
+// BlockPool behind pooled payload strings, and the bump-pointer Arena that holds one
+// read batch's scratch. Header-only; shared by the server, its tests and ie_bench.
+#ifndef IE_MEMORY_H
+#define IE_MEMORY_H
+
+#include <string>
+#include <string_view>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <new>
+#include <cstring>
+#include <cstddef>
+#include <cstdint>
+#include <sys/mman.h>
+
+// --- Configuration ---
+#define POOL_MIN_BLOCK 64               // Smallest pooled block; classes double from here
+#define POOL_SIZE_CLASSES 7             // 64 B .. 4 KB; larger allocations go straight to malloc
+#define POOL_THREAD_CACHE 128           // Free blocks per class a thread keeps before returning half
+#define POOL_SLAB_BYTES 262144          // New blocks are carved from slabs of this size
+#define ARENA_BLOCK_BYTES 16384         // Scratch arena block for one read batch (grows if needed)
+#define HUGE_PAGE_BYTES 2097152         // Pool slabs and receive buffers are mapped in 2 MB regions
+#define HUGE_PAGES_ENABLED 1            // 0 keeps those regions on ordinary 4 KB pages
+
+// Long-lived buffer memory (pool slabs, receive buffers) carved from 2 MB regions so
+// thousands of sessions' buffers sit behind a few TLB entries instead of hundreds of
+// 4 KB pages each. A region is a reserved huge page (MAP_HUGETLB) while the hugetlbfs
+// pool lasts, otherwise a 2 MB-aligned mapping advised for transparent huge pages, or
+// plain pages when THP is disabled. Nothing is unmapped; callers recycle what they carve.
+class PageHeap {
+public:
+    enum Backing { BACKING_HUGETLB, BACKING_THP, BACKING_SMALL, BACKING_KINDS };
+    struct Stats {
+        uint64_t regions[BACKING_KINDS];    // 2 MB regions mapped, by backing
+        uint64_t mapped_bytes;
+        uint64_t carved_bytes;              // Handed out so far
+    };
+
+    static void *allocate(size_t bytes) {
+        bytes = (bytes + 63) & ~(size_t)63; // Keeps every carve cache-line aligned
+        std::lock_guard<std::mutex> lock(mutex);
+        carved_bytes += bytes;
+        if (bytes > HUGE_PAGE_BYTES) {
+            return map_region((bytes + HUGE_PAGE_BYTES - 1) & ~(size_t)(HUGE_PAGE_BYTES - 1));
+        }
+        if (!current || used + bytes > HUGE_PAGE_BYTES) {
+            current = map_region(HUGE_PAGE_BYTES);
+            used = 0;
+        }
+        void *pointer = current + used;
+        used += bytes;
+        return pointer;
+    }
+
+    static Stats stats() {
+        std::lock_guard<std::mutex> lock(mutex);
+        Stats snapshot = {};
+        for (int kind = 0; kind < BACKING_KINDS; ++kind) snapshot.regions[kind] = regions[kind];
+        snapshot.mapped_bytes = mapped_bytes;
+        snapshot.carved_bytes = carved_bytes;
+        return snapshot;
+    }
+
+    // Skips reserved huge pages from now on, as when the hugetlbfs pool has run dry
+    static void disable_hugetlb() {
+        std::lock_guard<std::mutex> lock(mutex);
+        hugetlb_available = false;
+    }
+
+    static const char *backing_name(Backing backing) {
+        switch (backing) {
+            case BACKING_HUGETLB: return "hugetlb";
+            case BACKING_THP: return "THP";
+            default: return "4 KB pages";
+        }
+    }
+
+private:
+    // mutex held
+    static char *map_region(size_t bytes) {
+        // 1. Reserved huge pages; once the pool runs dry, later regions skip the attempt
+        if (HUGE_PAGES_ENABLED && hugetlb_available) {
+            void *region = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if (region != MAP_FAILED) return record(static_cast<char *>(region), bytes, BACKING_HUGETLB);
+            hugetlb_available = false;
+        }
+
+        // 2. Over-map and trim to a 2 MB boundary, so THP can back the region with whole huge pages
+        size_t span = bytes + HUGE_PAGE_BYTES;
+        void *raw = mmap(nullptr, span, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (raw == MAP_FAILED) throw std::bad_alloc();
+        char *start = static_cast<char *>(raw);
+        char *aligned = reinterpret_cast<char *>((reinterpret_cast<uintptr_t>(start) + HUGE_PAGE_BYTES - 1) &
+                                                 ~(uintptr_t)(HUGE_PAGE_BYTES - 1));
+        if (aligned > start) munmap(start, aligned - start);
+        if (start + span > aligned + bytes) munmap(aligned + bytes, start + span - (aligned + bytes));
+
+        // 3. Plain pages if THP is off (madvise still succeeds then, so ask sysfs)
+        bool use_thp = HUGE_PAGES_ENABLED && thp_enabled() && madvise(aligned, bytes, MADV_HUGEPAGE) == 0;
+        return record(aligned, bytes, use_thp ? BACKING_THP : BACKING_SMALL);
+    }
+
+    static char *record(char *region, size_t bytes, Backing backing) {
+        regions[backing] += bytes / HUGE_PAGE_BYTES;
+        mapped_bytes += bytes;
+        if (!logged[backing]) {
+            logged[backing] = true;
+            std::cout << "[INFO] Buffer memory backed by " << backing_name(backing) << "." << std::endl;
+        }
+        return region;
+    }
+
+    static bool thp_enabled() {
+        static const bool enabled = [] {
+            std::ifstream setting("/sys/kernel/mm/transparent_hugepage/enabled");
+            std::string modes;
+            std::getline(setting, modes);
+            return !modes.empty() && modes.find("[never]") == std::string::npos;
+        }();
+        return enabled;
+    }
+
+    static inline std::mutex mutex;
+    static inline char *current = nullptr;  // Region being carved
+    static inline size_t used = 0;
+    static inline bool hugetlb_available = true;
+    static inline bool logged[BACKING_KINDS] = {};
+    static inline uint64_t regions[BACKING_KINDS] = {};
+    static inline uint64_t mapped_bytes = 0, carved_bytes = 0;
+};
+
+// Size-classed block pool behind PoolAllocator. Each thread keeps a free list per class,
+// so a pooled allocate/free is a couple of pointer moves. Payloads are typically built
+// on a handler thread and freed on the I/O thread, so thread caches trade batches of
+// blocks with a shared depot. Blocks are carved from PageHeap slabs that are never
+// returned: the pool settles at the high-water mark of the load.
+class BlockPool {
+public:
+    struct Stats {
+        uint64_t allocations;   // Pooled allocations
+        uint64_t cache_hits;    // Served from the thread's own free list
+        uint64_t depot_refills; // Batches taken from the shared depot
+        uint64_t slabs;         // Slabs carved so far
+        uint64_t oversize;      // Too large for any class; went to malloc
+    };
+
+    static void *allocate(size_t bytes) {
+        int size_class = class_of(bytes);
+        if (size_class < 0) {
+            oversize.fetch_add(1, std::memory_order_relaxed);
+            return ::operator new(bytes);
+        }
+        ThreadCache& cache = thread_cache();
+        if (cache.retired) return depot_pop(size_class);
+        if (!cache.free[size_class]) {
+            refill(cache, size_class);
+        } else {
+            cache.hits++;
+        }
+        FreeBlock *block = cache.free[size_class];
+        cache.free[size_class] = block->next;
+        cache.count[size_class]--;
+        if (++cache.allocations == STATS_BATCH) report(cache);
+        return block;
+    }
+
+    static void deallocate(void *pointer, size_t bytes) {
+        int size_class = class_of(bytes);
+        if (size_class < 0) {
+            ::operator delete(pointer);
+            return;
+        }
+        FreeBlock *block = static_cast<FreeBlock *>(pointer);
+        ThreadCache& cache = thread_cache();
+        if (cache.retired) {
+            Depot& depot = depots[size_class];
+            std::lock_guard<std::mutex> lock(depot.mutex);
+            block->next = depot.free;
+            depot.free = block;
+            return;
+        }
+        block->next = cache.free[size_class];
+        cache.free[size_class] = block;
+        if (++cache.count[size_class] > POOL_THREAD_CACHE) release(cache, size_class, POOL_THREAD_CACHE / 2);
+    }
+
+    static Stats stats() {
+        return {allocations.load(), cache_hits.load(), depot_refills.load(), slabs.load(), oversize.load()};
+    }
+
+private:
+    static const uint64_t STATS_BATCH = 256; // Thread-local counts are published this often
+
+    struct FreeBlock {
+        FreeBlock *next;
+    };
+    struct ThreadCache {
+        FreeBlock *free[POOL_SIZE_CLASSES];
+        size_t count[POOL_SIZE_CLASSES];
+        uint64_t allocations, hits; // Not yet published
+        bool retired;               // Thread is exiting; go straight to the depot
+    };
+    struct Depot {              // Static storage, so 'free' starts out null
+        std::mutex mutex;
+        FreeBlock *free;
+    };
+    // Hands a thread's blocks back when it exits (handler threads come and go)
+    struct CacheReleaser {
+        ThreadCache *cache;
+        ~CacheReleaser() {
+            for (int size_class = 0; size_class < POOL_SIZE_CLASSES; ++size_class) {
+                release(*cache, size_class, cache->count[size_class]);
+            }
+            report(*cache);
+            cache->retired = true;
+        }
+    };
+
+    static inline Depot depots[POOL_SIZE_CLASSES];
+    static inline std::atomic<uint64_t> allocations{0}, cache_hits{0}, depot_refills{0}, slabs{0}, oversize{0};
+
+    static int class_of(size_t bytes) {
+        if (bytes <= POOL_MIN_BLOCK) return 0;
+        int size_class = (64 - __builtin_clzl(bytes - 1)) - __builtin_ctz(POOL_MIN_BLOCK);
+        return size_class < POOL_SIZE_CLASSES ? size_class : -1;
+    }
+
+    static ThreadCache& thread_cache() {
+        // Trivially destructible, so it stays usable after the releaser has run
+        static thread_local ThreadCache cache = {};
+        static thread_local CacheReleaser releaser{&cache};
+        return cache;
+    }
+
+    static void report(ThreadCache& cache) {
+        allocations.fetch_add(cache.allocations, std::memory_order_relaxed);
+        cache_hits.fetch_add(cache.hits, std::memory_order_relaxed);
+        cache.allocations = cache.hits = 0;
+    }
+
+    // Takes half a cache's worth from the depot, carving a new slab if it is empty
+    static void refill(ThreadCache& cache, int size_class) {
+        Depot& depot = depots[size_class];
+        std::lock_guard<std::mutex> lock(depot.mutex);
+        if (!depot.free) carve_slab(depot, size_class);
+        for (size_t moved = 0; depot.free && moved < POOL_THREAD_CACHE / 2; ++moved) {
+            FreeBlock *block = depot.free;
+            depot.free = block->next;
+            block->next = cache.free[size_class];
+            cache.free[size_class] = block;
+            cache.count[size_class]++;
+        }
+        depot_refills.fetch_add(1, std::memory_order_relaxed);
+        report(cache); // Already on the slow path; keeps STATS current under light load
+    }
+
+    static void release(ThreadCache& cache, int size_class, size_t blocks) {
+        Depot& depot = depots[size_class];
+        std::lock_guard<std::mutex> lock(depot.mutex);
+        for (; blocks > 0 && cache.free[size_class]; --blocks) {
+            FreeBlock *block = cache.free[size_class];
+            cache.free[size_class] = block->next;
+            cache.count[size_class]--;
+            block->next = depot.free;
+            depot.free = block;
+        }
+    }
+
+    static void *depot_pop(int size_class) {
+        Depot& depot = depots[size_class];
+        std::lock_guard<std::mutex> lock(depot.mutex);
+        if (!depot.free) carve_slab(depot, size_class);
+        FreeBlock *block = depot.free;
+        depot.free = block->next;
+        return block;
+    }
+
+    // depot.mutex held
+    static void carve_slab(Depot& depot, int size_class) {
+        size_t block_size = (size_t)POOL_MIN_BLOCK << size_class;
+        char *slab = static_cast<char *>(PageHeap::allocate(POOL_SLAB_BYTES));
+        for (size_t offset = 0; offset + block_size <= POOL_SLAB_BYTES; offset += block_size) {
+            FreeBlock *block = reinterpret_cast<FreeBlock *>(slab + offset);
+            block->next = depot.free;
+            depot.free = block;
+        }
+        slabs.fetch_add(1, std::memory_order_relaxed);
+    }
+};
+
+// Standard allocator over BlockPool, for sessions, map nodes and payload strings
+template <typename T>
+struct PoolAllocator {
+    using value_type = T;
+    PoolAllocator() = default;
+    template <typename U>
+    PoolAllocator(const PoolAllocator<U>&) {}
+    T *allocate(size_t n) {
+        static_assert(alignof(T) <= alignof(std::max_align_t), "pooled blocks are max_align_t aligned");
+        return static_cast<T *>(BlockPool::allocate(n * sizeof(T)));
+    }
+    void deallocate(T *pointer, size_t n) { BlockPool::deallocate(pointer, n * sizeof(T)); }
+};
+template <typename T, typename U>
+bool operator==(const PoolAllocator<T>&, const PoolAllocator<U>&) { return true; }
+template <typename T, typename U>
+bool operator!=(const PoolAllocator<T>&, const PoolAllocator<U>&) { return false; }
+
+// Message payloads are pooled strings, shared by every queue they are fanned out to
+using PooledString = std::basic_string<char, std::char_traits<char>, PoolAllocator<char>>;
+using Payload = std::shared_ptr<const PooledString>;
+
+inline Payload make_payload(PooledString&& text) {
+    return std::allocate_shared<PooledString>(PoolAllocator<PooledString>(), std::move(text));
+}
+
+inline Payload make_payload(std::string_view text) {
+    return std::allocate_shared<PooledString>(PoolAllocator<PooledString>(), text.data(), text.size());
+}
+
+// Bump-pointer arena for per-batch scratch: frame views, destination lists and formatted
+// text that die with the batch. Nothing is freed individually; reset() rewinds to the
+// first block and keeps every block for the next batch, so a warm arena never allocates.
+class Arena {
+public:
+    explicit Arena(size_t block_bytes = ARENA_BLOCK_BYTES) : block_bytes(block_bytes) {}
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+    ~Arena() {
+        while (blocks) {
+            Block *next = blocks->next;
+            ::operator delete(blocks);
+            blocks = next;
+        }
+    }
+
+    void *allocate(size_t bytes, size_t align) {
+        size_t offset = (used + align - 1) & ~(align - 1);
+        if (!current || offset + bytes > current->size) {
+            next_block(bytes);
+            offset = 0;
+        }
+        used = offset + bytes;
+        return current->data() + offset;
+    }
+
+    std::string_view copy(std::string_view text) {
+        char *data = static_cast<char *>(allocate(text.size(), 1));
+        memcpy(data, text.data(), text.size());
+        return std::string_view(data, text.size());
+    }
+
+    void reset() {
+        current = nullptr;
+        used = 0;
+    }
+
+    size_t reserved_bytes() const { return reserved; }
+
+private:
+    struct Block {
+        Block *next;
+        size_t size;
+        char *data() { return reinterpret_cast<char *>(this + 1); } // max_align_t aligned
+    };
+
+    // Moves to the next kept block, inserting a new one if it is missing or too small
+    void next_block(size_t min_bytes) {
+        Block *next = current ? current->next : blocks;
+        if (!next || next->size < min_bytes) {
+            size_t size = std::max(block_bytes, min_bytes);
+            Block *fresh = static_cast<Block *>(::operator new(sizeof(Block) + size));
+            fresh->size = size;
+            fresh->next = next;
+            (current ? current->next : blocks) = fresh;
+            reserved += size;
+            next = fresh;
+        }
+        current = next;
+        used = 0;
+    }
+
+    size_t block_bytes;
+    Block *blocks = nullptr;  // Every block, in the order they are used
+    Block *current = nullptr; // Block being filled (null right after reset)
+    size_t used = 0;          // Bytes used in 'current'
+    size_t reserved = 0;
+};
+
+// Standard allocator over an Arena; deallocation is a no-op until the arena resets
+template <typename T>
+struct ArenaAllocator {
+    using value_type = T;
+    Arena *arena;
+    explicit ArenaAllocator(Arena& arena) : arena(&arena) {}
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other) : arena(other.arena) {}
+    T *allocate(size_t n) { return static_cast<T *>(arena->allocate(n * sizeof(T), alignof(T))); }
+    void deallocate(T *, size_t) {}
+};
+template <typename T, typename U>
+bool operator==(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) { return a.arena == b.arena; }
+template <typename T, typename U>
+bool operator!=(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) { return a.arena != b.arena; }
+
+template <typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+
+#endif
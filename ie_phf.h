@@ -0,0 +1,123 @@
+// Information Exchange campus directory: a minimal perfect hash from campus names to
+// their dense IDs, built once over a fixed name set. Header-only.
+#ifndef IE_PHF_H
+#define IE_PHF_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+
+// --- Configuration ---
+#define PHF_MAX_SEED_TRIES 1000000      // Displacement seeds tried per bucket before re-salting
+#define PHF_MAX_SALTS 16                // Rebuild attempts before giving up on the perfect hash
+
+// Dense campus ID, interned from the campus name (see intern_campus)
+typedef uint32_t CampusId;
+const CampusId NO_CAMPUS = UINT32_MAX;
+
+// Minimal perfect hash over a fixed set of names (hash-and-displace). Keys are spread
+// over buckets by one hash; each bucket stores the seed that places all of its keys in
+// distinct, free slots of a table exactly as large as the key set. A lookup is one
+// FNV-1a pass over the name, two mixes and one compare; there are no collisions to walk.
+class PerfectHash {
+public:
+    // 'names' must be distinct; ids[i] is returned for names[i]. False if no
+    // displacement was found within PHF_MAX_SALTS attempts.
+    bool build(const std::vector<std::string>& names, const std::vector<CampusId>& ids) {
+        size_t n = names.size();
+        std::vector<uint64_t> hashes(n);
+        for (size_t i = 0; i < n; ++i) hashes[i] = hash_name(names[i]);
+        size_t bucket_count = std::max<size_t>(1, (n + 1) / 2); // ~2 keys per bucket
+
+        for (uint32_t attempt_salt = 0; attempt_salt < PHF_MAX_SALTS; ++attempt_salt) {
+            std::vector<std::vector<size_t>> buckets(bucket_count);
+            for (size_t i = 0; i < n; ++i) buckets[mix(hashes[i], attempt_salt) % bucket_count].push_back(i);
+            std::vector<size_t> order(bucket_count);
+            for (size_t b = 0; b < bucket_count; ++b) order[b] = b;
+            // Placing the largest buckets first, while the table is emptiest, keeps searches short
+            std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return buckets[a].size() > buckets[b].size(); });
+
+            std::vector<uint32_t> attempt_seeds(bucket_count, 0);
+            std::vector<bool> taken(n, false);
+            std::vector<size_t> slots;
+            bool placed_all = true;
+            for (size_t b : order) {
+                if (buckets[b].empty()) break;
+                bool placed = false;
+                for (uint32_t seed = 1; seed <= PHF_MAX_SEED_TRIES && !placed; ++seed) {
+                    slots.clear();
+                    placed = true;
+                    for (size_t key : buckets[b]) {
+                        size_t slot = mix(hashes[key], slot_salt(attempt_salt, seed)) % n;
+                        if (taken[slot] || std::find(slots.begin(), slots.end(), slot) != slots.end()) {
+                            placed = false;
+                            break;
+                        }
+                        slots.push_back(slot);
+                    }
+                    if (placed) {
+                        attempt_seeds[b] = seed;
+                        for (size_t slot : slots) taken[slot] = true;
+                    }
+                }
+                if (!placed) {
+                    placed_all = false;
+                    break;
+                }
+            }
+            if (!placed_all) continue;
+
+            keys.assign(n, std::string());
+            values.assign(n, NO_CAMPUS);
+            for (size_t b = 0; b < bucket_count; ++b) {
+                for (size_t key : buckets[b]) {
+                    size_t slot = mix(hashes[key], slot_salt(attempt_salt, attempt_seeds[b])) % n;
+                    keys[slot] = names[key];
+                    values[slot] = ids[key];
+                }
+            }
+            seeds = std::move(attempt_seeds);
+            salt = attempt_salt;
+            return true;
+        }
+        return false;
+    }
+
+    CampusId find(std::string_view name) const {
+        if (keys.empty()) return NO_CAMPUS;
+        uint64_t hash = hash_name(name);
+        uint32_t seed = seeds[mix(hash, salt) % seeds.size()];
+        size_t slot = mix(hash, slot_salt(salt, seed)) % keys.size();
+        return keys[slot] == name ? values[slot] : NO_CAMPUS;
+    }
+
+    size_t size() const { return keys.size(); }
+    size_t bucket_count() const { return seeds.size(); }
+
+private:
+    static uint64_t hash_name(std::string_view name) {
+        uint64_t hash = 14695981039346656037ULL; // FNV-1a
+        for (unsigned char c : name) hash = (hash ^ c) * 1099511628211ULL;
+        return hash;
+    }
+    // Bucket selection uses seed 0; displacement seeds start at 1, so the two never coincide
+    static uint64_t slot_salt(uint32_t salt, uint32_t seed) { return ((uint64_t)seed << 32) | salt; }
+    static uint64_t mix(uint64_t hash, uint64_t seed) {
+        uint64_t x = hash ^ (seed * 0x9E3779B97F4A7C15ULL); // splitmix64/murmur3 finalizer
+        x ^= x >> 33;
+        x *= 0xff51afd7ed558ccdULL;
+        x ^= x >> 33;
+        x *= 0xc4ceb9fe1a85ec53ULL;
+        x ^= x >> 33;
+        return x;
+    }
+
+    std::vector<std::string> keys;  // By slot
+    std::vector<CampusId> values;   // By slot
+    std::vector<uint32_t> seeds;    // By bucket
+    uint32_t salt = 0;
+};
+
+#endif
@@ -0,0 +1,197 @@
+// Information Exchange timing: the lock-free token bucket that paces senders, and the
+// hierarchical timer wheel behind the I/O thread's timeouts. Header-only; shared by the
+// server and its tests.
+#ifndef IE_TIMING_H
+#define IE_TIMING_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+#include <functional>
+#include <algorithm>
+
+// --- Configuration ---
+#define TIMER_TICK_MS 100               // Resolution of the I/O thread's timer wheel
+#define TIMER_WHEEL_BITS 6              // 64 slots per wheel level
+#define TIMER_WHEEL_LEVELS 4            // 64^4 ticks of range (~19 days at 100ms ticks)
+
+// Lock-free token bucket. Balances are kept in millitokens so refills stay integral.
+// consume() may push the balance negative; the owner repays the debt by waiting,
+// which is how throttling turns into TCP backpressure instead of dropped messages.
+class TokenBucket {
+public:
+    // A new (or so far unlimited) bucket starts with its full burst. One that was already
+    // metering keeps its balance, debt included, settled at the old rate and capped at the
+    // new burst, so changing a limit never forgives a flooding sender.
+    void configure(double rate_per_sec, double burst) {
+        int64_t old_rate = rate_milli.load(std::memory_order_relaxed);
+        int64_t new_burst = (int64_t)(burst * 1000);
+        if (old_rate > 0) refill(old_rate);
+        burst_milli.store(new_burst, std::memory_order_relaxed);
+        if (old_rate > 0) {
+            int64_t current = balance.load(std::memory_order_relaxed);
+            while (current > new_burst && !balance.compare_exchange_weak(current, new_burst, std::memory_order_relaxed)) {}
+        } else {
+            balance.store(new_burst, std::memory_order_relaxed);
+            last_ns.store(now_ns(), std::memory_order_relaxed);
+        }
+        rate_milli.store((int64_t)(rate_per_sec * 1000), std::memory_order_relaxed);
+    }
+
+    void consume(double amount) {
+        if (rate_milli.load(std::memory_order_relaxed) <= 0) return; // Unlimited
+        balance.fetch_sub((int64_t)(amount * 1000), std::memory_order_relaxed);
+    }
+
+    // Time until the balance is back to zero (0 when tokens are available now)
+    std::chrono::nanoseconds time_until_ready() {
+        int64_t rate = rate_milli.load(std::memory_order_relaxed);
+        if (rate <= 0) return std::chrono::nanoseconds(0);
+        refill(rate);
+        int64_t current = balance.load(std::memory_order_relaxed);
+        if (current >= 0) return std::chrono::nanoseconds(0);
+        return std::chrono::nanoseconds((int64_t)(-(__int128)current * 1000000000LL / rate) + 1);
+    }
+
+    double rate() const { return rate_milli.load(std::memory_order_relaxed) / 1000.0; }
+
+private:
+    static int64_t now_ns() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    void refill(int64_t rate) {
+        int64_t now = now_ns();
+        int64_t last = last_ns.load(std::memory_order_relaxed);
+        // Whoever wins the CAS owns the elapsed interval, so no time is credited twice
+        if (now <= last || !last_ns.compare_exchange_strong(last, now, std::memory_order_relaxed)) return;
+
+        // 128-bit product: at file-transfer byte rates it overflows 64 bits within seconds
+        __int128 earned = (__int128)(now - last) * rate / 1000000000LL;
+        int64_t burst = burst_milli.load(std::memory_order_relaxed);
+        int64_t current = balance.load(std::memory_order_relaxed);
+        int64_t updated;
+        do {
+            updated = earned >= (__int128)burst - current ? burst : current + (int64_t)earned;
+        } while (!balance.compare_exchange_weak(current, updated, std::memory_order_relaxed));
+    }
+
+    std::atomic<int64_t> rate_milli{0};    // Millitokens earned per second (0 = unlimited)
+    std::atomic<int64_t> burst_milli{0};   // Balance ceiling
+    std::atomic<int64_t> balance{0};       // Current millitokens (negative = in debt)
+    std::atomic<int64_t> last_ns{0};       // Steady-clock time of the last refill
+};
+
+// Intrusive timer for the I/O thread's wheel; a node is armed while it sits in a slot list
+struct Timer {
+    Timer *prev = nullptr;
+    Timer *next = nullptr;
+    uint64_t expires = 0;           // Absolute wheel tick at which it fires
+    std::function<void()> callback;
+    bool armed() const { return prev != nullptr; }
+};
+
+// Hierarchical timing wheel with O(1) schedule and cancel. Level 0 holds timers due
+// within 64 ticks; each level above covers 64x the range of the one below and is
+// cascaded down one slot at a time as the lower level wraps. Only the I/O thread
+// touches it; it is advanced from the epoll loop, whose timeout never exceeds one tick.
+class TimerWheel {
+public:
+    TimerWheel() : slots(TIMER_WHEEL_LEVELS << TIMER_WHEEL_BITS),
+                   next_tick(std::chrono::steady_clock::now() + std::chrono::milliseconds(TIMER_TICK_MS)) {
+        for (Timer& head : slots) head.prev = head.next = &head;
+    }
+
+    void schedule(Timer& timer, int64_t delay_ms) {
+        cancel(timer);
+        timer.expires = current + std::max<int64_t>(1, (delay_ms + TIMER_TICK_MS - 1) / TIMER_TICK_MS);
+        place(timer);
+    }
+
+    void cancel(Timer& timer) {
+        if (!timer.armed()) return;
+        timer.prev->next = timer.next;
+        timer.next->prev = timer.prev;
+        timer.prev = timer.next = nullptr;
+    }
+
+    // Runs every tick that has elapsed up to 'now', firing due timers
+    void advance(std::chrono::steady_clock::time_point now) {
+        while (next_tick <= now) {
+            current++;
+            next_tick += std::chrono::milliseconds(TIMER_TICK_MS);
+
+            // Each time a level wraps, pull the next slot of the level above down into range
+            for (int level = 1; level < TIMER_WHEEL_LEVELS; ++level) {
+                if (current & ((1ULL << (TIMER_WHEEL_BITS * level)) - 1)) break;
+                Timer pending;
+                detach(slot(level, (current >> (TIMER_WHEEL_BITS * level)) & MASK), pending);
+                while (pending.next != &pending) {
+                    Timer& timer = *pending.next;
+                    cancel(timer);
+                    place(timer);
+                }
+            }
+
+            // Detach the due slot first: callbacks may reschedule themselves
+            Timer due;
+            detach(slot(0, current & MASK), due);
+            while (due.next != &due) {
+                Timer& timer = *due.next;
+                cancel(timer);
+                timer.callback();
+            }
+        }
+    }
+
+    int ms_until_next_tick(std::chrono::steady_clock::time_point now) const {
+        auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(next_tick - now).count();
+        return wait < 0 ? 0 : (int)wait + 1;
+    }
+
+private:
+    static const uint64_t MASK = (1ULL << TIMER_WHEEL_BITS) - 1;
+
+    Timer& slot(int level, uint64_t index) { return slots[(level << TIMER_WHEEL_BITS) + index]; }
+
+    // Files the timer on the lowest level whose range covers its remaining delay
+    void place(Timer& timer) {
+        uint64_t delta = timer.expires > current ? timer.expires - current : 0;
+        for (int level = 0; level < TIMER_WHEEL_LEVELS; ++level) {
+            if (delta < (1ULL << (TIMER_WHEEL_BITS * (level + 1)))) {
+                link(slot(level, (timer.expires >> (TIMER_WHEEL_BITS * level)) & MASK), timer);
+                return;
+            }
+        }
+        // Beyond the wheel's range: park in the farthest slot and re-cascade from there
+        timer.expires = current + (1ULL << (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS)) - 1;
+        link(slot(TIMER_WHEEL_LEVELS - 1, (timer.expires >> (TIMER_WHEEL_BITS * (TIMER_WHEEL_LEVELS - 1))) & MASK), timer);
+    }
+
+    static void link(Timer& head, Timer& timer) {
+        timer.prev = head.prev;
+        timer.next = &head;
+        head.prev->next = &timer;
+        head.prev = &timer;
+    }
+
+    // Moves a slot's whole list onto a local sentinel in O(1)
+    static void detach(Timer& head, Timer& into) {
+        if (head.next == &head) {
+            into.next = into.prev = &into;
+            return;
+        }
+        into.next = head.next;
+        into.prev = head.prev;
+        into.next->prev = into.prev->next = &into;
+        head.next = head.prev = &head;
+    }
+
+    std::vector<Timer> slots;       // Sentinel heads of circular lists, level-major
+    uint64_t current = 0;           // Ticks elapsed since the wheel started
+    std::chrono::steady_clock::time_point next_tick;
+};
+
+#endif
@@ -1,49 +1,400 @@
 #include <iostream>
 #include <vector>
+#include <array>
 #include <map>
 #include <string>
 #include <sstream>
+#include <fstream>
 #include <thread>
 #include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <chrono>
+#include <algorithm>
+#include <atomic>
+#include <functional>
 #include <cstring>
+#include <cstddef>
+#include <optional>
+#include <shared_mutex>
+#include <charconv>
+#include <string_view>
 #include <cstdlib>
+#include <csignal>
 #include <unistd.h>
+#include <fcntl.h>
 #include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/uio.h>
+#include <sys/random.h>
+#include <sys/resource.h>
+#include <poll.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
+#include <netinet/udp.h>
+#include <linux/errqueue.h>
+#include "ie_memory.h"
+#include "ie_phf.h"
+#include "ie_frames.h"
+#include "ie_timing.h"
 
 // --- Configuration ---
 #define TCP_PORT 5000       // Server TCP Listening Port
 #define BUFFER_SIZE 1024
 #define SERVER_BROADCAST_IP "127.0.0.1" // Server sends UDP from this IP
+#define BROADCAST_RATE_PER_DEST 200     // Default datagrams/sec paced to each destination
+#define BROADCAST_BURST 16              // Datagrams a destination may receive back-to-back
+#define GSO_MAX_SEGMENTS 64             // Kernel limit on segments per UDP_SEGMENT send
+#define GSO_MAX_PAYLOAD 65000           // Keep a GSO super-datagram under the 64KB UDP limit
+#define BROADCAST_COALESCE_MS 2         // Window for packing bursts into one datagram (0 = off)
+#define BROADCAST_MTU 1400              // Largest coalesced datagram; records are '\n'-separated
+#define LIMIT_MSGS_PER_SEC 500          // Default per-campus routed messages/sec (0 = unlimited)
+#define LIMIT_BYTES_PER_SEC 262144      // Default per-campus routed bytes/sec (0 = unlimited)
+#define LIMIT_BROADCAST_SENDS_PER_SEC 5000 // Default per-campus broadcast fan-out sends/sec
+#define THROTTLE_MAX_WAIT_MS 1000       // Longest single pause before re-checking the buckets
+#define OUTBOUND_QUEUE_MAX_BYTES 262144 // Per-destination cap on queued outbound bytes
+#define OUTBOUND_GLOBAL_MAX_BYTES 67108864 // Cap on queued outbound bytes across all destinations
+#define OUTBOUND_IOV_MAX 64             // Queued messages written per sendmsg
+#define SPILL_DIR "/tmp"                // Where the 'spill' policy parks overflow (unlinked files)
+#define REGISTRATION_TIMEOUT_MS 10000   // Connections must register within this long
+#define MAX_PENDING_REGISTRATIONS 256   // Unregistered sockets admitted at once; more are refused
+#define LISTEN_BACKLOG SOMAXCONN        // Accept queue depth for reconnect storms
+#define IDLE_TIMEOUT_MS 120000          // Sessions silent this long are reaped (heartbeats count)
+#define MESSAGE_TTL_MS 60000            // Queued messages not delivered within this long expire
+#define RESUME_GRACE_MS 30000           // A dropped resumable session waits this long for its client
+#define RESUME_RETAIN_BYTES 262144      // Sent-but-unacknowledged bytes kept for replay on resume
+#define HEARTBEAT_INTERVAL_MS 15000     // Sessions silent this long get a HEARTBEAT frame
+#define TCP_KEEPALIVE_IDLE_SEC 30       // Kernel keepalive probing starts after this much silence
+#define TCP_KEEPALIVE_INTERVAL_SEC 10   // Seconds between keepalive probes
+#define TCP_KEEPALIVE_COUNT 3           // Unanswered probes before the kernel drops the peer
+#define TCP_USER_TIMEOUT_MS 45000       // Max time written data may stay unacknowledged
+#define RECV_BATCH_BYTES 65536          // Handler read size; the frames of one read form a batch
+#define MAX_FRAME_BYTES 1048576         // Longest a frame may grow without its '\n'; the session is ended past it
+#define CLOSE_FLUSH_MS 1000             // Longest a session the server ends waits for its last reply to be written
+#define MAX_CAMPUSES 4096               // Capacity of the campus ID space (unused IDs are reclaimed)
+#define MAX_GATEWAY_IDENTITIES 1024     // Campuses one gateway connection may ATTACH
+#define MAX_PENDING_PROBES 64           // Forwarded PINGs a campus may owe a PONG for (older ones are forgotten)
+#define FILE_CHUNK_MAX 65536            // Largest FILE chunk relayed (raw bytes after its header line)
+#define SPLICE_MIN_BYTES 16384          // Chunk bodies with this much still unread are spliced, not copied (0 = never)
+#define SPLICE_PIPE_BYTES 131072        // Capacity asked for each relay pipe (a chunk can arrive in small fragments)
+#define SPLICE_PIPES_MAX 64             // Relay pipes open at once; chunks are copied while none is free
+#define SPLICE_HEADER_READ 512          // Read size after a chunk, so a following header comes without its body
+#define ZEROCOPY_MIN_BYTES 32768        // Payloads this large are sent with MSG_ZEROCOPY (0 = never; see ZEROCOPY:)
+#define ZEROCOPY_LINGER_MS 5000         // Longest an ended session's socket stays open for its zero-copy completions
 
 // --- Global Structures & Synchronization ---
+
+// A handler's RECV_BATCH_BYTES receive buffer. Buffers come from PageHeap and go back
+// on a free list when the handler exits, for the next session to reuse.
+class RecvBuffer {
+public:
+    RecvBuffer() {
+        std::lock_guard<std::mutex> lock(free_mutex);
+        if (free_buffers.empty()) {
+            data = static_cast<char *>(PageHeap::allocate(RECV_BATCH_BYTES));
+        } else {
+            data = free_buffers.back();
+            free_buffers.pop_back();
+        }
+    }
+    ~RecvBuffer() {
+        std::lock_guard<std::mutex> lock(free_mutex);
+        free_buffers.push_back(data);
+    }
+    RecvBuffer(const RecvBuffer&) = delete;
+    RecvBuffer& operator=(const RecvBuffer&) = delete;
+
+    char *data;
+
+private:
+    static inline std::mutex free_mutex;
+    static inline std::vector<char *> free_buffers;
+};
+
+// What to do when a destination's outbound queue (or the global cap) is full
+enum BackpressurePolicy {
+    POLICY_BLOCK,           // Sender's handler waits for room (TCP pushes back on the sender)
+    POLICY_DROP_OLDEST,     // Evict the oldest unsent messages to make room
+    POLICY_DROP_NEWEST,     // Discard the message being queued
+    POLICY_DISCONNECT,      // Drop the slow consumer's connection
+    POLICY_SPILL            // Append overflow to a disk file, replayed as the queue drains
+};
+
+// Per-campus rate limits (0 = unlimited); burst allowance is one second's worth
+struct RateLimits {
+    double msgs_per_sec;
+    double bytes_per_sec;
+    double broadcast_sends_per_sec;
+};
+
+// A FILE chunk body waiting in a pipe. The handler splices it there from the sender's
+// socket and the I/O thread splices it on to the destination's, so the bytes never pass
+// through user space. Pipes are pooled (see acquire_relay_pipe).
+struct SplicedBody {
+    int pipe_fds[2] = {-1, -1};
+    size_t capacity = 0;        // Bytes the pipe holds, as granted by the kernel
+    size_t length = 0;          // Bytes of the body
+    size_t unsent = 0;          // Bytes still in the pipe
+    ~SplicedBody();             // Returns a drained pipe to the pool, closes any other
+};
+
+// One queued outbound frame; the payload may be shared by several queues
+struct OutboundMessage {
+    Payload payload;
+    std::chrono::steady_clock::time_point queued_at;
+    uint64_t seq;               // Resume sequence number, sent as "#<seq> " (0 = unsequenced)
+    std::shared_ptr<SplicedBody> body = nullptr; // Raw bytes written after the payload (unsequenced only)
+
+    size_t size() const { return payload->size() + (body ? body->length : 0); }
+};
+
+// A payload written with MSG_ZEROCOPY: the kernel reads it from our pages until the
+// completion for send call 'id' arrives on the socket's error queue
+struct ZeroCopySend {
+    uint32_t id;
+    Payload payload;
+    bool done;
+};
+
 struct ClientInfo {
     int tcp_socket;             // TCP socket file descriptor for sending/receiving
     std::string campus_name;    // Unique campus identifier (e.g., "Lahore")
+    CampusId campus_id = NO_CAMPUS; // Interned campus_name, held for the session; indexes the per-campus arrays
+    uint64_t generation = 0;    // Registration number; a re-registration gets a newer one
     struct sockaddr_in udp_addr; // UDP address for sending broadcasts to this client
+    TokenBucket msg_bucket;     // Routed messages/sec
+    TokenBucket byte_bucket;    // Routed bytes/sec
+    TokenBucket broadcast_bucket; // Broadcast fan-out sends/sec (one BROADCAST costs N)
+    bool throttled = false;     // Handler is in a throttling episode (logged once)
+
+    // Outbound queue, flushed by the I/O thread (which alone closes tcp_socket)
+    std::mutex out_mutex;       // Protects everything below
+    std::condition_variable out_cv; // Signals blocked senders that room was made
+    std::deque<OutboundMessage> outbound;
+    size_t queued_bytes = 0;    // Bytes in 'outbound' not yet written
+    size_t send_offset = 0;     // Bytes of outbound.front() already written
+    BackpressurePolicy policy = POLICY_BLOCK;
+    int spill_fd = -1;          // Unlinked overflow file (POLICY_SPILL)
+    off_t spill_read = 0, spill_write = 0;
+    uint64_t dropped = 0;       // Messages discarded by the drop policies
+    uint64_t expired = 0;       // Messages discarded after MESSAGE_TTL_MS in the queue
+    bool disconnecting = false; // Socket shut down; waiting for the handler to unregister
+    std::string end_reason;     // Why it was disconnected (eviction, takeover)
+    bool closed = false;        // Session ended; the I/O thread will close the socket
+    CampusId gateway = NO_CAMPUS; // Gateway identity: no socket of its own, traffic goes via this campus
+
+    // Resumable sessions (registered with ":RESUME"); also protected by out_mutex
+    bool resumable = false;
+    std::string session_token;  // Presented by the client to resume
+    uint64_t next_seq = 1;      // Sequence number for the next sequenced frame
+    std::deque<OutboundMessage> unacked; // Written but not yet acknowledged, for replay
+    size_t unacked_bytes = 0;
+    bool detach_pending = false; // Connection failed; the handler will detach rather than end
+    bool detached = false;      // Connection gone, queue kept for RESUME_GRACE_MS
+
+    // MSG_ZEROCOPY sends (see flush_outbound); also protected by out_mutex
+    bool zerocopy = false;      // SO_ZEROCOPY is set and no completion has reported a copy
+    uint32_t zerocopy_next = 0; // Number the kernel gives the next MSG_ZEROCOPY send call
+    std::deque<ZeroCopySend> zerocopy_inflight; // Payloads the kernel may still read, oldest first
+    int linger_socket = -1;     // Socket of an ended session, open until those complete (I/O thread)
+    int64_t linger_deadline_ms = 0; // ...or until this steady-clock time, when it is closed abortively
+
+    // PINGs forwarded to this campus and not answered yet: the prober and the forwarding
+    // stamp; only a PONG matching one is passed on (also protected by out_mutex)
+    std::deque<std::pair<CampusId, int64_t>> pending_probes;
+
+    std::atomic<int64_t> last_recv_ms{0}; // Steady-clock ms of the last frame read (handler writes)
+    int64_t batch_recv_us = 0;  // Steady-clock us when the frames being routed were read (handler only)
+
+    // I/O thread only
+    Timer heartbeat_timer;
+    Timer idle_timer;
+    Timer expiry_timer;         // Armed for the front message's TTL while the queue is non-empty
+    Timer grace_timer;          // Armed while detached
+    uint32_t io_events = 0;     // Events the socket is registered with epoll for, while watched
+
+    ~ClientInfo();              // Releases campus_id
+};
+
+// A connection that has not registered yet. It is owned by the I/O thread, which reads
+// it without blocking until the registration line arrives or its deadline fires; only
+// then does it get a handler thread.
+struct PendingRegistration {
+    int socket;
+    struct sockaddr_in addr;
+    std::string received;       // Bytes read so far (registration line plus anything after)
+    Timer deadline;
+};
+
+// A FILE chunk whose raw bytes are still arriving after its header line. They are
+// moved into the forwarded payload as they come in and never scanned as frames, or, for
+// a large body, spliced into a relay pipe without being read at all.
+struct ChunkRelay {
+    std::shared_ptr<ClientInfo> dest;   // Null while discarding a chunk nobody can take
+    PooledString payload;               // Forwarded header, then the bytes received so far
+    std::shared_ptr<SplicedBody> body;  // Set when the body is spliced; payload is then the header
+    size_t remaining = 0;               // Raw bytes still to come
+    bool chunk_ended = false;           // A chunk just ended: read only about a header, in case another follows
 };
 
-// Map to store active clients: Key = Campus Name, Value = ClientInfo
-std::map<std::string, ClientInfo> active_clients;
-std::mutex clients_mutex;       // Mutex to protect access to active_clients map
+// Relay pipes for spliced chunk bodies: drained pipes are kept for reuse
+struct RelayPipe {
+    int fds[2];
+    size_t capacity;
+};
+std::vector<RelayPipe> relay_pipes_free;
+size_t relay_pipes_open = 0;                // Pooled plus in use, at most SPLICE_PIPES_MAX
+std::mutex relay_pipes_mutex;               // Protects relay_pipes_free and relay_pipes_open
+std::atomic<uint64_t> spliced_chunk_bytes{0};   // Chunk bytes moved from a socket to a relay pipe unread
+std::atomic<uint64_t> splice_fallbacks{0};      // Chunks copied after all: pipe full, or too small for them
+
+// Campus IDs: each name is interned (at registration, or when configuration names it)
+// into a dense ID. Per-campus state lives in flat arrays indexed by ID, and clients may
+// address a destination as "#<id>" after a RESOLVE. An ID that nothing holds or
+// configures any more is reclaimed once fresh IDs run out (see reclaim_campus_ids).
+struct CampusEntry {
+    std::string name;
+    std::string from_prefix;    // "FROM <name>: ", the header of every message it sends
+    std::atomic<uint32_t> holders{0};    // Sessions, identities and callers using the ID
+    std::atomic<uint32_t> generation{0}; // Times the ID was reclaimed; part of its "#<id>"
+};
+CampusEntry campus_table[MAX_CAMPUSES];     // An entry only changes while its ID is unheld
+std::atomic<uint32_t> campus_count{0};      // IDs handed out so far (the high-water mark)
+std::map<std::string, CampusId, std::less<>> campus_ids; // Name -> ID (every interned name)
+std::vector<CampusId> free_campus_ids;      // Reclaimed IDs, reissued before fresh ones
+std::atomic<uint64_t> reclaimed_campus_ids{0}; // IDs reclaimed so far
+PerfectHash campus_directory;               // Known campuses from the directory file; fixed after startup
+std::shared_mutex campus_mutex;             // Protects campus_ids and free_campus_ids (leaf lock)
+
+// Per-campus routing counters, kept across sessions
+struct CampusCounters {
+    std::atomic<uint64_t> sent{0};      // Messages routed from this campus
+    std::atomic<uint64_t> received{0};  // Messages queued for this campus
+    std::atomic<uint64_t> failed{0};    // Sends to unknown or inactive campuses
+    std::atomic<uint64_t> file_bytes{0}; // FILE chunk bytes relayed from this campus
+};
+CampusCounters campus_counters[MAX_CAMPUSES];
+
+// Active clients: Index = CampusId, Value = ClientInfo (null when not registered)
+// Entries are shared so a handler thread can keep using its session without the lock.
+std::shared_ptr<ClientInfo> active_clients[MAX_CAMPUSES];
+size_t active_count = 0;        // Non-null entries in active_clients
+std::mutex clients_mutex;       // Mutex to protect access to active_clients
+std::atomic<uint64_t> session_generation{0}; // Source of ClientInfo::generation
+std::vector<CampusId> gateway_identities[MAX_CAMPUSES]; // By gateway: the identities it attached (clients_mutex)
 int udp_broadcast_socket;       // Single UDP socket for all broadcast sending
 
+// Per-destination pacing state for the broadcast sender thread
+struct BroadcastDest {
+    struct sockaddr_in udp_addr;                              // Where this campus receives UDP
+    std::deque<Payload> pending;                              // Datagrams waiting for tokens
+    double tokens;                                            // Datagrams allowed right now
+    std::chrono::steady_clock::time_point last_refill;
+    std::chrono::steady_clock::time_point flush_at;           // End of the current coalescing window
+};
+
+// Map of paced destinations: Key = CampusId, Value = BroadcastDest
+std::map<CampusId, BroadcastDest> broadcast_dests;
+int broadcast_rate_overrides[MAX_CAMPUSES]; // Per-campus datagrams/sec, by ID (0 = default)
+std::mutex broadcast_mutex;                 // Protects broadcast_dests and the rate settings
+std::condition_variable broadcast_cv;       // Wakes the sender when datagrams are queued
+int broadcast_rate = BROADCAST_RATE_PER_DEST;
+int broadcast_coalesce_ms = BROADCAST_COALESCE_MS;
+bool udp_gso_supported = false;             // Kernel accepts UDP_SEGMENT on our socket
+
+// Rate-limit configuration: per-campus overrides on top of the defaults
+RateLimits default_limits = {LIMIT_MSGS_PER_SEC, LIMIT_BYTES_PER_SEC, LIMIT_BROADCAST_SENDS_PER_SEC};
+std::optional<RateLimits> limit_overrides[MAX_CAMPUSES]; // By CampusId
+std::mutex limits_mutex;                    // Protects default_limits and limit_overrides
+
+// Outbound I/O thread state
+BackpressurePolicy default_policy = POLICY_BLOCK;
+std::optional<BackpressurePolicy> policy_overrides[MAX_CAMPUSES]; // By CampusId; protected by limits_mutex
+std::atomic<size_t> outbound_total_bytes{0};  // Queued bytes across every destination
+int io_epoll_fd = -1;                         // Sockets waiting for EPOLLOUT
+int io_wake_fd = -1;                          // eventfd that wakes the I/O thread
+std::vector<std::shared_ptr<ClientInfo>> io_ready; // Sessions with new work for the I/O thread
+std::vector<std::shared_ptr<PendingRegistration>> io_accepted; // New connections awaiting registration
+std::mutex io_mutex;                          // Protects io_ready and io_accepted
+std::atomic<size_t> zerocopy_min_bytes{ZEROCOPY_MIN_BYTES}; // 0 disables MSG_ZEROCOPY
+std::atomic<uint64_t> zerocopy_sends{0};      // sendmsg calls made with MSG_ZEROCOPY
+std::atomic<uint64_t> zerocopy_bytes{0};      // Bytes those calls wrote
+std::atomic<uint64_t> zerocopy_hits{0};       // Completed without the kernel copying
+std::atomic<uint64_t> zerocopy_copied{0};     // Completed, but the kernel copied after all
+std::atomic<uint64_t> zerocopy_refused{0};    // Refused (ENOBUFS) and written with a copy instead
+std::atomic<uint64_t> zerocopy_aborted{0};    // Still uncompleted when their ended session's socket was reset
+std::atomic<int> pending_registrations{0};    // Accepted sockets not yet registered
+std::atomic<uint64_t> refused_connections{0}; // Turned away by admission control
+
 // --- Function Prototypes ---
-void handle_client(int client_sock, struct sockaddr_in client_addr);
+void handle_client(int client_sock, struct sockaddr_in client_addr, std::string received);
 void handle_server_input();
-void send_udp_broadcast(const std::string& message);
-void route_tcp_message(const std::string& sender_name, const std::string& full_message);
+bool valid_campus_name(std::string_view name);
+CampusId intern_campus(std::string_view name);
+void release_campus(CampusId id);
+size_t reclaim_campus_ids();
+CampusId find_campus(std::string_view name);
+bool load_campus_directory(const char *path);
+int send_udp_broadcast(Payload payload, Arena& scratch);
+void broadcast_sender_loop();
+void set_broadcast_rate(const std::string& campus, int rate);
+void set_broadcast_coalesce(int window_ms);
+void route_tcp_message(const std::shared_ptr<ClientInfo>& sender, std::string_view full_message, size_t colon_pos, Arena& scratch);
+bool enqueue_outbound(const std::shared_ptr<ClientInfo>& dest, Payload payload, bool sequenced = true,
+                      std::shared_ptr<SplicedBody> body = nullptr);
+void close_session(const std::shared_ptr<ClientInfo>& client);
+void evict_session(const std::shared_ptr<ClientInfo>& client, const std::string& reason, bool allow_resume = false);
+uint64_t take_over_session(const std::shared_ptr<ClientInfo>& old_session, const std::shared_ptr<ClientInfo>& new_session,
+                           bool resume, uint64_t last_seq);
+void outbound_io_loop();
+void admit_connection(int client_sock, struct sockaddr_in client_addr);
+void set_backpressure_policy(const std::string& campus, BackpressurePolicy policy);
+void print_stats();
+void apply_rate_limits(ClientInfo& client);
+void set_rate_limits(const std::string& campus, const RateLimits& limits);
+void attach_identity(const std::shared_ptr<ClientInfo>& gateway, std::string_view name);
+std::shared_ptr<ClientInfo> find_identity(const ClientInfo& gateway, std::string_view name);
+void detach_identity(const std::shared_ptr<ClientInfo>& identity);
+void release_identities(CampusId gateway);
+bool begin_chunk_relay(const std::shared_ptr<ClientInfo>& sender, std::string_view header, size_t buffered, ChunkRelay& relay);
+bool relay_chunk_bytes(ChunkRelay& relay, std::string& pending, ClientInfo& client, int sock);
+ssize_t recv_waiting(ClientInfo& client, int sock, char *buffer, size_t length);
+bool wait_readable(ClientInfo& client, int sock);
+void reap_zerocopy_completions(ClientInfo& client);
+
+// Steady-clock milliseconds, for timestamps kept in atomics
+static int64_t steady_ms() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static int64_t steady_us() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
 
 // ====================================================================
 //                             MAIN SERVER LOGIC
 // ====================================================================
 
-int main() {
+int main(int argc, char *argv[]) {
     int listen_sock;
     struct sockaddr_in server_addr, client_addr;
     socklen_t addr_len = sizeof(struct sockaddr_in);
 
+    // splice() into a socket cannot be told MSG_NOSIGNAL; a vanished peer shows up as EPIPE
+    signal(SIGPIPE, SIG_IGN);
+
+    // Optional campus directory: ./server [<campus directory file>]
+    if (argc > 2) {
+        std::cerr << "Usage: " << argv[0] << " [<campus directory file>]" << std::endl;
+        return EXIT_FAILURE;
+    }
+    if (argc == 2 && !load_campus_directory(argv[1])) return EXIT_FAILURE;
+
     // 1. Setup TCP Listener Socket
     if ((listen_sock = socket(AF_INET, SOCK_STREAM, 0)) == 0) {
         perror("TCP socket creation failed");
@@ -64,7 +415,7 @@ int main() {
         exit(EXIT_FAILURE);
     }
     
-    if (listen(listen_sock, 5) < 0) {
+    if (listen(listen_sock, LISTEN_BACKLOG) < 0) {
         perror("TCP listen failed");
         close(listen_sock);
         exit(EXIT_FAILURE);
@@ -77,14 +428,40 @@ int main() {
         exit(EXIT_FAILURE);
     }
 
+    // Probe for UDP GSO support (Linux 4.18+); a zero segment size leaves sends untouched
+    int gso_size = 0;
+    udp_gso_supported = setsockopt(udp_broadcast_socket, SOL_UDP, UDP_SEGMENT, &gso_size, sizeof(gso_size)) == 0;
+
     std::cout << "🌐 NU-Information Exchange Server started." << std::endl;
     std::cout << "TCP listening on port " << TCP_PORT << " for client connections..." << std::endl;
+    std::cout << "UDP broadcasts paced at " << broadcast_rate << " datagrams/sec per destination (GSO "
+              << (udp_gso_supported ? "enabled" : "unavailable") << ", " << broadcast_coalesce_ms
+              << " ms coalescing window)." << std::endl;
+    select_frame_scanner();
     
     // 3. Start Server Input Thread for Broadcasts
     std::thread input_thread(handle_server_input);
     input_thread.detach(); // Allow the thread to run independently
 
-    // 4. Main TCP Accept Loop
+    // 4. Start the paced UDP broadcast sender
+    std::thread sender_thread(broadcast_sender_loop);
+    sender_thread.detach();
+
+    // 5. Start the outbound I/O thread that flushes per-destination queues
+    io_epoll_fd = epoll_create1(0);
+    io_wake_fd = eventfd(0, EFD_NONBLOCK);
+    if (io_epoll_fd < 0 || io_wake_fd < 0) {
+        perror("Outbound I/O setup failed");
+        exit(EXIT_FAILURE);
+    }
+    struct epoll_event wake_event = {};
+    wake_event.events = EPOLLIN;
+    wake_event.data.fd = io_wake_fd;
+    epoll_ctl(io_epoll_fd, EPOLL_CTL_ADD, io_wake_fd, &wake_event);
+    std::thread io_thread(outbound_io_loop);
+    io_thread.detach();
+
+    // 6. Main TCP Accept Loop
     while (true) {
         int client_sock = accept(listen_sock, (struct sockaddr *)&client_addr, &addr_len);
         if (client_sock < 0) {
@@ -92,13 +469,33 @@ int main() {
             continue;
         }
 
+        // Let the kernel detect half-open peers: keepalive probes while idle, and a
+        // bound on how long written data may go unacknowledged (e.g. a pulled cable)
+        int keepalive = 1, idle = TCP_KEEPALIVE_IDLE_SEC, interval = TCP_KEEPALIVE_INTERVAL_SEC;
+        int count = TCP_KEEPALIVE_COUNT, user_timeout = TCP_USER_TIMEOUT_MS;
+        setsockopt(client_sock, SOL_SOCKET, SO_KEEPALIVE, &keepalive, sizeof(keepalive));
+        setsockopt(client_sock, IPPROTO_TCP, TCP_KEEPIDLE, &idle, sizeof(idle));
+        setsockopt(client_sock, IPPROTO_TCP, TCP_KEEPINTVL, &interval, sizeof(interval));
+        setsockopt(client_sock, IPPROTO_TCP, TCP_KEEPCNT, &count, sizeof(count));
+        setsockopt(client_sock, IPPROTO_TCP, TCP_USER_TIMEOUT, &user_timeout, sizeof(user_timeout));
+
+        // Admission control: cap unregistered sockets so a storm of idle or half-open
+        // connections cannot exhaust descriptors before real campuses register
+        if (pending_registrations.load() >= MAX_PENDING_REGISTRATIONS) {
+            refused_connections++;
+            std::cerr << "[ADMISSION] Refusing connection from " << inet_ntoa(client_addr.sin_addr)
+                      << " (" << MAX_PENDING_REGISTRATIONS << " registrations pending)." << std::endl;
+            close(client_sock);
+            continue;
+        }
+
         std::cout << "\n[INFO] New TCP connection accepted from " 
                   << inet_ntoa(client_addr.sin_addr) << ":" << ntohs(client_addr.sin_port) 
                   << std::endl;
 
-        // Spawn a new thread to handle the client's communication
-        std::thread client_thread(handle_client, client_sock, client_addr);
-        client_thread.detach(); // Detach the thread to run independently
+        // The I/O thread waits for the registration line; the client's handler
+        // thread is only spawned once it has arrived
+        admit_connection(client_sock, client_addr);
     }
 
     // Cleanup (This part is typically unreachable in an infinite loop server)
@@ -111,24 +508,89 @@ int main() {
 //                        CLIENT HANDLER THREAD
 // ====================================================================
 
-void handle_client(int client_sock, struct sockaddr_in client_addr) {
-    char buffer[BUFFER_SIZE];
+// Blocks the handler (and therefore stops reading the socket) while the sender is in debt.
+// The unread bytes fill the kernel buffers and TCP flow control pushes back on the client.
+static void wait_for_tokens(ClientInfo& client) {
+    auto wait = std::chrono::nanoseconds(0);
+    while ((wait = std::max({client.msg_bucket.time_until_ready(),
+                             client.byte_bucket.time_until_ready(),
+                             client.broadcast_bucket.time_until_ready()})).count() > 0) {
+        if (!client.throttled) {
+            std::cout << "[THROTTLE] Pausing reads from '" << client.campus_name << "' (rate limit reached)." << std::endl;
+            client.throttled = true;
+        }
+        std::this_thread::sleep_for(std::min<std::chrono::nanoseconds>(wait, std::chrono::milliseconds(THROTTLE_MAX_WAIT_MS)));
+    }
+}
+
+// Waits for 'sock' (the client's socket) to have input; false if poll() fails.
+// MSG_ZEROCOPY completions queued on the socket also wake poll() (POLLERR, which
+// cannot be masked); they are collected here so the wait does not turn into a spin.
+bool wait_readable(ClientInfo& client, int sock) {
+    struct pollfd input = {sock, POLLIN, 0};
+    if (poll(&input, 1, -1) < 0) return errno == EINTR;
+    if ((input.revents & (POLLIN | POLLHUP | POLLERR)) == POLLERR) {
+        std::lock_guard<std::mutex> lock(client.out_mutex);
+        reap_zerocopy_completions(client);
+    }
+    return true;
+}
+
+// Client sockets stay non-blocking, so the I/O thread can splice into them without
+// stalling; the handler thread waits for input here instead
+ssize_t recv_waiting(ClientInfo& client, int sock, char *buffer, size_t length) {
+    while (true) {
+        ssize_t received = recv(sock, buffer, length, 0);
+        if (received >= 0) return received;
+        if (errno == EINTR) continue;
+        if (errno != EAGAIN && errno != EWOULDBLOCK) return -1;
+        if (!wait_readable(client, sock)) return -1;
+    }
+}
+
+// 'received' holds what the I/O thread read before handing the socket over; it
+// starts with the registration line.
+void handle_client(int client_sock, struct sockaddr_in client_addr, std::string received) {
+    RecvBuffer buffer;
+    std::string pending = std::move(received); // Bytes received but not yet forming a complete frame
+    std::string frame;
     std::string campus_name;
-    bool is_registered = false;
+    Arena scratch;
+    std::shared_ptr<ClientInfo> client;
     int udp_port = -1;
+    int bytes_received = 0;
+    bool quit = false;
     
-    // 1. Initial Registration (Expecting: <CAMPUS_NAME>:<UDP_PORT>)
-    int bytes_received = recv(client_sock, buffer, BUFFER_SIZE - 1, 0);
-    if (bytes_received > 0) {
-        buffer[bytes_received] = '\0';
-        std::string initial_msg(buffer);
-        size_t colon_pos = initial_msg.find(':');
+    // 1. Initial Registration (Expecting: <CAMPUS_NAME>:<UDP_PORT>\n)
+    // Resumable sessions register as <CAMPUS_NAME>:<UDP_PORT>:RESUME, and reconnect with
+    // <CAMPUS_NAME>:<UDP_PORT>:RESUME:<TOKEN>:<LAST_SEQ> (the last sequence number received)
+    {
+        ArenaVector<FrameSpan> spans{ArenaAllocator<char>(scratch)};
+        size_t consumed = scan_frames(pending.data(), pending.size(), spans);
+        if (!spans.empty() && spans[0].valid_utf8) frame.assign(pending, spans[0].offset, spans[0].length);
+        pending.erase(0, spans.size() > 1 ? spans[1].offset : consumed);
+    }
+    scratch.reset();
+    if (!frame.empty()) {
+        std::vector<std::string> fields;
+        std::stringstream fields_stream(frame);
+        std::string field;
+        while (std::getline(fields_stream, field, ':')) fields.push_back(field);
         
-        if (colon_pos != std::string::npos) {
-            campus_name = initial_msg.substr(0, colon_pos);
+        if (fields.size() >= 2 && !valid_campus_name(fields[0])) {
+            std::cerr << "[ERROR] Invalid campus name '" << fields[0] << "' during registration." << std::endl;
+            std::string error_msg = "SERVER: Error: Campus name '" + fields[0] + "' cannot be registered.\n";
+            send(client_sock, error_msg.data(), error_msg.size(), MSG_NOSIGNAL);
+        } else if (fields.size() >= 2) {
+            campus_name = fields[0];
             try {
-                udp_port = std::stoi(initial_msg.substr(colon_pos + 1));
-                is_registered = true;
+                udp_port = std::stoi(fields[1]);
+                bool resumable = fields.size() >= 3 && fields[2] == "RESUME";
+                std::string resume_token = resumable && fields.size() >= 5 ? fields[3] : "";
+                uint64_t last_seq = resume_token.empty() ? 0 : std::stoull(fields[4]);
+                // Interned last, once nothing can fail before the session takes over the hold
+                CampusId campus_id = intern_campus(campus_name);
+                if (campus_id == NO_CAMPUS) throw std::length_error("campus table full");
                 
                 // Construct UDP address for future broadcasts
                 struct sockaddr_in udp_dest_addr;
@@ -138,137 +600,2167 @@ void handle_client(int client_sock, struct sockaddr_in client_addr) {
                 udp_dest_addr.sin_addr.s_addr = client_addr.sin_addr.s_addr; 
                 udp_dest_addr.sin_port = htons(udp_port);
 
-                // Register the client in the global map
+                client = std::allocate_shared<ClientInfo>(PoolAllocator<ClientInfo>());
+                client->tcp_socket = client_sock;
+                int zerocopy_on = 1; // Needed before MSG_ZEROCOPY is honoured; older kernels refuse it
+                client->zerocopy = setsockopt(client_sock, SOL_SOCKET, SO_ZEROCOPY, &zerocopy_on, sizeof(zerocopy_on)) == 0;
+                client->campus_name = campus_name;
+                client->campus_id = campus_id;
+                client->udp_addr = udp_dest_addr;
+                client->generation = ++session_generation;
+                client->last_recv_ms = steady_ms();
+                client->batch_recv_us = steady_us();
+                client->resumable = resumable;
+                if (resumable) {
+                    unsigned char random[16];
+                    if (getrandom(random, sizeof(random), 0) == (ssize_t)sizeof(random)) {
+                        char hex[sizeof(random) * 2 + 1];
+                        for (size_t i = 0; i < sizeof(random); ++i) snprintf(hex + 2 * i, 3, "%02x", random[i]);
+                        client->session_token = hex;
+                    } else {
+                        perror("[ERROR] getrandom failed; session will not be resumable");
+                        client->resumable = resumable = false;
+                    }
+                }
+                apply_rate_limits(*client);
+                {
+                    std::lock_guard<std::mutex> lock(limits_mutex);
+                    client->policy = policy_overrides[campus_id].value_or(default_policy);
+                }
+
+                // Register the client in the global map, taking over any live or detached
+                // session of the same campus (e.g. a flapping link that reconnected first)
                 std::lock_guard<std::mutex> lock(clients_mutex);
-                active_clients[campus_name] = {client_sock, campus_name, udp_dest_addr};
+                std::shared_ptr<ClientInfo>& existing = active_clients[campus_id];
+                bool resume = existing && !resume_token.empty() &&
+                              existing->resumable && existing->session_token == resume_token;
+
+                // Acknowledge registration (queued first so it precedes any routed or replayed
+                // message); the welcome and the token are not part of the sequenced stream
+                std::string welcome_msg = resume ? "SERVER: Welcome back, " + campus_name + "! Session resumed.\n"
+                                                 : "SERVER: Welcome, " + campus_name + "! TCP and UDP services active.\n";
+                if (!resume_token.empty() && !resume) {
+                    welcome_msg += "SERVER: Previous session could not be resumed; starting a new one.\n";
+                }
+                enqueue_outbound(client, make_payload(welcome_msg), false);
+                if (resumable) {
+                    std::string session_token = resume ? resume_token : client->session_token;
+                    enqueue_outbound(client, make_payload("SESSION:" + session_token + "\n"), false);
+                }
+
+                if (existing) {
+                    if (existing->gateway != NO_CAMPUS) {
+                        // A campus hosted by a gateway now has a connection of its own
+                        std::vector<CampusId>& hosted = gateway_identities[existing->gateway];
+                        hosted.erase(std::remove(hosted.begin(), hosted.end(), campus_id), hosted.end());
+                    } else if (!resume) {
+                        release_identities(campus_id); // A fresh gateway session attaches its own
+                    }
+                    uint64_t lost = take_over_session(existing, client, resume, last_seq);
+                    if (resume) {
+                        std::cout << "[RESUME] '" << campus_name << "' session " << existing->generation
+                                  << " resumed as session " << client->generation << " after #" << last_seq << "." << std::endl;
+                    } else {
+                        std::cout << "[TAKEOVER] '" << campus_name << "' session " << existing->generation
+                                  << " replaced by session " << client->generation << "." << std::endl;
+                    }
+                    if (lost > 0) {
+                        std::string notice = "SERVER: " + std::to_string(lost) + " message(s) after #" +
+                                             std::to_string(last_seq) + " could not be replayed.\n";
+                        enqueue_outbound(client, make_payload(notice), false);
+                    }
+                    existing = client;
+                } else {
+                    existing = client;
+                    active_count++;
+                }
+                {
+                    // Pending paced broadcasts follow the campus to its new UDP address
+                    std::lock_guard<std::mutex> broadcast_lock(broadcast_mutex);
+                    auto dest_it = broadcast_dests.find(campus_id);
+                    if (dest_it != broadcast_dests.end()) dest_it->second.udp_addr = udp_dest_addr;
+                }
 
                 std::cout << "[REGISTRATION] Client '" << campus_name << "' registered. UDP port: " << udp_port << std::endl;
-                
-                // Acknowledge registration
-                std::string welcome_msg = "SERVER: Welcome, " + campus_name + "! TCP and UDP services active.";
-                send(client_sock, welcome_msg.c_str(), welcome_msg.length(), 0);
 
+            } catch (const std::length_error&) {
+                std::cerr << "[ERROR] Campus table full (" << MAX_CAMPUSES << " names); refusing '" << campus_name << "'." << std::endl;
             } catch (...) {
                 std::cerr << "[ERROR] Invalid UDP port format during registration." << std::endl;
             }
         }
     }
     
-    if (!is_registered) {
+    if (!client) {
         std::cerr << "[ERROR] Client failed to register name/port. Closing socket." << std::endl;
         close(client_sock);
         return;
     }
 
     // 2. Main TCP Message Receiving Loop (Inter-Campus Routing)
-    while ((bytes_received = recv(client_sock, buffer, BUFFER_SIZE - 1, 0)) > 0) {
-        buffer[bytes_received] = '\0';
-        std::string message(buffer);
-        
-        // Route the message
-        route_tcp_message(campus_name, message);
-    }
+    // Each '\n'-terminated frame is one message; a single recv may carry several. The
+    // frames of one read are processed as a batch whose scratch space (frame spans,
+    // broadcast destination lists) comes from an arena that is rewound afterwards.
+    // One vectorized pass over the read finds the frames, their first ':' and any
+    // non-ASCII bytes; only frames with the latter get a UTF-8 check.
+    // A FILE chunk header is followed by raw bytes that are not frames: scanning stops
+    // there, the bytes go to the relay, and scanning resumes after them.
+    // Until a '\n' arrives only the newly read bytes are searched, so a frame arriving in
+    // many reads is indexed once; one longer than MAX_FRAME_BYTES ends the session.
+    ChunkRelay relay;
+    bool chunk_header = false;
+    size_t scanned = 0; // Leading bytes of 'pending' known to hold no '\n'
+    do {
+        if (relay.remaining > 0 && !relay_chunk_bytes(relay, pending, *client, client_sock)) {
+            bytes_received = -1; // The connection failed inside a spliced chunk
+            break;
+        }
+        chunk_header = false;
+        if (relay.remaining == 0) {
+            ArenaVector<FrameSpan> spans{ArenaAllocator<char>(scratch)};
+            size_t consumed = 0;
+            if (memchr(pending.data() + scanned, '\n', pending.size() - scanned)) {
+                consumed = scan_frames(pending.data(), pending.size(), spans);
+            }
+            size_t invalid_frames = 0;
+            for (const FrameSpan& span : spans) {
+                std::string_view frame(pending.data() + span.offset, span.length);
+                if (!span.valid_utf8) {
+                    // Dropped, but paid for like any frame, so a flood of them is throttled too
+                    wait_for_tokens(*client);
+                    client->msg_bucket.consume(1);
+                    client->byte_bucket.consume(frame.size() + 1);
+                    invalid_frames++;
+                    continue;
+                }
+                if (frame.empty() || frame == "HEARTBEAT") continue; // Liveness replies are not routed
+                if (frame.compare(0, 10, "HEARTBEAT:") == 0) {
+                    // Resumable clients acknowledge the last sequence number they received
+                    uint64_t acked = 0;
+                    std::from_chars(frame.data() + 10, frame.data() + frame.size(), acked);
+                    std::lock_guard<std::mutex> lock(client->out_mutex);
+                    while (!client->unacked.empty() && client->unacked.front().seq <= acked) {
+                        client->unacked_bytes -= client->unacked.front().payload->size();
+                        client->unacked.pop_front();
+                    }
+                    continue;
+                }
+                if (frame == "QUIT") {
+                    quit = true; // Ends a resumable session for good instead of detaching it
+                    break;
+                }
+                if (frame.compare(0, 7, "ATTACH:") == 0) {
+                    // Paid for like a message: each one costs an intern and a reply
+                    wait_for_tokens(*client);
+                    client->msg_bucket.consume(1);
+                    client->byte_bucket.consume(frame.size() + 1);
+                    attach_identity(client, frame.substr(7));
+                    continue;
+                }
+
+                // A gateway speaks for its identities as "@<identity>:<frame>"; any other
+                // frame starting with '@' is an ordinary message to such a destination
+                std::shared_ptr<ClientInfo> sender = client;
+                size_t colon_pos = span.colon == FrameSpan::NO_COLON ? std::string_view::npos : span.colon;
+                if (frame[0] == '@' && colon_pos != std::string_view::npos) {
+                    std::shared_ptr<ClientInfo> identity = find_identity(*client, frame.substr(1, colon_pos - 1));
+                    if (identity) {
+                        frame.remove_prefix(colon_pos + 1);
+                        if (frame == "QUIT") {
+                            detach_identity(identity);
+                            continue;
+                        }
+                        identity->batch_recv_us = client->batch_recv_us;
+                        sender = std::move(identity);
+                        colon_pos = frame.find(':');
+                    }
+                }
+                // Identities share the gateway's reads, so one over its limit pauses them all
+                wait_for_tokens(*sender);
+                sender->msg_bucket.consume(1);
+                sender->byte_bucket.consume(frame.size() + 1);
+
+                if (frame.compare(0, 5, "FILE:") == 0) {
+                    size_t body_start = pending.find('\n', span.offset + span.length) + 1;
+                    if (!begin_chunk_relay(sender, frame.substr(5), pending.size() - body_start, relay)) continue; // Malformed; no bytes follow
+                    sender->byte_bucket.consume(relay.remaining);
+                    consumed = body_start;
+                    chunk_header = true;
+                    break;
+                }
+
+                // Route the message
+                route_tcp_message(sender, frame, colon_pos, scratch);
+            }
+            if (invalid_frames > 0) {
+                // One reply per batch, however many of its frames were dropped
+                std::cerr << "[ERROR] Dropped " << invalid_frames << " frame(s) from " << campus_name << ": not valid UTF-8." << std::endl;
+                std::string error_msg = invalid_frames == 1 ? "SERVER: Error: Message is not valid UTF-8.\n"
+                    : "SERVER: Error: " + std::to_string(invalid_frames) + " messages were not valid UTF-8.\n";
+                enqueue_outbound(client, make_payload(error_msg), false);
+            }
+            pending.erase(0, consumed);
+            // Unless the batch stopped early, what is left is one frame still missing its '\n'
+            scanned = quit || chunk_header ? 0 : pending.size();
+            if (scanned > MAX_FRAME_BYTES) {
+                std::cerr << "[ERROR] Frame from " << campus_name << " exceeds " << MAX_FRAME_BYTES << " bytes; ending the session." << std::endl;
+                enqueue_outbound(client, make_payload("SERVER: Error: Message exceeds " + std::to_string(MAX_FRAME_BYTES) + " bytes.\n"), false);
+                std::unique_lock<std::mutex> lock(client->out_mutex);
+                client->end_reason = "frame exceeds " + std::to_string(MAX_FRAME_BYTES) + " bytes";
+                // Give the I/O thread a moment to write the reply before the socket is closed
+                client->out_cv.wait_for(lock, std::chrono::milliseconds(CLOSE_FLUSH_MS), [&] {
+                    return client->outbound.empty() || client->disconnecting || client->detach_pending;
+                });
+                quit = true; // Not resumable: the client would only send the same frame again
+            }
+        }
+        scratch.reset();
+        if (quit) break;
+        if (chunk_header) continue; // The chunk, and frames after it, may already be buffered
+        wait_for_tokens(*client);
+        client->throttled = false; // Caught up with everything buffered; the next pause is a new episode
+        size_t read_size = relay.chunk_ended ? SPLICE_HEADER_READ : RECV_BATCH_BYTES;
+        relay.chunk_ended = false;
+        if ((bytes_received = recv_waiting(*client, client_sock, buffer.data, read_size)) > 0) {
+            pending.append(buffer.data, bytes_received);
+            client->last_recv_ms = steady_ms();
+            client->batch_recv_us = steady_us();
+        }
+    } while (!quit && (chunk_header || bytes_received > 0));
     
     // 3. Client Disconnect/Error
-    if (bytes_received == 0) {
+    // A resumable session whose connection dropped (rather than being replaced, evicted
+    // or quit) is detached: it stays registered and keeps queueing until it is resumed
+    std::string end_reason;
+    bool detached;
+    size_t queued;
+    {
+        std::lock_guard<std::mutex> lock(client->out_mutex);
+        client->detached = client->resumable && !client->disconnecting && !quit;
+        detached = client->detached;
+        end_reason = client->end_reason;
+        queued = client->outbound.size();
+    }
+    if (!end_reason.empty()) {
+        std::cout << "[DISCONNECT] Client '" << campus_name << "' session " << client->generation
+                  << " ended (" << end_reason << ")." << std::endl;
+    } else if (quit) {
+        std::cout << "[DISCONNECT] Client '" << campus_name << "' quit." << std::endl;
+    } else if (bytes_received == 0) {
         std::cout << "[DISCONNECT] Client '" << campus_name << "' disconnected gracefully." << std::endl;
     } else {
-        perror("[ERROR] recv failed");
+        perror("[ERROR] recv failed"); // ETIMEDOUT here means keepalive/user-timeout gave up on the peer
     }
 
-    // Unregister and cleanup
-    close(client_sock);
-    std::lock_guard<std::mutex> lock(clients_mutex);
-    active_clients.erase(campus_name);
+    if (detached) {
+        close_session(client);
+        std::cout << "[DETACH] Session '" << campus_name << "' detached; holding " << queued
+                  << " queued message(s) for " << RESUME_GRACE_MS << " ms." << std::endl;
+        return;
+    }
+
+    // Unregister and cleanup (the I/O thread closes the socket once it lets go of it)
+    {
+        std::lock_guard<std::mutex> lock(clients_mutex);
+        std::shared_ptr<ClientInfo>& entry = active_clients[client->campus_id];
+        // A newer generation may own the name by now; only our own entry is removed
+        if (entry && entry->generation == client->generation) {
+            entry.reset();
+            active_count--;
+            release_identities(client->campus_id);
+        }
+    }
+    close_session(client);
     std::cout << "[INFO] Client '" << campus_name << "' removed from active list." << std::endl;
 }
 
+// ====================================================================
+//                             CAMPUS IDS
+// ====================================================================
+
+// Names that cannot be told apart from addressing: empty ones (an empty table entry is a
+// free ID), ones with ':', and ones starting with '#' (an ID) or '@' (a gateway identity)
+bool valid_campus_name(std::string_view name) {
+    return !name.empty() && name.find(':') == std::string_view::npos && name[0] != '#' && name[0] != '@';
+}
+
+// Returns the campus's ID, interning the name on first sight, and holds it for the
+// caller until release_campus() (a session passes its hold on to ClientInfo). NO_CAMPUS
+// once every ID is in use and none can be reclaimed.
+CampusId intern_campus(std::string_view name) {
+    // Directory campuses are held from startup on and never reclaimed
+    CampusId id = campus_directory.find(name);
+    if (id != NO_CAMPUS) {
+        campus_table[id].holders++;
+        return id;
+    }
+    {
+        // Held under the lock, so a concurrent reclaim cannot take the ID away first
+        std::shared_lock<std::shared_mutex> lock(campus_mutex);
+        auto it = campus_ids.find(name);
+        if (it != campus_ids.end()) {
+            campus_table[it->second].holders++;
+            return it->second;
+        }
+    }
+
+    for (int attempt = 0; attempt < 2; ++attempt) {
+        if (attempt > 0 && reclaim_campus_ids() == 0) break;
+        std::unique_lock<std::shared_mutex> lock(campus_mutex);
+        auto it = campus_ids.find(name);
+        if (it != campus_ids.end()) {
+            campus_table[it->second].holders++;
+            return it->second;
+        }
+        bool fresh = free_campus_ids.empty();
+        if (fresh) {
+            id = campus_count.load(std::memory_order_relaxed);
+            if (id >= MAX_CAMPUSES) continue;
+        } else {
+            id = free_campus_ids.back();
+            free_campus_ids.pop_back();
+        }
+        campus_table[id].name = std::string(name);
+        campus_table[id].from_prefix = "FROM " + std::string(name) + ": ";
+        campus_table[id].holders = 1;
+        campus_ids.emplace(std::string(name), id);
+        if (fresh) campus_count.store(id + 1, std::memory_order_release); // Publishes the table entry
+        return id;
+    }
+    return NO_CAMPUS;
+}
+
+void release_campus(CampusId id) {
+    campus_table[id].holders.fetch_sub(1, std::memory_order_release);
+}
+
+ClientInfo::~ClientInfo() {
+    if (campus_id != NO_CAMPUS) release_campus(campus_id);
+}
+
+// Returns IDs nothing uses any more to the free list: no session, identity or caller
+// holds them, no LIMIT/POLICY/RATE override names them and no broadcasts wait for them.
+// Their old "#<id>"s stop resolving (the generation moves on) and their counters restart.
+// Returns how many were reclaimed.
+size_t reclaim_campus_ids() {
+    std::lock_guard<std::mutex> clients_lock(clients_mutex);
+    std::lock_guard<std::mutex> limits_lock(limits_mutex);
+    std::lock_guard<std::mutex> broadcast_lock(broadcast_mutex);
+    std::unique_lock<std::shared_mutex> lock(campus_mutex);
+    size_t reclaimed = 0;
+    CampusId count = campus_count.load(std::memory_order_relaxed);
+    for (CampusId id = 0; id < count; ++id) {
+        CampusEntry& entry = campus_table[id];
+        if (entry.name.empty() || entry.holders.load(std::memory_order_acquire) != 0 || active_clients[id] ||
+            !gateway_identities[id].empty() || limit_overrides[id] || policy_overrides[id] ||
+            broadcast_rate_overrides[id] != 0 || broadcast_dests.count(id)) {
+            continue;
+        }
+        campus_ids.erase(campus_ids.find(entry.name));
+        entry.name.clear();
+        entry.from_prefix.clear();
+        entry.generation.fetch_add(1, std::memory_order_release);
+        CampusCounters& counters = campus_counters[id];
+        counters.sent = counters.received = counters.failed = counters.file_bytes = 0;
+        free_campus_ids.push_back(id);
+        reclaimed++;
+    }
+    reclaimed_campus_ids += reclaimed;
+    if (reclaimed > 0) std::cout << "[INFO] Reclaimed " << reclaimed << " unused campus IDs." << std::endl;
+    return reclaimed;
+}
+
+// NO_CAMPUS if the name is not interned. The ID is not held: a caller that uses it after
+// dropping the locks that keep it alive (clients_mutex with an active session) must
+// expect it to have been reclaimed.
+CampusId find_campus(std::string_view name) {
+    // Directory campuses: one hash and one compare, and no lock since it never changes
+    CampusId id = campus_directory.find(name);
+    if (id != NO_CAMPUS) return id;
+
+    // Everything else: the dynamic table
+    std::shared_lock<std::shared_mutex> lock(campus_mutex);
+    auto it = campus_ids.find(name);
+    return it != campus_ids.end() ? it->second : NO_CAMPUS;
+}
+
+// Loads the known campus set, one name per line ('#' starts a comment), before any
+// client connects. The campuses get the first IDs in file order and are compiled into
+// the perfect hash consulted ahead of the dynamic table.
+bool load_campus_directory(const char *path) {
+    std::ifstream file(path);
+    if (!file) {
+        perror("[ERROR] Failed to open campus directory");
+        return false;
+    }
+    std::vector<std::string> names;
+    std::vector<CampusId> ids;
+    std::string line;
+    while (std::getline(file, line)) {
+        line = line.substr(0, line.find('#'));
+        line.erase(0, line.find_first_not_of(" \t\r"));
+        line.erase(line.find_last_not_of(" \t\r") + 1);
+        if (line.empty()) continue;
+        if (!valid_campus_name(line)) {
+            std::cerr << "[WARNING] Skipping campus directory entry '" << line << "' (names cannot contain ':' or start with '@')." << std::endl;
+            continue;
+        }
+        if (find_campus(line) != NO_CAMPUS) continue; // Duplicate
+        CampusId id = intern_campus(line);
+        if (id == NO_CAMPUS) {
+            std::cerr << "[ERROR] Campus directory exceeds " << MAX_CAMPUSES << " names." << std::endl;
+            return false;
+        }
+        names.push_back(line);
+        ids.push_back(id);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    if (!campus_directory.build(names, ids)) {
+        // The names are still interned; lookups just go through the dynamic table
+        std::cerr << "[WARNING] Could not build a perfect hash for the campus directory; using the dynamic table." << std::endl;
+        return true;
+    }
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+    std::cout << "[INFO] Campus directory: " << names.size() << " campuses from " << path << " (perfect hash over "
+              << campus_directory.bucket_count() << " buckets, built in " << elapsed.count() << " us)." << std::endl;
+    return true;
+}
+
+// The "#<id>" a client is given for an ID: the ID plus MAX_CAMPUSES per time it has been
+// reclaimed, so one resolved before a reclaim never reaches the campus that reuses it
+static uint64_t issued_campus_id(CampusId id) {
+    return (uint64_t)campus_table[id].generation.load(std::memory_order_acquire) * MAX_CAMPUSES + id;
+}
+
+// Parses the digits of a "#<id>" destination; NO_CAMPUS unless it is the ID's current issue
+static CampusId parse_campus_id(std::string_view digits) {
+    uint64_t issued = 0;
+    auto result = std::from_chars(digits.data(), digits.data() + digits.size(), issued);
+    if (result.ec != std::errc() || result.ptr != digits.data() + digits.size()) return NO_CAMPUS;
+    CampusId id = issued % MAX_CAMPUSES;
+    if (id >= campus_count.load(std::memory_order_acquire)) return NO_CAMPUS;
+    return issued_campus_id(id) == issued ? id : NO_CAMPUS;
+}
+
+// ====================================================================
+//                         GATEWAY IDENTITIES
+// ====================================================================
+
+// A gateway is an ordinary registered session that hosts other campuses over its own
+// connection: "ATTACH:<name>" registers <name> as an identity of it, "@<name>:<frame>"
+// sends on the identity's behalf, and everything for the identity arrives on the
+// gateway's connection as "@<name>:<frame>". "@<name>:QUIT" detaches it. Identities are
+// routed, rate-limited and counted like any campus, but have no socket or UDP port of
+// their own, and live as long as their gateway's session (including a resumed one).
+
+// Why 'gateway' may not attach campus 'id' (NO_CAMPUS: not interned yet), or empty if
+// it may; 'attached' is set when the identity is already its own. Needs clients_mutex.
+static std::string attach_refusal(const std::shared_ptr<ClientInfo>& gateway, CampusId id, bool& attached) {
+    attached = false;
+    if (active_clients[gateway->campus_id] != gateway) return "was sent on a replaced session";
+    const std::shared_ptr<ClientInfo> *entry = id == NO_CAMPUS ? nullptr : &active_clients[id];
+    if (entry && *entry && (*entry)->gateway == gateway->campus_id) {
+        attached = true; // Already ours (e.g. attached again after a resume): nothing to do
+        return "";
+    }
+    if ((entry && *entry) || id == gateway->campus_id) return "is registered by another session";
+    if (gateway_identities[gateway->campus_id].size() >= MAX_GATEWAY_IDENTITIES) {
+        return "exceeds " + std::to_string(MAX_GATEWAY_IDENTITIES) + " identities per gateway";
+    }
+    return "";
+}
+
+// Replies "ATTACHED:<name>", or an error if the name belongs to another session. The
+// name is only interned once the attach looks acceptable, so refusals take no ID.
+void attach_identity(const std::shared_ptr<ClientInfo>& gateway, std::string_view name) {
+    std::string error;
+    bool attached = false;
+    if (!valid_campus_name(name)) {
+        error = "cannot be registered";
+    } else {
+        std::lock_guard<std::mutex> lock(clients_mutex);
+        error = attach_refusal(gateway, find_campus(name), attached);
+    }
+    CampusId id = error.empty() && !attached ? intern_campus(name) : NO_CAMPUS;
+    if (error.empty() && !attached && id == NO_CAMPUS) error = "cannot be registered";
+    if (id != NO_CAMPUS) {
+        auto identity = std::allocate_shared<ClientInfo>(PoolAllocator<ClientInfo>());
+        identity->tcp_socket = -1;
+        identity->campus_name = std::string(name);
+        identity->campus_id = id; // Takes over the hold; a refused identity gives it back
+        memset(&identity->udp_addr, 0, sizeof(identity->udp_addr));
+        identity->generation = ++session_generation;
+        identity->last_recv_ms = steady_ms();
+        identity->gateway = gateway->campus_id;
+        apply_rate_limits(*identity);
+
+        // Checked again: the sessions may have changed while the name was interned
+        std::lock_guard<std::mutex> lock(clients_mutex);
+        error = attach_refusal(gateway, id, attached);
+        if (error.empty() && !attached) {
+            std::vector<CampusId>& hosted = gateway_identities[gateway->campus_id];
+            active_clients[id] = identity;
+            active_count++;
+            hosted.push_back(id);
+            std::cout << "[GATEWAY] '" << name << "' attached via '" << gateway->campus_name << "' ("
+                      << hosted.size() << " hosted)." << std::endl;
+        }
+    }
+
+    std::string reply = error.empty() ? "ATTACHED:" + std::string(name) + "\n"
+                                      : "SERVER: Error: Cannot attach '" + std::string(name) + "': " + error + ".\n";
+    if (!error.empty()) std::cerr << "[GATEWAY] '" << gateway->campus_name << "' could not attach '" << name << "' (" << error << ")." << std::endl;
+    enqueue_outbound(gateway, make_payload(reply), false);
+}
+
+// The identity 'name' if it is attached to this gateway, else null
+std::shared_ptr<ClientInfo> find_identity(const ClientInfo& gateway, std::string_view name) {
+    std::lock_guard<std::mutex> lock(clients_mutex);
+    CampusId id = find_campus(name);
+    if (id == NO_CAMPUS) return nullptr;
+    const std::shared_ptr<ClientInfo>& entry = active_clients[id];
+    return entry && entry->gateway == gateway.campus_id ? entry : nullptr;
+}
+
+void detach_identity(const std::shared_ptr<ClientInfo>& identity) {
+    {
+        std::lock_guard<std::mutex> lock(clients_mutex);
+        std::shared_ptr<ClientInfo>& entry = active_clients[identity->campus_id];
+        if (entry != identity) return;
+        entry.reset();
+        active_count--;
+        std::vector<CampusId>& hosted = gateway_identities[identity->gateway];
+        hosted.erase(std::remove(hosted.begin(), hosted.end(), identity->campus_id), hosted.end());
+    }
+    std::cout << "[GATEWAY] '" << identity->campus_name << "' detached from '"
+              << campus_table[identity->gateway].name << "'." << std::endl;
+}
+
+// The gateway's session is over for good: so are its identities (clients_mutex held)
+void release_identities(CampusId gateway) {
+    std::vector<CampusId>& hosted = gateway_identities[gateway];
+    if (hosted.empty()) return;
+    size_t released = 0;
+    for (CampusId id : hosted) {
+        std::shared_ptr<ClientInfo>& entry = active_clients[id];
+        if (entry && entry->gateway == gateway) {
+            entry.reset();
+            active_count--;
+            released++;
+        }
+    }
+    hosted.clear();
+    std::cout << "[GATEWAY] Released " << released << " identities of '" << campus_table[gateway].name << "'." << std::endl;
+}
+
 // ====================================================================
 //                           ROUTING LOGIC
 // ====================================================================
 
-void route_tcp_message(const std::string& sender_name, const std::string& full_message) {
-    size_t colon_pos = full_message.find(':');
+// The active session for a "<name>" or "#<id>" destination (null if there is none).
+// Looked up under clients_mutex, which a reclaim also takes, so the ID cannot be
+// reissued to another campus between the lookup and reading its session.
+static std::shared_ptr<ClientInfo> find_destination(std::string_view destination, CampusId& dest_id) {
+    std::lock_guard<std::mutex> lock(clients_mutex);
+    dest_id = destination.size() > 1 && destination[0] == '#' ? parse_campus_id(destination.substr(1))
+                                                              : find_campus(destination);
+    return dest_id == NO_CAMPUS ? nullptr : active_clients[dest_id];
+}
+
+// Latency probes, answered without touching the routing counters:
+//   PING:<token>           -> PONG:<token>:<server_us>, echoed from here; server_us is how
+//                             long the probe was in the server before its echo was queued
+//   PING:<dest>:<token>    -> the destination gets PING:<sender>:<token>:<stamp>, and its
+//                             client answers PONG:<sender>:<token>:<stamp>, which reaches
+//                             the sender as PONG:<dest>:<token>:<dest_us>; dest_us is the
+//                             time from forwarding the probe to getting the answer here
+//                             ("unreachable" if <dest> is not active)
+// Together they separate the network, server queueing and a slow destination. A PONG is
+// only passed on for a PING the server forwarded to its sender and has not seen answered.
+static void route_probe(const std::shared_ptr<ClientInfo>& sender, bool ping, std::string_view content) {
+    size_t colon_pos = content.find(':');
+    PooledString reply;
+    if (ping && colon_pos == std::string_view::npos) {
+        reply.append("PONG:").append(content).append(":").append(std::to_string(steady_us() - sender->batch_recv_us)).push_back('\n');
+        enqueue_outbound(sender, make_payload(std::move(reply)), false);
+        return;
+    }
+    if (colon_pos == std::string_view::npos) return;
+
+    // PING: forward to the destination; PONG: return the answer to the probe's sender
+    std::string_view peer = content.substr(0, colon_pos), rest = content.substr(colon_pos + 1);
+    CampusId peer_id;
+    std::shared_ptr<ClientInfo> target = find_destination(peer, peer_id);
+    if (ping) {
+        if (target) {
+            int64_t stamp = steady_us();
+            {
+                // Recorded first, since the answer may be back before enqueue_outbound returns
+                std::lock_guard<std::mutex> lock(target->out_mutex);
+                if (target->pending_probes.size() >= MAX_PENDING_PROBES) target->pending_probes.pop_front();
+                target->pending_probes.emplace_back(sender->campus_id, stamp);
+            }
+            PooledString probe;
+            probe.append("PING:").append(sender->campus_name).append(":").append(rest).append(":")
+                 .append(std::to_string(stamp)).push_back('\n');
+            if (enqueue_outbound(target, make_payload(std::move(probe)), false)) return;
+        }
+        reply.append("PONG:").append(peer).append(":").append(rest).append(":unreachable\n");
+        enqueue_outbound(sender, make_payload(std::move(reply)), false);
+    } else if (target) {
+        // rest is "<token>:<stamp>", as forwarded
+        size_t stamp_pos = rest.rfind(':');
+        int64_t stamp = 0;
+        if (stamp_pos == std::string_view::npos) return;
+        std::from_chars(rest.data() + stamp_pos + 1, rest.data() + rest.size(), stamp);
+        {
+            std::lock_guard<std::mutex> lock(sender->out_mutex);
+            auto& pending = sender->pending_probes;
+            auto it = std::find(pending.begin(), pending.end(), std::make_pair(peer_id, stamp));
+            if (it == pending.end()) {
+                std::cerr << "[PROBE] Dropping unsolicited PONG from '" << sender->campus_name << "' for '" << peer << "'." << std::endl;
+                return;
+            }
+            pending.erase(it);
+        }
+        reply.append("PONG:").append(sender->campus_name).append(":").append(rest.substr(0, stamp_pos)).append(":")
+             .append(std::to_string(steady_us() - stamp)).push_back('\n');
+        enqueue_outbound(target, make_payload(std::move(reply)), false);
+    }
+}
+
+// File transfer between campuses. The server relays two kinds of frame without
+// looking into the transfer itself:
+//   FILECTL:<dest>:<verb>:<id>:...   -> the destination gets FILECTL:<sender>:<verb>:<id>:...
+//                                       (offers, accepts and completions between the clients)
+//   FILE:<dest>:<id>:<offset>:<len>  -> followed by <len> raw bytes (at most FILE_CHUNK_MAX),
+//                                       forwarded as FILE:<sender>:<id>:<offset>:<len> + bytes
+// Either one for an inactive destination is answered FILECTL:<dest>:UNREACHABLE:<id>:<verb>
+// (<verb> is FILE for a chunk). One chunk is held at a time, so a file of any size costs
+// the server one chunk. A large chunk body is cut through rather than copied: spliced from
+// the sender's socket into a pipe, queued behind its header, and spliced on from there.
+// Both go unsequenced: the resume window is for messages, and a receiver that misses a
+// chunk asks for the rest again from the offset it has.
+static void reply_unreachable(const std::shared_ptr<ClientInfo>& sender, std::string_view peer,
+                              std::string_view id, std::string_view verb) {
+    PooledString reply;
+    reply.append("FILECTL:").append(peer).append(":UNREACHABLE:").append(id).append(":").append(verb).push_back('\n');
+    enqueue_outbound(sender, make_payload(std::move(reply)), false);
+}
+
+static void route_file_control(const std::shared_ptr<ClientInfo>& sender, std::string_view content) {
+    // content is "<dest>:<verb>:<id>:..."
+    size_t verb_pos = content.find(':');
+    size_t id_pos = verb_pos == std::string_view::npos ? verb_pos : content.find(':', verb_pos + 1);
+    if (id_pos == std::string_view::npos) return;
+    std::string_view peer = content.substr(0, verb_pos), rest = content.substr(verb_pos + 1);
+    CampusId peer_id;
+    std::shared_ptr<ClientInfo> target = find_destination(peer, peer_id);
+    PooledString forwarded;
+    forwarded.append("FILECTL:").append(sender->campus_name).append(":").append(rest).push_back('\n');
+    if (target && enqueue_outbound(target, make_payload(std::move(forwarded)), false)) return;
+    std::string_view id = content.substr(id_pos + 1);
+    reply_unreachable(sender, peer, id.substr(0, id.find(':')), content.substr(verb_pos + 1, id_pos - verb_pos - 1));
+}
+
+// Takes a relay pipe from the pool, opening one if the pool is empty; null when
+// SPLICE_PIPES_MAX are in use (the chunk is then copied). The pipe is non-blocking, so
+// a write or splice that finds it full fails instead of stalling the handler.
+static std::shared_ptr<SplicedBody> acquire_relay_pipe() {
+    auto body = std::make_shared<SplicedBody>();
+    std::lock_guard<std::mutex> lock(relay_pipes_mutex);
+    if (!relay_pipes_free.empty()) {
+        body->pipe_fds[0] = relay_pipes_free.back().fds[0];
+        body->pipe_fds[1] = relay_pipes_free.back().fds[1];
+        body->capacity = relay_pipes_free.back().capacity;
+        relay_pipes_free.pop_back();
+        return body;
+    }
+    if (relay_pipes_open >= SPLICE_PIPES_MAX) return nullptr;
+    if (pipe2(body->pipe_fds, O_CLOEXEC | O_NONBLOCK) < 0) {
+        perror("[ERROR] Failed to create relay pipe");
+        return nullptr;
+    }
+    // The default 64 KB is 16 page slots, which a fragmented chunk can fill early. The
+    // kernel may refuse (pipe-max-size), or give a user over pipe-user-pages-soft as
+    // little as 2 pages, so the pipe keeps whatever it really got.
+    int capacity = fcntl(body->pipe_fds[1], F_SETPIPE_SZ, SPLICE_PIPE_BYTES);
+    if (capacity < 0) {
+        perror("[WARNING] Failed to enlarge relay pipe");
+        capacity = fcntl(body->pipe_fds[1], F_GETPIPE_SZ);
+    }
+    body->capacity = capacity > 0 ? capacity : 0;
+    relay_pipes_open++;
+    return body;
+}
+
+SplicedBody::~SplicedBody() {
+    if (pipe_fds[0] < 0) return;
+    std::lock_guard<std::mutex> lock(relay_pipes_mutex);
+    if (unsent == 0) {
+        relay_pipes_free.push_back({{pipe_fds[0], pipe_fds[1]}, capacity});
+        return;
+    }
+    // Bytes of a discarded body are still inside; the pipe cannot be reused
+    close(pipe_fds[0]);
+    close(pipe_fds[1]);
+    relay_pipes_open--;
+}
+
+// Falls back from splicing: reads what the relay pipe holds into the payload and releases it
+static void drain_relay_pipe(ChunkRelay& relay) {
+    size_t offset = relay.payload.size();
+    relay.payload.resize(offset + relay.body->unsent);
+    while (relay.body->unsent > 0) {
+        ssize_t got = read(relay.body->pipe_fds[0], &relay.payload[offset], relay.body->unsent);
+        if (got <= 0) {
+            if (got < 0 && errno == EINTR) continue;
+            break; // Cannot happen with bytes in the pipe; the chunk is left short
+        }
+        offset += got;
+        relay.body->unsent -= got;
+    }
+    relay.payload.resize(offset);
+    relay.body.reset();
+}
+
+// 'header' is a FILE frame after "FILE:". Sets up the relay of the raw bytes that follow
+// it; false (after telling the sender) if the header is malformed.
+// 'buffered' is how many bytes after the header were read along with it.
+bool begin_chunk_relay(const std::shared_ptr<ClientInfo>& sender, std::string_view header, size_t buffered, ChunkRelay& relay) {
+    // <dest>:<id>:<offset>:<len>
+    size_t id_pos = header.find(':');
+    size_t offset_pos = id_pos == std::string_view::npos ? id_pos : header.find(':', id_pos + 1);
+    size_t len_pos = offset_pos == std::string_view::npos ? offset_pos : header.find(':', offset_pos + 1);
+    uint64_t length = 0;
+    if (len_pos == std::string_view::npos || id_pos == 0 ||
+        std::from_chars(header.data() + len_pos + 1, header.data() + header.size(), length).ptr != header.data() + header.size() ||
+        length == 0) {
+        enqueue_outbound(sender, make_payload(std::string_view("SERVER: Error: Malformed FILE chunk header.\n")), false);
+        return false;
+    }
+    std::string_view destination = header.substr(0, id_pos);
+    relay.remaining = length;
+    relay.payload = PooledString();
+    relay.dest.reset();
+    relay.body.reset();
+    if (length > FILE_CHUNK_MAX) {
+        std::cerr << "[FILE] Discarding a " << length << "-byte chunk from " << sender->campus_name
+                  << " (limit " << FILE_CHUNK_MAX << ")." << std::endl;
+        enqueue_outbound(sender, make_payload("SERVER: Error: FILE chunks are limited to " + std::to_string(FILE_CHUNK_MAX) + " bytes.\n"), false);
+        return true;
+    }
+    CampusId dest_id;
+    relay.dest = find_destination(destination, dest_id);
+    if (!relay.dest) {
+        // The bytes are still read (and dropped) to keep the stream in step
+        reply_unreachable(sender, destination, header.substr(id_pos + 1, offset_pos - id_pos - 1), "FILE");
+        return true;
+    }
+    // Cut-through: a body mostly still in the socket goes through a pipe instead, if the
+    // pipe can hold all of it (a smaller one goes back to the pool and the body is copied)
+    if (SPLICE_MIN_BYTES > 0 && length > buffered && length - buffered >= SPLICE_MIN_BYTES) {
+        relay.body = acquire_relay_pipe();
+        if (relay.body && relay.body->capacity < length) {
+            relay.body.reset();
+            splice_fallbacks++;
+        }
+        if (relay.body) relay.body->length = length;
+    }
+    relay.payload.reserve(5 + sender->campus_name.size() + (header.size() - id_pos) + 1 + (relay.body ? 0 : length));
+    relay.payload.append("FILE:").append(sender->campus_name).append(header.substr(id_pos)).push_back('\n');
+    campus_counters[sender->campus_id].file_bytes += length;
+    return true;
+}
+
+// Moves what has arrived of the current chunk out of 'pending', and queues the chunk for
+// its destination once it is complete. A spliced chunk is completed here: what was read
+// with the header is written to the pipe, and the rest goes from 'sock' into the pipe.
+// False if the connection failed (errno says why).
+bool relay_chunk_bytes(ChunkRelay& relay, std::string& pending, ClientInfo& client, int sock) {
+    size_t take = std::min(relay.remaining, pending.size());
+    size_t piped = 0;
+    if (relay.body && take > 0) {
+        // The pipe is empty and has room for the whole chunk; were it to fill anyway, the
+        // non-blocking write comes up short and the chunk is copied instead
+        ssize_t written = write(relay.body->pipe_fds[1], pending.data(), take);
+        if (written > 0) {
+            relay.body->unsent += written;
+            piped = written;
+        }
+        if (written < 0) {
+            perror("[ERROR] Failed to write to relay pipe");
+        } else if (piped < take) {
+            std::cerr << "[WARNING] Relay pipe took " << piped << " of " << take
+                      << " chunk bytes; copying the chunk instead." << std::endl;
+        }
+        if (piped < take) {
+            drain_relay_pipe(relay);
+            splice_fallbacks++;
+        }
+    }
+    if (relay.dest && !relay.body) relay.payload.append(pending, piped, take - piped);
+    pending.erase(0, take);
+    relay.remaining -= take;
+
+    while (relay.body && relay.remaining > 0) {
+        ssize_t moved = splice(sock, nullptr, relay.body->pipe_fds[1], nullptr, relay.remaining,
+                               SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (moved > 0) {
+            relay.body->unsent += moved;
+            relay.remaining -= moved;
+            spliced_chunk_bytes += moved;
+            continue;
+        }
+        if (moved == 0) {
+            errno = ECONNRESET; // The stream ended inside the chunk
+            return false;
+        }
+        if (errno == EINTR) continue;
+        if (errno != EAGAIN) return false;
+        // Either the socket has nothing yet, or the body arrived in fragments small enough
+        // to fill the pipe's slots first; then the rest is copied as usual
+        struct pollfd room = {relay.body->pipe_fds[1], POLLOUT, 0};
+        if (poll(&room, 1, 0) <= 0) {
+            drain_relay_pipe(relay);
+            splice_fallbacks++;
+            break;
+        }
+        if (!wait_readable(client, sock)) return false;
+    }
+
+    if (relay.remaining > 0) return true;
+    relay.chunk_ended = true;
+    if (!relay.dest) return true;
+    if (!enqueue_outbound(relay.dest, make_payload(std::move(relay.payload)), false, std::move(relay.body))) {
+        std::cerr << "[DROP] File chunk for " << relay.dest->campus_name << " discarded (outbound queue full)." << std::endl;
+    }
+    relay.dest.reset();
+    relay.body.reset();
+    return true;
+}
+
+// 'full_message' points into the handler's receive buffer and is only valid for the
+// current batch; anything that outlives it is copied into a pooled payload. 'colon_pos'
+// is the first ':' as found by the frame scanner (npos if there is none).
+void route_tcp_message(const std::shared_ptr<ClientInfo>& sender, std::string_view full_message, size_t colon_pos, Arena& scratch) {
+    const std::string& sender_name = sender->campus_name;
     
     if (colon_pos == std::string::npos) {
         std::cerr << "[ERROR] Invalid message format from " << sender_name << ": " << full_message << std::endl;
         return;
     }
     
-    std::string destination = full_message.substr(0, colon_pos);
-    std::string content = full_message.substr(colon_pos + 1);
-    
-    // Determine the final message string to send to the recipient
-    std::string final_msg = "FROM " + sender_name + ": " + content;
+    // Views into the frame; the only allocation is the pooled payload sent on
+    std::string_view destination = full_message.substr(0, colon_pos);
+    std::string_view content = full_message.substr(colon_pos + 1);
+    CampusCounters& sender_counters = campus_counters[sender->campus_id];
+
+    // RESOLVE:<name> asks for a campus's ID, so later messages can be sent to "#<id>"
+    if (destination == "RESOLVE") {
+        CampusId id = find_campus(content);
+        PooledString reply;
+        reply.append("RESOLVE:").append(content).append(":").append(id == NO_CAMPUS ? "none" : std::to_string(issued_campus_id(id))).push_back('\n');
+        enqueue_outbound(sender, make_payload(std::move(reply)), false);
+        return;
+    }
+
+    if (destination == "PING" || destination == "PONG") {
+        route_probe(sender, destination == "PING", content);
+        return;
+    }
+
+    if (destination == "FILECTL") {
+        route_file_control(sender, content);
+        return;
+    }
 
     std::cout << "[TCP ROUTING] " << sender_name << " -> " << destination << std::endl;
 
     // Check for BROADCAST keyword
     if (destination == "BROADCAST") {
-        std::string broadcast_msg = "BROADCAST FROM " + sender_name + ": " + content;
-        send_udp_broadcast(broadcast_msg);
+        PooledString broadcast_msg;
+        broadcast_msg.reserve(16 + sender_name.size() + 2 + content.size());
+        broadcast_msg.append("BROADCAST FROM ").append(sender_name).append(": ").append(content);
+        // One broadcast costs a send per destination, so it is charged per recipient
+        sender->broadcast_bucket.consume(send_udp_broadcast(make_payload(std::move(broadcast_msg)), scratch));
+        sender_counters.sent++;
         return;
     }
 
-    // Attempt to route to a specific campus
-    std::lock_guard<std::mutex> lock(clients_mutex);
-    auto it = active_clients.find(destination);
-
-    if (it != active_clients.end()) {
-        // Found the recipient, send TCP message
-        int dest_sock = it->second.tcp_socket;
-        if (send(dest_sock, final_msg.c_str(), final_msg.length(), 0) < 0) {
-            perror("[ERROR] Failed to send routed TCP message");
-            // Optionally remove the client if send fails
+    // Attempt to route to a specific campus (the lock only covers the lookup;
+    // queueing may block under POLICY_BLOCK and must not stall other routes).
+    // A "#<id>" destination skips the name lookup and is a plain array index.
+    CampusId dest_id;
+    std::shared_ptr<ClientInfo> dest = find_destination(destination, dest_id);
+
+    if (dest) {
+        // Found the recipient, queue the TCP message for the I/O thread
+        if (enqueue_outbound(dest, format_routed_message(campus_table[sender->campus_id].from_prefix, content))) {
+            sender_counters.sent++;
+            campus_counters[dest_id].received++;
+            std::cout << "[SUCCESS] Routed to " << dest->campus_name << "." << std::endl;
         } else {
-            std::cout << "[SUCCESS] Routed to " << destination << "." << std::endl;
+            std::cerr << "[DROP] Message for " << destination << " discarded (outbound queue full)." << std::endl;
         }
     } else {
         // Recipient not found, inform the sender
-        auto sender_it = active_clients.find(sender_name);
-        if (sender_it != active_clients.end()) {
-            std::string error_msg = "SERVER: Error: Campus '" + destination + "' is not currently active.";
-            send(sender_it->second.tcp_socket, error_msg.c_str(), error_msg.length(), 0);
-        }
+        PooledString error_msg;
+        error_msg.append("SERVER: Error: Campus '").append(destination).append("' is not currently active.\n");
+        enqueue_outbound(sender, make_payload(std::move(error_msg)));
+        sender_counters.failed++;
         std::cerr << "[FAIL] Campus '" << destination << "' not found for routing." << std::endl;
     }
 }
 
+// ====================================================================
+//                   OUTBOUND QUEUES & BACKPRESSURE
+// ====================================================================
+
+static void wake_io_thread(const std::shared_ptr<ClientInfo>& client) {
+    {
+        std::lock_guard<std::mutex> lock(io_mutex);
+        io_ready.push_back(client);
+    }
+    uint64_t one = 1;
+    if (write(io_wake_fd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+        perror("[ERROR] Failed to wake I/O thread");
+    }
+}
+
+// Appends one length-prefixed record to the session's spill file (out_mutex held)
+static bool spill_record(ClientInfo& client, const PooledString& payload) {
+    if (client.spill_fd < 0) {
+        std::string path = std::string(SPILL_DIR) + "/ies-spill-XXXXXX";
+        std::vector<char> name(path.begin(), path.end());
+        name.push_back('\0');
+        client.spill_fd = mkstemp(name.data());
+        if (client.spill_fd < 0) {
+            perror("[ERROR] Failed to create spill file");
+            return false;
+        }
+        unlink(name.data()); // Anonymous: the space is reclaimed when the fd closes
+    }
+    uint32_t len = payload.size();
+    struct iovec iov[2] = {{&len, sizeof(len)}, {(void *)payload.data(), payload.size()}};
+    ssize_t written = pwritev(client.spill_fd, iov, 2, client.spill_write);
+    if (written != (ssize_t)(sizeof(len) + payload.size())) {
+        perror("[ERROR] Failed to spill message");
+        return false;
+    }
+    client.spill_write += written;
+    return true;
+}
+
+// Moves spilled records back into memory while there is room (out_mutex held)
+static void unspill_records(ClientInfo& client) {
+    while (client.spill_read < client.spill_write &&
+           (client.outbound.empty() ||
+            (client.queued_bytes < OUTBOUND_QUEUE_MAX_BYTES / 2 &&
+             outbound_total_bytes.load() < OUTBOUND_GLOBAL_MAX_BYTES / 2))) {
+        uint32_t len = 0;
+        if (pread(client.spill_fd, &len, sizeof(len), client.spill_read) != sizeof(len)) break;
+        PooledString payload(len, '\0');
+        if (pread(client.spill_fd, &payload[0], len, client.spill_read + sizeof(len)) != (ssize_t)len) break;
+        client.spill_read += sizeof(len) + len;
+        client.queued_bytes += len;
+        outbound_total_bytes += len;
+        // Spilled messages are numbered as they come back, which keeps sequence order
+        client.outbound.push_back({make_payload(std::move(payload)),
+                                   std::chrono::steady_clock::now(), client.resumable ? client.next_seq++ : 0});
+    }
+    if (client.spill_read >= client.spill_write && client.spill_write > 0) {
+        // Fully replayed: recycle the file from the start
+        if (ftruncate(client.spill_fd, 0) < 0) perror("[ERROR] Failed to truncate spill file");
+        client.spill_read = client.spill_write = 0;
+    }
+}
+
+// A gateway identity's frames travel in its gateway's queue as "@<identity>:<frame>",
+// so they share that connection's ordering, backpressure and resume stream
+static bool enqueue_via_gateway(const ClientInfo& identity, Payload payload, bool sequenced,
+                                std::shared_ptr<SplicedBody> body) {
+    std::shared_ptr<ClientInfo> gateway;
+    {
+        std::lock_guard<std::mutex> lock(clients_mutex);
+        if (active_clients[identity.campus_id].get() != &identity) return false; // Detached meanwhile
+        gateway = active_clients[identity.gateway];
+    }
+    if (!gateway) return false;
+    PooledString tagged;
+    tagged.reserve(identity.campus_name.size() + 2 + payload->size());
+    tagged.append("@").append(identity.campus_name).append(":").append(*payload);
+    return enqueue_outbound(gateway, make_payload(std::move(tagged)), sequenced, std::move(body));
+}
+
+// A spliced body cannot go to the spill file from its pipe; it is read back behind its
+// header into an ordinary payload first
+static Payload absorb_body(const Payload& payload, SplicedBody& body) {
+    PooledString joined(payload->size() + body.unsent, '\0');
+    std::copy(payload->begin(), payload->end(), joined.begin());
+    size_t offset = payload->size();
+    while (body.unsent > 0) {
+        ssize_t got = read(body.pipe_fds[0], &joined[offset], body.unsent);
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) break;
+        offset += got;
+        body.unsent -= got;
+    }
+    joined.resize(offset);
+    return make_payload(std::move(joined));
+}
+
+// Queues a payload for a destination, applying its backpressure policy when the
+// destination queue or the global cap is full. Returns false if the payload was discarded.
+// Unsequenced payloads (registration replies) are not part of the resumable stream.
+// A spliced 'body' (FILE chunks only, unsequenced) is written from its pipe after the payload.
+bool enqueue_outbound(const std::shared_ptr<ClientInfo>& dest, Payload payload, bool sequenced,
+                      std::shared_ptr<SplicedBody> body) {
+    if (dest->gateway != NO_CAMPUS) return enqueue_via_gateway(*dest, std::move(payload), sequenced, std::move(body));
+    size_t size = payload->size() + (body ? body->length : 0);
+    bool disconnect = false;
+    {
+        std::unique_lock<std::mutex> lock(dest->out_mutex);
+        auto has_room = [&] {
+            return dest->queued_bytes + size <= OUTBOUND_QUEUE_MAX_BYTES &&
+                   outbound_total_bytes.load() + size <= OUTBOUND_GLOBAL_MAX_BYTES;
+        };
+
+        // A detached session keeps queueing while it waits for its client to resume
+        if (dest->disconnecting || (dest->closed && !dest->detached)) return false;
+
+        // Once anything is spilled, later messages follow it to disk to keep ordering
+        if (dest->spill_write > dest->spill_read || (dest->policy == POLICY_SPILL && !has_room())) {
+            if (body) payload = absorb_body(payload, *body);
+            if (!spill_record(*dest, *payload)) return false;
+            if (dest->outbound.empty()) unspill_records(*dest);
+        } else {
+            // An empty queue always accepts one message, however large, so progress is possible
+            if (!has_room() && !dest->outbound.empty()) {
+                switch (dest->policy) {
+                case POLICY_BLOCK:
+                    if (dest->detached) {
+                        // Nobody is draining a detached queue; blocking would stall the sender
+                        dest->dropped++;
+                        return false;
+                    }
+                    dest->out_cv.wait(lock, [&] {
+                        return dest->closed || dest->disconnecting || has_room() || dest->outbound.empty();
+                    });
+                    if (dest->closed || dest->disconnecting) return false;
+                    break;
+                case POLICY_DROP_OLDEST:
+                    // The partially written front message must stay or the stream is corrupted
+                    while (!has_room() && dest->outbound.size() > (dest->send_offset > 0 ? 1u : 0u)) {
+                        auto victim = dest->send_offset > 0 ? dest->outbound.begin() + 1 : dest->outbound.begin();
+                        dest->queued_bytes -= victim->size();
+                        outbound_total_bytes -= victim->size();
+                        dest->outbound.erase(victim);
+                        dest->dropped++;
+                    }
+                    break;
+                case POLICY_DROP_NEWEST:
+                    dest->dropped++;
+                    return false;
+                case POLICY_DISCONNECT:
+                    disconnect = true; // Evicted below, once out_mutex is released
+                    break;
+                case POLICY_SPILL:
+                    break; // Handled above
+                }
+            }
+            if (disconnect) {
+                dest->dropped++;
+            } else {
+                dest->queued_bytes += size;
+                outbound_total_bytes += size;
+                uint64_t seq = sequenced && dest->resumable ? dest->next_seq++ : 0;
+                dest->outbound.push_back({std::move(payload), std::chrono::steady_clock::now(), seq, std::move(body)});
+            }
+        }
+    }
+
+    if (disconnect) {
+        evict_session(dest, "slow consumer");
+        return false;
+    }
+    wake_io_thread(dest);
+    return true;
+}
+
+// Session takeover on re-registration (clients_mutex held by the caller). The old
+// session's undelivered messages and spill file move to the replacement, and the old
+// connection is shut down; its handler then unregisters nothing, since the name now
+// belongs to a newer generation. A partially written message is resent whole.
+// When 'resume' is set the client presented the old session's token: the stream
+// continues with the same sequence numbers, and written-but-unacknowledged messages
+// after 'last_seq' are replayed first. Returns how many messages could not be replayed.
+uint64_t take_over_session(const std::shared_ptr<ClientInfo>& old_ptr, const std::shared_ptr<ClientInfo>& new_ptr,
+                           bool resume, uint64_t last_seq) {
+    ClientInfo& old_session = *old_ptr;
+    ClientInfo& new_session = *new_ptr;
+    uint64_t lost = 0;
+    {
+        std::lock_guard<std::mutex> old_lock(old_session.out_mutex);
+        std::lock_guard<std::mutex> new_lock(new_session.out_mutex);
+        if (old_session.disconnecting) return 0;
+
+        if (resume) {
+            new_session.session_token = old_session.session_token;
+            new_session.next_seq = old_session.next_seq;
+
+            // Replay what was written after the client's last received frame
+            uint64_t first_available = new_session.next_seq;
+            for (auto& message : old_session.unacked) {
+                if (message.seq <= last_seq) continue;
+                first_available = std::min(first_available, message.seq);
+                new_session.queued_bytes += message.payload->size();
+                outbound_total_bytes += message.payload->size();
+                new_session.outbound.push_back(std::move(message));
+            }
+            for (const auto& message : old_session.outbound) {
+                if (message.seq > last_seq) first_available = std::min(first_available, message.seq);
+            }
+            if (first_available > last_seq + 1) lost = first_available - last_seq - 1;
+        }
+        old_session.unacked.clear();
+        old_session.unacked_bytes = 0;
+
+        // A front chunk whose spliced body is partly written cannot be resent whole; the
+        // receiver asks for it again from the offset it has
+        if (!old_session.outbound.empty() && old_session.outbound.front().body &&
+            old_session.send_offset > old_session.outbound.front().payload->size()) {
+            old_session.queued_bytes -= old_session.outbound.front().size();
+            outbound_total_bytes -= old_session.outbound.front().size();
+            old_session.outbound.pop_front();
+            old_session.dropped++;
+        }
+        for (auto& message : old_session.outbound) {
+            // A fresh registration starts a new stream, so inherited messages are renumbered
+            if (!resume) message.seq = new_session.resumable && message.seq ? new_session.next_seq++ : 0;
+            new_session.outbound.push_back(std::move(message));
+        }
+        new_session.queued_bytes += old_session.queued_bytes; // Global total is unchanged
+        old_session.outbound.clear();
+        old_session.queued_bytes = 0;
+        old_session.send_offset = 0;
+
+        if (old_session.spill_fd >= 0 && new_session.spill_fd < 0) {
+            new_session.spill_fd = old_session.spill_fd;
+            new_session.spill_read = old_session.spill_read;
+            new_session.spill_write = old_session.spill_write;
+            old_session.spill_fd = -1;
+            old_session.spill_read = old_session.spill_write = 0;
+        }
+
+        // Under out_mutex, so the I/O thread cannot have closed the fd yet (a gateway
+        // identity has none)
+        if (!old_session.closed && old_session.tcp_socket >= 0) shutdown(old_session.tcp_socket, SHUT_RDWR);
+        old_session.disconnecting = true;
+        old_session.end_reason = (resume ? "resumed as session " : "replaced by session ") +
+                                 std::to_string(new_session.generation);
+    }
+    old_session.out_cv.notify_all();
+    wake_io_thread(new_ptr); // Flush the inherited queue on the new connection
+    wake_io_thread(old_ptr);
+    return lost;
+}
+
+// Removes a broken or unwanted session right away so no routing or fan-out work is
+// spent on it. Its handler sees the shutdown, unregisters and hands the socket back.
+// With 'allow_resume', a resumable session only loses its connection: it stays
+// registered and keeps its queue, and its handler detaches it for RESUME_GRACE_MS.
+void evict_session(const std::shared_ptr<ClientInfo>& client, const std::string& reason, bool allow_resume) {
+    if (allow_resume) {
+        std::lock_guard<std::mutex> lock(client->out_mutex);
+        if (client->resumable && !client->closed && !client->disconnecting) {
+            if (!client->detach_pending) {
+                shutdown(client->tcp_socket, SHUT_RDWR);
+                client->detach_pending = true;
+                client->end_reason = "connection lost: " + reason;
+                std::cerr << "[DETACH] Session '" << client->campus_name << "' lost its connection (" << reason << ")." << std::endl;
+            }
+            return;
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(clients_mutex);
+        std::shared_ptr<ClientInfo>& entry = active_clients[client->campus_id];
+        if (entry && entry->generation == client->generation) {
+            entry.reset();
+            active_count--;
+            release_identities(client->campus_id);
+            std::lock_guard<std::mutex> broadcast_lock(broadcast_mutex);
+            broadcast_dests.erase(client->campus_id);
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(client->out_mutex);
+        if (client->closed || client->disconnecting) return;
+        // Under out_mutex, so the I/O thread cannot have closed the fd yet
+        shutdown(client->tcp_socket, SHUT_RDWR);
+        client->disconnecting = true;
+        client->end_reason = "evicted: " + reason;
+        outbound_total_bytes -= client->queued_bytes;
+        client->dropped += client->outbound.size();
+        client->queued_bytes = 0;
+        client->send_offset = 0;
+        client->outbound.clear();
+    }
+    client->out_cv.notify_all();
+    std::cerr << "[EVICT] Session '" << client->campus_name << "' evicted (" << reason << ")." << std::endl;
+}
+
+// Marks the session finished; the I/O thread discards its queue and closes the socket
+void close_session(const std::shared_ptr<ClientInfo>& client) {
+    {
+        std::lock_guard<std::mutex> lock(client->out_mutex);
+        client->closed = true;
+    }
+    client->out_cv.notify_all();
+    wake_io_thread(client);
+}
+
+enum FlushResult { FLUSH_DONE, FLUSH_COMPLETIONS, FLUSH_PENDING, FLUSH_FAILED };
+
+// Collects MSG_ZEROCOPY completions from the socket's error queue and drops the payload
+// references they release, so pooled buffers go back once the kernel is done with them
+// (out_mutex held). A completion saying the kernel copied after all (loopback does)
+// ends zero-copy sends for the session: that deferred copy costs more than a plain send.
+void reap_zerocopy_completions(ClientInfo& client) {
+    int sock = client.tcp_socket >= 0 ? client.tcp_socket : client.linger_socket;
+    if (client.zerocopy_inflight.empty() || sock < 0) return;
+    char control[CMSG_SPACE(sizeof(struct sock_extended_err)) + 64];
+    while (true) {
+        struct msghdr msg = {};
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        if (recvmsg(sock, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) break; // Queue empty
+        for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+            if (cmsg->cmsg_level != SOL_IP || cmsg->cmsg_type != IP_RECVERR) continue;
+            struct sock_extended_err err;
+            memcpy(&err, CMSG_DATA(cmsg), sizeof(err));
+            if (err.ee_errno != 0 || err.ee_origin != SO_EE_ORIGIN_ZEROCOPY) continue;
+            // Send calls ee_info..ee_data (inclusive; the numbers wrap) are complete
+            uint32_t span = err.ee_data - err.ee_info;
+            for (ZeroCopySend& send : client.zerocopy_inflight) {
+                if (send.id - err.ee_info <= span) send.done = true;
+            }
+            if (err.ee_code & SO_EE_CODE_ZEROCOPY_COPIED) {
+                zerocopy_copied += span + 1;
+                client.zerocopy = false;
+            } else {
+                zerocopy_hits += span + 1;
+            }
+        }
+    }
+    while (!client.zerocopy_inflight.empty() && client.zerocopy_inflight.front().done) {
+        client.zerocopy_inflight.pop_front();
+    }
+}
+
+// A payload of at least zerocopy_min_bytes is written on its own with MSG_ZEROCOPY
+static bool use_zerocopy(const ClientInfo& client, const OutboundMessage& message) {
+    size_t threshold = zerocopy_min_bytes.load(std::memory_order_relaxed);
+    return client.zerocopy && threshold > 0 && !message.body && message.payload->size() >= threshold;
+}
+
+// Writes as much of the session's queue as the socket accepts without blocking.
+// FLUSH_PENDING means data remains and the socket must be watched for EPOLLOUT;
+// FLUSH_COMPLETIONS means all is written but zero-copy completions are outstanding;
+// FLUSH_FAILED (EPIPE, ECONNRESET, ...) means the peer is gone and errno says why.
+static FlushResult flush_outbound(ClientInfo& client) {
+    std::lock_guard<std::mutex> lock(client.out_mutex);
+    reap_zerocopy_completions(client);
+    if (client.disconnecting || client.detach_pending || client.closed) return FLUSH_DONE;
+    bool refused = false; // The kernel turned MSG_ZEROCOPY down during this flush
+    while (!client.outbound.empty()) {
+        ssize_t written;
+        OutboundMessage& first = client.outbound.front();
+        char first_header[24];
+        size_t first_header_len = first.seq ? snprintf(first_header, sizeof(first_header), "#%llu ", (unsigned long long)first.seq) : 0;
+        if (first.body && client.send_offset >= first.payload->size()) {
+            // The chunk header is out; its body goes from the relay pipe to the socket
+            written = splice(first.body->pipe_fds[0], nullptr, client.tcp_socket, nullptr, first.body->unsent,
+                             SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+            if (written > 0) first.body->unsent -= written;
+        } else if (!refused && use_zerocopy(client, first) && client.send_offset >= first_header_len) {
+            // The kernel sends straight from the payload's pages, so it stays referenced
+            // (and unchanged: payloads are immutable) until the completion arrives
+            size_t skip = client.send_offset - first_header_len;
+            struct iovec iov = {(void *)(first.payload->data() + skip), first.payload->size() - skip};
+            struct msghdr msg = {};
+            msg.msg_iov = &iov;
+            msg.msg_iovlen = 1;
+            written = sendmsg(client.tcp_socket, &msg, MSG_DONTWAIT | MSG_NOSIGNAL | MSG_ZEROCOPY);
+            if (written >= 0) {
+                client.zerocopy_inflight.push_back({client.zerocopy_next++, first.payload, false});
+                zerocopy_sends++;
+                zerocopy_bytes += written;
+            } else if (errno == ENOBUFS) {
+                // Too many pages pinned for this socket (optmem); copy until the next flush
+                zerocopy_refused++;
+                refused = true;
+                continue;
+            }
+        } else {
+            // Sequenced frames go out as "#<seq> <payload>"; the header is its own iovec.
+            // Gathering stops after a payload with a spliced body, which is written next,
+            // and before a zero-copy payload, which is written alone (its header is not:
+            // it lives on this stack, where the kernel must not keep reading it).
+            struct iovec iov[2 * OUTBOUND_IOV_MAX];
+            char headers[OUTBOUND_IOV_MAX][24];
+            size_t iov_count = 0, count = 0;
+            size_t skip = client.send_offset;  // Offset into the front message's header + payload
+            int more = 0;
+            for (auto it = client.outbound.begin(); it != client.outbound.end() && count < OUTBOUND_IOV_MAX; ++it, ++count) {
+                bool alone = !refused && use_zerocopy(client, *it);
+                if (alone && it != client.outbound.begin()) break;
+                size_t header_len = it->seq ? snprintf(headers[count], sizeof(headers[count]), "#%llu ", (unsigned long long)it->seq) : 0;
+                if (skip < header_len) {
+                    iov[iov_count++] = {headers[count] + skip, header_len - skip};
+                    skip = 0;
+                } else {
+                    skip -= header_len;
+                }
+                if (alone) {
+                    more = MSG_MORE; // The payload follows at once
+                    break;
+                }
+                iov[iov_count++] = {(void *)(it->payload->data() + skip), it->payload->size() - skip};
+                skip = 0;
+                if (it->body) break;
+            }
+
+            struct msghdr msg = {};
+            msg.msg_iov = iov;
+            msg.msg_iovlen = iov_count;
+            written = sendmsg(client.tcp_socket, &msg, MSG_DONTWAIT | MSG_NOSIGNAL | more);
+        }
+        if (written < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return FLUSH_PENDING;
+            if (errno == EINTR) continue;
+            return FLUSH_FAILED;
+        }
+
+        // Retire fully written messages and remember where the partial one stopped
+        size_t remaining = written;
+        while (remaining > 0) {
+            OutboundMessage& front = client.outbound.front();
+            char header[24];
+            size_t header_len = front.seq ? snprintf(header, sizeof(header), "#%llu ", (unsigned long long)front.seq) : 0;
+            size_t left_in_front = header_len + front.size() - client.send_offset;
+            if (remaining < left_in_front) {
+                client.send_offset += remaining;
+                break;
+            }
+            remaining -= left_in_front;
+            client.queued_bytes -= front.size();
+            outbound_total_bytes -= front.size();
+            if (front.seq) {
+                // Kept (bounded) until acknowledged, so a resuming client can get it again
+                client.unacked_bytes += front.payload->size();
+                client.unacked.push_back(std::move(front));
+                while (client.unacked_bytes > RESUME_RETAIN_BYTES) {
+                    client.unacked_bytes -= client.unacked.front().payload->size();
+                    client.unacked.pop_front();
+                }
+            }
+            client.outbound.pop_front();
+            client.send_offset = 0;
+        }
+        client.out_cv.notify_all();
+        if (client.spill_fd >= 0) unspill_records(client);
+    }
+    return client.zerocopy_inflight.empty() ? FLUSH_DONE : FLUSH_COMPLETIONS;
+}
+
+// Releases everything a finished session still holds (called on the I/O thread only)
+// A detached session only loses its socket; its queue waits for the client to resume.
+// True if the socket lingers for zero-copy completions (see finish_lingering).
+static bool destroy_session(ClientInfo& client) {
+    std::lock_guard<std::mutex> lock(client.out_mutex);
+    bool lingers = false;
+    if (client.tcp_socket >= 0) {
+        epoll_ctl(io_epoll_fd, EPOLL_CTL_DEL, client.tcp_socket, nullptr);
+        // The kernel may still read the pages of zero-copy sends that have not completed,
+        // and their completions can only be read while the socket is open. It is shut
+        // down instead (the peer still gets what was written) and closed once they are in.
+        reap_zerocopy_completions(client);
+        if (client.zerocopy_inflight.empty()) {
+            close(client.tcp_socket);
+        } else {
+            shutdown(client.tcp_socket, SHUT_RDWR);
+            client.linger_socket = client.tcp_socket;
+            client.linger_deadline_ms = steady_ms() + ZEROCOPY_LINGER_MS;
+            lingers = true;
+        }
+        client.tcp_socket = -1;
+    }
+    if (client.detached && !client.disconnecting) return lingers;
+    outbound_total_bytes -= client.queued_bytes;
+    client.queued_bytes = 0;
+    client.outbound.clear();
+    client.unacked.clear();
+    client.unacked_bytes = 0;
+    if (client.spill_fd >= 0) close(client.spill_fd);
+    client.spill_fd = -1;
+    return lingers;
+}
+
+// Closes an ended session's lingering socket once its zero-copy sends have completed;
+// false while it has to wait. At the deadline it is closed abortively (SO_LINGER 0):
+// the kernel then drops the data with the connection instead of sending it from the
+// pages later, so the payloads can go.
+static bool finish_lingering(ClientInfo& client) {
+    std::lock_guard<std::mutex> lock(client.out_mutex);
+    reap_zerocopy_completions(client);
+    if (!client.zerocopy_inflight.empty()) {
+        if (steady_ms() < client.linger_deadline_ms) return false;
+        struct linger abort_close = {1, 0};
+        setsockopt(client.linger_socket, SOL_SOCKET, SO_LINGER, &abort_close, sizeof(abort_close));
+        zerocopy_aborted += client.zerocopy_inflight.size();
+    }
+    close(client.linger_socket);
+    client.linger_socket = -1;
+    client.zerocopy_inflight.clear();
+    return true;
+}
+
+// Heartbeat: a session that has sent us nothing for a whole interval gets a HEARTBEAT
+// frame, however busy its inbound direction is, so a campus that only receives still
+// answers before the idle check. Writing is also what lets TCP_USER_TIMEOUT catch a
+// vanished peer. At most one probe waits in the queue at a time.
+static void heartbeat_due(TimerWheel& wheel, const std::shared_ptr<ClientInfo>& client) {
+    static const auto heartbeat = make_payload(std::string_view("HEARTBEAT\n"));
+    auto now = std::chrono::steady_clock::now();
+    int64_t quiet_ms = steady_ms() - client->last_recv_ms.load();
+    {
+        std::lock_guard<std::mutex> lock(client->out_mutex);
+        if (quiet_ms >= HEARTBEAT_INTERVAL_MS && !client->disconnecting && !client->closed &&
+            (client->outbound.empty() || client->outbound.back().payload != heartbeat)) {
+            // Queued directly: the I/O thread must never block on a backpressure policy
+            client->queued_bytes += heartbeat->size();
+            outbound_total_bytes += heartbeat->size();
+            client->outbound.push_back({heartbeat, now, 0});
+        }
+    }
+    wheel.schedule(client->heartbeat_timer, quiet_ms >= HEARTBEAT_INTERVAL_MS ? HEARTBEAT_INTERVAL_MS
+                                                                              : HEARTBEAT_INTERVAL_MS - quiet_ms);
+    wake_io_thread(client);
+}
+
+// Idle reaping: clients answer heartbeats, so a session that has sent nothing at all
+// for IDLE_TIMEOUT_MS is hung or gone
+static void idle_check_due(TimerWheel& wheel, const std::shared_ptr<ClientInfo>& client) {
+    int64_t idle_ms = steady_ms() - client->last_recv_ms.load();
+    if (idle_ms >= IDLE_TIMEOUT_MS) {
+        evict_session(client, "idle timeout", true);
+    } else {
+        wheel.schedule(client->idle_timer, IDLE_TIMEOUT_MS - idle_ms);
+    }
+}
+
+// Arms the TTL timer for the oldest queued message if it is not armed already
+static void arm_expiry(TimerWheel& wheel, ClientInfo& client) {
+    if (client.expiry_timer.armed()) return;
+    std::lock_guard<std::mutex> lock(client.out_mutex);
+    if (client.outbound.empty() || client.disconnecting) return;
+    auto age = std::chrono::steady_clock::now() - client.outbound.front().queued_at;
+    int64_t remaining = MESSAGE_TTL_MS - std::chrono::duration_cast<std::chrono::milliseconds>(age).count();
+    wheel.schedule(client.expiry_timer, remaining);
+}
+
+// Message TTL: drops queued messages older than MESSAGE_TTL_MS. Queues are FIFO, so
+// only the front needs checking; a partially written front message is kept.
+static void expiry_due(TimerWheel& wheel, const std::shared_ptr<ClientInfo>& client) {
+    auto cutoff = std::chrono::steady_clock::now() - std::chrono::milliseconds(MESSAGE_TTL_MS);
+    size_t expired = 0;
+    {
+        std::lock_guard<std::mutex> lock(client->out_mutex);
+        size_t first = client->send_offset > 0 ? 1 : 0;
+        while (client->outbound.size() > first && client->outbound[first].queued_at <= cutoff) {
+            size_t size = client->outbound[first].size();
+            client->queued_bytes -= size;
+            outbound_total_bytes -= size;
+            client->outbound.erase(client->outbound.begin() + first);
+            expired++;
+        }
+        client->expired += expired;
+    }
+    if (expired > 0) {
+        client->out_cv.notify_all();
+        std::cerr << "[TTL] Expired " << expired << " undelivered message(s) for '" << client->campus_name << "'." << std::endl;
+    }
+    arm_expiry(wheel, *client);
+}
+
+// Resume grace period over: the detached session ends for good
+static void grace_expired(const std::shared_ptr<ClientInfo>& client) {
+    {
+        std::lock_guard<std::mutex> lock(clients_mutex);
+        std::shared_ptr<ClientInfo>& entry = active_clients[client->campus_id];
+        if (entry == client) {
+            entry.reset();
+            active_count--;
+            release_identities(client->campus_id);
+        }
+    }
+    size_t queued;
+    {
+        std::lock_guard<std::mutex> lock(client->out_mutex);
+        if (!client->detached || client->disconnecting) return;
+        client->disconnecting = true;
+        client->end_reason = "not resumed in time";
+        queued = client->outbound.size();
+    }
+    client->out_cv.notify_all();
+    std::cerr << "[DETACH] Session '" << client->campus_name << "' was not resumed within " << RESUME_GRACE_MS
+              << " ms; " << queued << " queued message(s) discarded." << std::endl;
+    wake_io_thread(client);
+}
+
+// Hands a freshly accepted socket to the I/O thread for the registration phase
+void admit_connection(int client_sock, struct sockaddr_in client_addr) {
+    auto registration = std::allocate_shared<PendingRegistration>(PoolAllocator<PendingRegistration>());
+    registration->socket = client_sock;
+    registration->addr = client_addr;
+    pending_registrations++;
+    {
+        std::lock_guard<std::mutex> lock(io_mutex);
+        io_accepted.push_back(std::move(registration));
+    }
+    uint64_t one = 1;
+    if (write(io_wake_fd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+        perror("[ERROR] Failed to wake I/O thread");
+    }
+}
+
+enum RegistrationRead { REGISTRATION_INCOMPLETE, REGISTRATION_COMPLETE, REGISTRATION_FAILED };
+
+// Reads what the (non-blocking) socket has, up to BUFFER_SIZE bytes in all; complete once
+// a '\n' has arrived. Bytes after it are left for the handler, so a peer that keeps
+// streaming cannot hold the I/O thread here.
+static RegistrationRead read_registration(PendingRegistration& registration) {
+    char buffer[BUFFER_SIZE];
+    while (true) {
+        size_t room = BUFFER_SIZE - registration.received.size();
+        if (room == 0) return REGISTRATION_FAILED; // No '\n' within BUFFER_SIZE bytes
+        ssize_t bytes = recv(registration.socket, buffer, room, 0);
+        if (bytes > 0) {
+            registration.received.append(buffer, bytes);
+            if (memchr(buffer, '\n', bytes)) return REGISTRATION_COMPLETE;
+            continue;
+        }
+        if (bytes < 0 && errno == EINTR) continue;
+        if (bytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return REGISTRATION_INCOMPLETE;
+        return REGISTRATION_FAILED; // EOF or error before registering
+    }
+}
+
+// First sight of a new session on the I/O thread: start its heartbeat and idle timers
+static void start_session_timers(TimerWheel& wheel, const std::shared_ptr<ClientInfo>& client) {
+    std::weak_ptr<ClientInfo> weak = client;
+    client->heartbeat_timer.callback = [&wheel, weak] {
+        if (auto session = weak.lock()) heartbeat_due(wheel, session);
+    };
+    client->idle_timer.callback = [&wheel, weak] {
+        if (auto session = weak.lock()) idle_check_due(wheel, session);
+    };
+    client->expiry_timer.callback = [&wheel, weak] {
+        if (auto session = weak.lock()) expiry_due(wheel, session);
+    };
+    client->grace_timer.callback = [weak] {
+        if (auto session = weak.lock()) grace_expired(session);
+    };
+    wheel.schedule(client->heartbeat_timer, HEARTBEAT_INTERVAL_MS);
+    wheel.schedule(client->idle_timer, IDLE_TIMEOUT_MS);
+}
+
+static void cancel_session_timers(TimerWheel& wheel, ClientInfo& client) {
+    wheel.cancel(client.heartbeat_timer);
+    wheel.cancel(client.idle_timer);
+    wheel.cancel(client.expiry_timer);
+    wheel.cancel(client.grace_timer);
+}
+
+void outbound_io_loop() {
+    // Live sessions the I/O thread knows about (keeps them alive while timers are armed)
+    std::map<ClientInfo *, std::shared_ptr<ClientInfo>> sessions;
+    // Sessions currently registered with epoll for EPOLLOUT: Key = socket fd
+    std::map<int, std::shared_ptr<ClientInfo>> watched;
+    // Connections in the registration phase, watched for EPOLLIN: Key = socket fd
+    std::map<int, std::shared_ptr<PendingRegistration>> registering;
+    std::vector<int> expired_registrations;   // Filled by deadline timers during advance()
+    // Ended sessions whose sockets wait for zero-copy completions (see finish_lingering)
+    std::vector<std::shared_ptr<ClientInfo>> lingering;
+    TimerWheel wheel;
+    struct epoll_event events[64];
+
+    // Leaves the registration phase: either to a handler thread or closed
+    // By value: erasing the map entry must not destroy the registration while it is in use
+    auto finish_registration = [&](std::shared_ptr<PendingRegistration> registration, bool registered) {
+        epoll_ctl(io_epoll_fd, EPOLL_CTL_DEL, registration->socket, nullptr);
+        wheel.cancel(registration->deadline);
+        registering.erase(registration->socket);
+        pending_registrations--;
+        if (!registered) {
+            close(registration->socket);
+            return;
+        }
+        std::thread client_thread(handle_client, registration->socket, registration->addr, std::move(registration->received));
+        client_thread.detach(); // Detach the thread to run independently
+    };
+
+    while (true) {
+        int ready = epoll_wait(io_epoll_fd, events, 64, wheel.ms_until_next_tick(std::chrono::steady_clock::now()));
+        if (ready < 0) {
+            if (errno != EINTR) perror("[ERROR] epoll_wait failed");
+            ready = 0;
+        }
+
+        std::vector<std::shared_ptr<ClientInfo>> work;
+        std::vector<std::shared_ptr<PendingRegistration>> accepted;
+        for (int i = 0; i < ready; ++i) {
+            int fd = events[i].data.fd;
+            if (fd == io_wake_fd) {
+                uint64_t count;
+                while (read(io_wake_fd, &count, sizeof(count)) > 0) {}
+                std::lock_guard<std::mutex> lock(io_mutex);
+                work.insert(work.end(), io_ready.begin(), io_ready.end());
+                io_ready.clear();
+                accepted.swap(io_accepted);
+            } else if (registering.count(fd)) {
+                auto registration = registering[fd];
+                RegistrationRead result = read_registration(*registration);
+                if (result != REGISTRATION_INCOMPLETE) {
+                    if (result == REGISTRATION_FAILED) {
+                        std::cerr << "[ERROR] Client failed to register name/port. Closing socket." << std::endl;
+                    }
+                    finish_registration(registration, result == REGISTRATION_COMPLETE);
+                }
+            } else {
+                auto it = watched.find(fd);
+                if (it != watched.end()) work.push_back(it->second);
+            }
+        }
+
+        for (const auto& registration : accepted) {
+            int fd = registration->socket;
+            // Non-blocking for the rest of the connection (the handler waits in poll)
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+            struct epoll_event event = {};
+            event.events = EPOLLIN | EPOLLRDHUP;
+            event.data.fd = fd;
+            epoll_ctl(io_epoll_fd, EPOLL_CTL_ADD, fd, &event);
+            registering[fd] = registration;
+            registration->deadline.callback = [&expired_registrations, fd] { expired_registrations.push_back(fd); };
+            wheel.schedule(registration->deadline, REGISTRATION_TIMEOUT_MS);
+        }
+
+        for (const auto& client : work) {
+            int fd = client->tcp_socket;
+            bool closed, detached;
+            {
+                std::lock_guard<std::mutex> lock(client->out_mutex);
+                closed = client->closed;
+                detached = client->detached && !client->disconnecting;
+            }
+            if (closed) {
+                if (fd >= 0) watched.erase(fd);
+                if (detached) {
+                    // No connection to write to: keep the queue and its TTL until the grace period ends
+                    if (destroy_session(*client)) lingering.push_back(client);
+                    if (sessions.emplace(client.get(), client).second) start_session_timers(wheel, client);
+                    wheel.cancel(client->heartbeat_timer);
+                    wheel.cancel(client->idle_timer);
+                    if (!client->grace_timer.armed()) wheel.schedule(client->grace_timer, RESUME_GRACE_MS);
+                    arm_expiry(wheel, *client);
+                    continue;
+                }
+                cancel_session_timers(wheel, *client);
+                sessions.erase(client.get());
+                if (destroy_session(*client)) lingering.push_back(client);
+                continue;
+            }
+
+            if (sessions.emplace(client.get(), client).second) {
+                start_session_timers(wheel, client);
+            }
+
+            FlushResult result = flush_outbound(*client);
+            if (result == FLUSH_FAILED) {
+                evict_session(client, strerror(errno), true);
+                result = FLUSH_DONE;
+            }
+            arm_expiry(wheel, *client);
+
+            // EPOLLOUT while data waits. With only zero-copy completions outstanding the
+            // socket stays registered for no events: EPOLLERR is reported regardless.
+            bool watch = result == FLUSH_PENDING || result == FLUSH_COMPLETIONS;
+            uint32_t events = result == FLUSH_PENDING ? (uint32_t)EPOLLOUT : 0;
+            if (watch && (!watched.count(fd) || client->io_events != events)) {
+                struct epoll_event event = {};
+                event.events = events;
+                event.data.fd = fd;
+                epoll_ctl(io_epoll_fd, watched.count(fd) ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, fd, &event);
+                watched[fd] = client;
+                client->io_events = events;
+            } else if (!watch && watched.count(fd)) {
+                epoll_ctl(io_epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+                watched.erase(fd);
+            }
+        }
+
+        wheel.advance(std::chrono::steady_clock::now());
+        lingering.erase(std::remove_if(lingering.begin(), lingering.end(),
+                                       [](const std::shared_ptr<ClientInfo>& client) { return finish_lingering(*client); }),
+                        lingering.end());
+
+        // Deadlines that fired in the same tick are closed together
+        if (!expired_registrations.empty()) {
+            for (int fd : expired_registrations) {
+                auto it = registering.find(fd);
+                if (it != registering.end()) finish_registration(it->second, false);
+            }
+            std::cerr << "[TIMEOUT] Closed " << expired_registrations.size()
+                      << " connection(s) that did not register within " << REGISTRATION_TIMEOUT_MS << " ms." << std::endl;
+            expired_registrations.clear();
+        }
+    }
+}
+
 // ====================================================================
 //                          BROADCAST LOGIC
 // ====================================================================
 
-void send_udp_broadcast(const std::string& message) {
-    std::lock_guard<std::mutex> lock(clients_mutex);
-    
+// Returns the number of destinations the message was queued for. The destination
+// snapshot lives in the caller's scratch arena.
+int send_udp_broadcast(Payload payload, Arena& scratch) {
+    // Snapshot the destinations so the pacer never holds clients_mutex while sending
+    ArenaVector<std::pair<CampusId, struct sockaddr_in>> targets{ArenaAllocator<char>(scratch)};
+    {
+        std::lock_guard<std::mutex> lock(clients_mutex);
+        targets.reserve(active_count);
+        CampusId count = campus_count.load(std::memory_order_acquire);
+        for (CampusId id = 0; id < count; ++id) {
+            // Gateway identities have no UDP port; their gateway gets the broadcast once
+            if (active_clients[id] && active_clients[id]->gateway == NO_CAMPUS) {
+                targets.push_back({id, active_clients[id]->udp_addr});
+            }
+        }
+    }
+
     std::cout << "\n--- STARTING UDP BROADCAST ---" << std::endl;
-    std::cout << "Message: " << message << std::endl;
-
-    int success_count = 0;
-    int fail_count = 0;
-
-    for (const auto& pair : active_clients) {
-        const ClientInfo& client = pair.second;
-        // Broadcast messages are sent as UDP datagrams
-        if (sendto(udp_broadcast_socket, 
-                   message.c_str(), 
-                   message.length(), 
-                   0, 
-                   (const struct sockaddr *)&client.udp_addr, 
-                   sizeof(client.udp_addr)) < 0) 
-        {
-            std::cerr << "[UDP FAIL] Failed to send to " << pair.first << std::endl;
-            fail_count++;
-        } else {
-            // std::cout << "[UDP SENT] to " << pair.first << std::endl;
-            success_count++;
+    std::cout << "Message: " << *payload << std::endl;
+
+    // One shared copy of the payload is queued to every destination
+    auto now = std::chrono::steady_clock::now();
+    {
+        std::lock_guard<std::mutex> lock(broadcast_mutex);
+        auto flush_at = now + std::chrono::milliseconds(broadcast_coalesce_ms);
+        for (const auto& target : targets) {
+            auto it = broadcast_dests.find(target.first);
+            if (it == broadcast_dests.end()) {
+                it = broadcast_dests.emplace(target.first, BroadcastDest{target.second, {}, BROADCAST_BURST, now, flush_at}).first;
+            }
+            BroadcastDest& dest = it->second;
+            // The first record of a burst opens the window; later ones ride along with it
+            if (dest.pending.empty()) dest.flush_at = flush_at;
+            dest.udp_addr = target.second;
+            dest.pending.push_back(payload);
         }
     }
-    
+    broadcast_cv.notify_one();
+
     std::cout << "--- BROADCAST SUMMARY ---" << std::endl;
-    std::cout << "Total Active Clients: " << active_clients.size() << std::endl;
-    std::cout << "Sent Successfully: " << success_count << std::endl;
+    std::cout << "Total Active Clients: " << targets.size() << std::endl;
+    std::cout << "Queued for Paced Sending: " << targets.size() << std::endl;
     std::cout << "---------------------------\n" << std::endl;
+    return (int)targets.size();
+}
+
+// Sends a batch of datagrams to one destination in as few syscalls as possible.
+// The batch is cut into runs of equal-sized datagrams (the last of a run may be shorter,
+// as the kernel allows); with GSO each run travels as one super-datagram segmented by the
+// kernel, and every run goes out in a single sendmmsg call. Nothing is padded or copied.
+// A datagram larger than BROADCAST_MTU is always sent on its own, unsegmented, so that
+// IP may fragment it: a gso_size above the path MTU would fail the whole call.
+// Returns the number of datagrams handed to the kernel.
+static int send_datagram_batch(const struct sockaddr_in& addr, const std::vector<Payload>& batch) {
+    if (batch.size() == 1) {
+        const PooledString& msg = *batch.front();
+        return sendto(udp_broadcast_socket, msg.data(), msg.size(), 0,
+                      (const struct sockaddr *)&addr, sizeof(addr)) < 0 ? 0 : 1;
+    }
+
+    struct Run {
+        size_t first, count, seg_size;
+    };
+    const size_t control_size = CMSG_SPACE(sizeof(uint16_t));
+
+    std::vector<struct iovec> iovs(batch.size());
+    for (size_t i = 0; i < batch.size(); ++i) iovs[i] = {(void *)batch[i]->data(), batch[i]->size()};
+
+    int datagrams = 0;
+    size_t start = 0; // First datagram not yet handed to the kernel
+    while (true) {
+        std::vector<Run> runs;
+        for (size_t i = start; i < batch.size(); ) {
+            Run run{i, 1, batch[i]->size()};
+            if (udp_gso_supported && run.seg_size <= BROADCAST_MTU) {
+                while (run.first + run.count < batch.size()) {
+                    size_t next = batch[run.first + run.count]->size();
+                    if (next > run.seg_size) break;
+                    ++run.count;
+                    if (next < run.seg_size) break; // A short segment can only end a run
+                }
+            }
+            runs.push_back(run);
+            i += run.count;
+        }
+
+        std::vector<struct mmsghdr> msgs(runs.size());
+        std::vector<char> control(runs.size() * control_size, 0);
+        for (size_t r = 0; r < runs.size(); ++r) {
+            struct msghdr& hdr = msgs[r].msg_hdr;
+            memset(&msgs[r], 0, sizeof(msgs[r]));
+            hdr.msg_name = (void *)&addr;
+            hdr.msg_namelen = sizeof(addr);
+            hdr.msg_iov = &iovs[runs[r].first];
+            hdr.msg_iovlen = runs[r].count;
+            if (runs[r].count > 1) {
+                hdr.msg_control = &control[r * control_size];
+                hdr.msg_controllen = control_size;
+                struct cmsghdr *cm = CMSG_FIRSTHDR(&hdr);
+                cm->cmsg_level = SOL_UDP;
+                cm->cmsg_type = UDP_SEGMENT;
+                cm->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+                uint16_t gso_size = (uint16_t)runs[r].seg_size;
+                memcpy(CMSG_DATA(cm), &gso_size, sizeof(gso_size));
+            }
+        }
+
+        // sendmmsg stops at the first message that fails; the runs after it are sent again
+        size_t done = 0;
+        bool unsegment = false;
+        while (done < msgs.size()) {
+            int sent = sendmmsg(udp_broadcast_socket, &msgs[done], msgs.size() - done, 0);
+            if (sent < 0) {
+                // EIO means the egress device cannot segment; stop trying GSO and resend unsegmented.
+                if (errno == EIO && udp_gso_supported && runs[done].count > 1) {
+                    udp_gso_supported = false;
+                    unsegment = true;
+                    break;
+                }
+                done++; // Only this run is lost
+                continue;
+            }
+            for (int r = 0; r < sent; ++r) datagrams += (int)runs[done + r].count;
+            done += sent;
+        }
+        if (!unsegment) return datagrams;
+        start = runs[done].first;
+    }
+}
+
+// Pops as many queued records as fit in one BROADCAST_MTU datagram, joined by '\n'.
+// A lone record (or one already larger than the MTU) is sent as-is without copying.
+static Payload coalesce_records(std::deque<Payload>& pending) {
+    Payload first = pending.front();
+    pending.pop_front();
+    if (pending.empty() || first->size() + 1 + pending.front()->size() > BROADCAST_MTU) {
+        return first;
+    }
+
+    PooledString packed;
+    packed.reserve(BROADCAST_MTU);
+    packed.append(*first);
+    while (!pending.empty() && packed.size() + 1 + pending.front()->size() <= BROADCAST_MTU) {
+        packed.push_back('\n');
+        packed.append(*pending.front());
+        pending.pop_front();
+    }
+    return make_payload(std::move(packed));
+}
+
+void broadcast_sender_loop() {
+    using clock = std::chrono::steady_clock;
+
+    struct Batch {
+        CampusId campus;
+        struct sockaddr_in addr;
+        std::vector<Payload> datagrams;
+    };
+
+    while (true) {
+        std::vector<Batch> batches;
+        {
+            std::unique_lock<std::mutex> lock(broadcast_mutex);
+            broadcast_cv.wait(lock, [] {
+                for (const auto& pair : broadcast_dests) {
+                    if (!pair.second.pending.empty()) return true;
+                }
+                return false;
+            });
+
+            auto now = clock::now();
+            auto next_wake = clock::time_point::max();
+
+            for (auto it = broadcast_dests.begin(); it != broadcast_dests.end(); ) {
+                BroadcastDest& dest = it->second;
+
+                // Refill the token bucket for the time elapsed since the last visit
+                int rate = broadcast_rate_overrides[it->first] > 0 ? broadcast_rate_overrides[it->first] : broadcast_rate;
+                double elapsed = std::chrono::duration<double>(now - dest.last_refill).count();
+                dest.tokens = std::min<double>(BROADCAST_BURST, dest.tokens + elapsed * rate);
+                dest.last_refill = now;
+
+                if (dest.pending.empty() && dest.tokens >= BROADCAST_BURST) {
+                    // Fully rested destinations are forgotten; they are recreated on the next broadcast
+                    it = broadcast_dests.erase(it);
+                    continue;
+                }
+
+                if (!dest.pending.empty() && now < dest.flush_at) {
+                    // Still inside the coalescing window; let more records accumulate
+                    next_wake = std::min(next_wake, dest.flush_at);
+                    ++it;
+                    continue;
+                }
+
+                Batch batch{it->first, dest.udp_addr, {}};
+                size_t batch_bytes = 0;
+                // A record larger than GSO_MAX_PAYLOAD still goes out, alone in its batch
+                while (!dest.pending.empty() && dest.tokens >= 1.0 &&
+                       batch.datagrams.size() < GSO_MAX_SEGMENTS &&
+                       (batch.datagrams.empty() || batch_bytes + dest.pending.front()->size() <= GSO_MAX_PAYLOAD)) {
+                    auto datagram = coalesce_records(dest.pending);
+                    batch_bytes += datagram->size();
+                    batch.datagrams.push_back(std::move(datagram));
+                    dest.tokens -= 1.0;
+                }
+                if (!batch.datagrams.empty()) batches.push_back(std::move(batch));
+
+                if (!dest.pending.empty()) {
+                    // Wake up when this destination earns its next token
+                    double wait = dest.tokens >= 1.0 ? 0.0 : (1.0 - dest.tokens) / rate;
+                    auto wake = now + std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(wait));
+                    next_wake = std::min(next_wake, wake);
+                }
+                ++it;
+            }
+
+            if (batches.empty() && next_wake != clock::time_point::max()) {
+                broadcast_cv.wait_until(lock, next_wake);
+            }
+        }
+
+        // Send outside the lock so new broadcasts can keep queueing
+        for (const auto& batch : batches) {
+            int sent = send_datagram_batch(batch.addr, batch.datagrams);
+            if (sent < (int)batch.datagrams.size()) {
+                std::cerr << "[UDP FAIL] Failed to send " << (batch.datagrams.size() - sent)
+                          << " datagram(s) to " << campus_table[batch.campus].name << std::endl;
+            }
+        }
+    }
+}
+
+void set_broadcast_coalesce(int window_ms) {
+    std::lock_guard<std::mutex> lock(broadcast_mutex);
+    broadcast_coalesce_ms = window_ms;
+}
+
+// rate <= 0 clears a per-campus override; an empty campus sets the default for everyone.
+// Only setting an override interns the campus; clearing one just looks it up.
+void set_broadcast_rate(const std::string& campus, int rate) {
+    CampusId id = campus.empty() ? NO_CAMPUS : rate > 0 ? intern_campus(campus) : find_campus(campus);
+    {
+        std::lock_guard<std::mutex> lock(broadcast_mutex);
+        if (campus.empty()) {
+            broadcast_rate = rate;
+        } else if (id != NO_CAMPUS) {
+            broadcast_rate_overrides[id] = std::max(rate, 0);
+        }
+    }
+    if (rate > 0 && id != NO_CAMPUS) release_campus(id); // The override keeps the ID from now on
+}
+
+// ====================================================================
+//                         SENDER RATE LIMITING
+// ====================================================================
+
+// Loads the configured limits for this campus into its token buckets
+void apply_rate_limits(ClientInfo& client) {
+    RateLimits limits;
+    {
+        std::lock_guard<std::mutex> lock(limits_mutex);
+        limits = limit_overrides[client.campus_id].value_or(default_limits);
+    }
+    client.msg_bucket.configure(limits.msgs_per_sec, limits.msgs_per_sec);
+    client.byte_bucket.configure(limits.bytes_per_sec, limits.bytes_per_sec);
+    client.broadcast_bucket.configure(limits.broadcast_sends_per_sec, limits.broadcast_sends_per_sec);
+}
+
+// campus "*" changes the defaults; live sessions pick up the new limits immediately
+void set_rate_limits(const std::string& campus, const RateLimits& limits) {
+    CampusId target = campus == "*" ? NO_CAMPUS : intern_campus(campus);
+    if (campus != "*" && target == NO_CAMPUS) return; // Campus table full
+    {
+        std::lock_guard<std::mutex> lock(limits_mutex);
+        if (campus == "*") {
+            default_limits = limits;
+        } else {
+            limit_overrides[target] = limits;
+        }
+    }
+    if (target != NO_CAMPUS) release_campus(target); // The override keeps the ID from now on
+    std::lock_guard<std::mutex> lock(clients_mutex);
+    CampusId count = campus_count.load(std::memory_order_acquire);
+    for (CampusId id = 0; id < count; ++id) {
+        if (active_clients[id] && (campus == "*" || id == target)) apply_rate_limits(*active_clients[id]);
+    }
+}
+
+static const char *policy_name(BackpressurePolicy policy) {
+    switch (policy) {
+    case POLICY_BLOCK: return "block";
+    case POLICY_DROP_OLDEST: return "drop-oldest";
+    case POLICY_DROP_NEWEST: return "drop-newest";
+    case POLICY_DISCONNECT: return "disconnect";
+    case POLICY_SPILL: return "spill";
+    }
+    return "unknown";
+}
+
+// campus "*" changes the default; live sessions switch immediately
+void set_backpressure_policy(const std::string& campus, BackpressurePolicy policy) {
+    CampusId target = campus == "*" ? NO_CAMPUS : intern_campus(campus);
+    if (campus != "*" && target == NO_CAMPUS) return; // Campus table full
+    {
+        std::lock_guard<std::mutex> lock(limits_mutex);
+        if (campus == "*") {
+            default_policy = policy;
+        } else {
+            policy_overrides[target] = policy;
+        }
+    }
+    if (target != NO_CAMPUS) release_campus(target); // The override keeps the ID from now on
+    std::lock_guard<std::mutex> lock(clients_mutex);
+    CampusId count = campus_count.load(std::memory_order_acquire);
+    for (CampusId id = 0; id < count; ++id) {
+        ClientInfo *client = active_clients[id].get();
+        if (!client || (campus != "*" && id != target)) continue;
+        {
+            std::lock_guard<std::mutex> out_lock(client->out_mutex);
+            client->policy = policy;
+        }
+        client->out_cv.notify_all(); // Blocked senders re-evaluate under the new policy
+    }
+}
+
+// ====================================================================
+//                             SERVER STATS
+// ====================================================================
+
+// Resident set from /proc/self/smaps_rollup: how much is on huge pages, and hugetlb
+// pages (which the kernel counts apart from Rss)
+static void print_resident_memory() {
+    std::ifstream rollup("/proc/self/smaps_rollup");
+    std::string line;
+    uint64_t rss_kb = 0, anon_huge_kb = 0, hugetlb_kb = 0;
+    bool found = false;
+    while (std::getline(rollup, line)) {
+        std::istringstream fields(line);
+        std::string key;
+        uint64_t kb = 0;
+        fields >> key >> kb;
+        if (key == "Rss:") {
+            rss_kb = kb;
+            found = true;
+        } else if (key == "AnonHugePages:") {
+            anon_huge_kb = kb;
+        } else if (key == "Private_Hugetlb:" || key == "Shared_Hugetlb:") {
+            hugetlb_kb += kb;
+        }
+    }
+    if (!found) {
+        std::cout << "Resident Memory: unavailable (no /proc/self/smaps_rollup)" << std::endl;
+        return;
+    }
+    std::cout << "Resident Memory: " << rss_kb << " KB (" << anon_huge_kb << " KB on transparent huge pages), "
+              << hugetlb_kb << " KB hugetlb" << std::endl;
+}
+
+void print_stats() {
+    std::lock_guard<std::mutex> lock(clients_mutex);
+    std::cout << "\n--- SERVER STATS ---" << std::endl;
+    std::cout << "Active Clients: " << active_count << std::endl;
+    {
+        std::shared_lock<std::shared_mutex> campus_lock(campus_mutex);
+        std::cout << "Campus IDs: " << campus_ids.size() << " / " << MAX_CAMPUSES << " in use ("
+                  << campus_directory.size() << " from the directory, " << reclaimed_campus_ids.load()
+                  << " reclaimed so far)" << std::endl;
+    }
+    std::cout << "Pending Registrations: " << pending_registrations.load() << " / " << MAX_PENDING_REGISTRATIONS
+              << " (refused " << refused_connections.load() << ")" << std::endl;
+    std::cout << "Outbound Queued: " << outbound_total_bytes.load() << " / " << OUTBOUND_GLOBAL_MAX_BYTES << " bytes" << std::endl;
+    BlockPool::Stats pool = BlockPool::stats();
+    std::cout << "Memory Pool: " << pool.allocations << " allocations, "
+              << (pool.allocations ? pool.cache_hits * 100 / pool.allocations : 0) << "% thread-cache hits, "
+              << pool.depot_refills << " depot refills, " << pool.slabs << " slabs ("
+              << pool.slabs * POOL_SLAB_BYTES / 1024 << " KB), " << pool.oversize << " oversize" << std::endl;
+    PageHeap::Stats pages = PageHeap::stats();
+    std::cout << "Buffer Pages: " << pages.mapped_bytes / 1024 << " KB mapped in 2 MB regions ("
+              << pages.regions[PageHeap::BACKING_HUGETLB] << " hugetlb, " << pages.regions[PageHeap::BACKING_THP]
+              << " THP, " << pages.regions[PageHeap::BACKING_SMALL] << " 4 KB pages), "
+              << pages.carved_bytes / 1024 << " KB carved" << std::endl;
+    print_resident_memory();
+    CampusId count = campus_count.load(std::memory_order_acquire);
+    uint64_t file_bytes = 0;
+    for (CampusId id = 0; id < count; ++id) file_bytes += campus_counters[id].file_bytes.load();
+    size_t pipes_open;
+    {
+        std::lock_guard<std::mutex> pipes_lock(relay_pipes_mutex);
+        pipes_open = relay_pipes_open;
+    }
+    std::cout << "File Relay: " << file_bytes << " chunk bytes, " << spliced_chunk_bytes.load()
+              << " spliced, " << splice_fallbacks.load() << " splice fallbacks, "
+              << pipes_open << " / " << SPLICE_PIPES_MAX << " relay pipes" << std::endl;
+    std::cout << "Zero-Copy Sends: " << zerocopy_sends.load() << " (" << zerocopy_bytes.load() << " bytes) for payloads of "
+              << zerocopy_min_bytes.load() << "+ bytes, " << zerocopy_hits.load() << " hits, "
+              << zerocopy_copied.load() + zerocopy_refused.load() << " fallbacks (" << zerocopy_copied.load()
+              << " copied by the kernel, " << zerocopy_refused.load() << " refused), "
+              << zerocopy_aborted.load() << " aborted at teardown" << std::endl;
+    // CPU so far, so a benchmark can compare CPU per gigabyte relayed between runs
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+        std::cout << "CPU Time: " << usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 << " s user, "
+                  << usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6 << " s system" << std::endl;
+    }
+    for (CampusId id = 0; id < count; ++id) {
+        if (!active_clients[id]) continue;
+        ClientInfo& client = *active_clients[id];
+        const CampusCounters& counters = campus_counters[id];
+        std::lock_guard<std::mutex> out_lock(client.out_mutex);
+        std::cout << "  " << client.campus_name << " (#" << issued_campus_id(id) << "): sent " << counters.sent.load()
+                  << ", received " << counters.received.load() << ", failed " << counters.failed.load()
+                  << ", queued " << client.outbound.size() << " msgs / "
+                  << client.queued_bytes << " bytes, spilled " << (client.spill_write - client.spill_read)
+                  << " bytes, dropped " << client.dropped << ", expired " << client.expired
+                  << ", policy " << policy_name(client.policy);
+        if (client.resumable) {
+            std::cout << ", " << (client.detached ? "detached" : "resumable") << " (next #" << client.next_seq
+                      << ", unacked " << client.unacked.size() << ")";
+        }
+        if (client.gateway != NO_CAMPUS) std::cout << ", via gateway " << campus_table[client.gateway].name;
+        if (!gateway_identities[id].empty()) std::cout << ", gateway for " << gateway_identities[id].size() << " campuses";
+        if (counters.file_bytes.load()) std::cout << ", file bytes relayed " << counters.file_bytes.load();
+        std::cout << std::endl;
+    }
+    std::cout << "--------------------\n" << std::endl;
 }
 
 // ====================================================================
@@ -277,7 +2769,14 @@ void send_udp_broadcast(const std::string& message) {
 
 void handle_server_input() {
     std::string line;
+    Arena scratch; // Per-command scratch space
     std::cout << "\n[INFO] Console input active. Type 'BROADCAST:<message>' to send global UDP message." << std::endl;
+    std::cout << "[INFO] 'RATE:<n>' or 'RATE:<campus>:<n>' sets the paced broadcast rate (datagrams/sec)." << std::endl;
+    std::cout << "[INFO] 'COALESCE:<ms>' sets the broadcast batching window (0 disables it)." << std::endl;
+    std::cout << "[INFO] 'LIMIT:<campus|*>:<msgs/s>:<bytes/s>:<broadcast sends/s>' sets sender rate limits (0 = unlimited)." << std::endl;
+    std::cout << "[INFO] 'POLICY:<campus|*>:<block|drop-oldest|drop-newest|disconnect|spill>' sets the slow-consumer policy." << std::endl;
+    std::cout << "[INFO] 'ZEROCOPY:<bytes>' sets the payload size sent with MSG_ZEROCOPY (0 disables it)." << std::endl;
+    std::cout << "[INFO] 'STATS' prints queue and session statistics." << std::endl;
     
     while (true) {
         std::cout << "Server > ";
@@ -285,14 +2784,85 @@ void handle_server_input() {
 
         if (line.substr(0, 10) == "BROADCAST:") {
             // Use the dedicated UDP broadcast function
-            send_udp_broadcast("SERVER BROADCAST: " + line.substr(10));
+            send_udp_broadcast(make_payload("SERVER BROADCAST: " + line.substr(10)), scratch);
+            scratch.reset();
+        } else if (line.substr(0, 5) == "RATE:") {
+            // RATE:<n> sets the default, RATE:<campus>:<n> overrides one destination (0 clears it)
+            std::string args = line.substr(5);
+            size_t colon_pos = args.rfind(':');
+            std::string campus = colon_pos == std::string::npos ? "" : args.substr(0, colon_pos);
+            try {
+                int rate = std::stoi(colon_pos == std::string::npos ? args : args.substr(colon_pos + 1));
+                if (campus.empty() && rate <= 0) throw std::invalid_argument("rate");
+                set_broadcast_rate(campus, rate);
+                std::cout << "[INFO] Broadcast rate for " << (campus.empty() ? "all campuses" : campus)
+                          << " set to " << (rate > 0 ? std::to_string(rate) : "default") << " datagrams/sec." << std::endl;
+            } catch (...) {
+                std::cout << "[WARNING] Usage: RATE:<n> or RATE:<campus>:<n>" << std::endl;
+            }
+        } else if (line.substr(0, 9) == "COALESCE:") {
+            try {
+                int window_ms = std::stoi(line.substr(9));
+                if (window_ms < 0) throw std::invalid_argument("window");
+                set_broadcast_coalesce(window_ms);
+                std::cout << "[INFO] Broadcast coalescing window set to " << window_ms << " ms." << std::endl;
+            } catch (...) {
+                std::cout << "[WARNING] Usage: COALESCE:<ms>" << std::endl;
+            }
+        } else if (line.substr(0, 9) == "ZEROCOPY:") {
+            try {
+                long long threshold = std::stoll(line.substr(9));
+                if (threshold < 0) throw std::invalid_argument("threshold");
+                zerocopy_min_bytes = threshold;
+                if (threshold) {
+                    std::cout << "[INFO] Payloads of " << threshold << " bytes or more are sent with MSG_ZEROCOPY." << std::endl;
+                } else {
+                    std::cout << "[INFO] MSG_ZEROCOPY sends disabled." << std::endl;
+                }
+            } catch (...) {
+                std::cout << "[WARNING] Usage: ZEROCOPY:<bytes>" << std::endl;
+            }
+        } else if (line.substr(0, 6) == "LIMIT:") {
+            std::stringstream args(line.substr(6));
+            std::string campus, msgs, bytes, broadcasts;
+            try {
+                if (!std::getline(args, campus, ':') || !std::getline(args, msgs, ':') ||
+                    !std::getline(args, bytes, ':') || !std::getline(args, broadcasts) || campus.empty()) {
+                    throw std::invalid_argument("limit");
+                }
+                RateLimits limits = {std::stod(msgs), std::stod(bytes), std::stod(broadcasts)};
+                set_rate_limits(campus, limits);
+                std::cout << "[INFO] Rate limits for " << (campus == "*" ? "all campuses" : campus) << " updated." << std::endl;
+            } catch (...) {
+                std::cout << "[WARNING] Usage: LIMIT:<campus|*>:<msgs/s>:<bytes/s>:<broadcast sends/s>" << std::endl;
+            }
+        } else if (line.substr(0, 7) == "POLICY:") {
+            std::string args = line.substr(7);
+            size_t colon_pos = args.find(':');
+            std::string campus = args.substr(0, colon_pos);
+            std::string name = colon_pos == std::string::npos ? "" : args.substr(colon_pos + 1);
+            BackpressurePolicy policies[] = {POLICY_BLOCK, POLICY_DROP_OLDEST, POLICY_DROP_NEWEST, POLICY_DISCONNECT, POLICY_SPILL};
+            bool found = false;
+            for (BackpressurePolicy policy : policies) {
+                if (!campus.empty() && name == policy_name(policy)) {
+                    set_backpressure_policy(campus, policy);
+                    std::cout << "[INFO] Slow-consumer policy for " << (campus == "*" ? "all campuses" : campus)
+                              << " set to " << name << "." << std::endl;
+                    found = true;
+                }
+            }
+            if (!found) {
+                std::cout << "[WARNING] Usage: POLICY:<campus|*>:<block|drop-oldest|drop-newest|disconnect|spill>" << std::endl;
+            }
+        } else if (line == "STATS") {
+            print_stats();
         } else if (line == "exit" || line == "quit") {
             std::cout << "Shutting down server..." << std::endl;
             // Note: Proper shutdown requires more complex signal handling, 
             // but for a simple console app, a manual kill is often used.
             exit(0);
         } else if (!line.empty()) {
-            std::cout << "[WARNING] Unknown command. Use 'BROADCAST:<message>' or 'exit'." << std::endl;
+            std::cout << "[WARNING] Unknown command. Use 'BROADCAST:<message>', 'RATE:<n>', 'COALESCE:<ms>', 'LIMIT:...', 'POLICY:...', 'STATS' or 'exit'." << std::endl;
         }
     }
 }
\ No newline at end of file
@@ -0,0 +1,226 @@
+// Tests for ie_frames.h: the frame scanners (scalar and vectorized), the UTF-8 check
+// and the formatting of routed frames.
+#include "ie_frames.h"
+
+#include <gtest/gtest.h>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct Scan {
+    std::vector<FrameSpan> spans;
+    size_t consumed;
+};
+
+Scan run_scanner(FrameScanner scanner, const std::string& data) {
+    Arena arena;
+    ArenaVector<FrameSpan> spans{ArenaAllocator<char>(arena)};
+    size_t consumed = scanner(data.data(), data.size(), spans);
+    return {std::vector<FrameSpan>(spans.begin(), spans.end()), consumed};
+}
+
+// A byte-at-a-time restatement of what every scanner must return
+Scan reference_scan(const std::string& data) {
+    Scan scan{{}, 0};
+    size_t start = 0;
+    for (size_t newline = data.find('\n'); newline != std::string::npos; newline = data.find('\n', start)) {
+        size_t end = newline > start && data[newline - 1] == '\r' ? newline - 1 : newline;
+        size_t colon = data.find(':', start);
+        bool valid = utf8_valid((const unsigned char *)data.data() + start, end - start);
+        scan.spans.push_back({(uint32_t)start, (uint32_t)(end - start),
+                              colon < newline ? (uint32_t)(colon - start) : FrameSpan::NO_COLON, valid});
+        start = newline + 1;
+    }
+    scan.consumed = start;
+    return scan;
+}
+
+void expect_same(const Scan& expected, const Scan& actual, const std::string& label) {
+    EXPECT_EQ(expected.consumed, actual.consumed) << label;
+    ASSERT_EQ(expected.spans.size(), actual.spans.size()) << label;
+    for (size_t i = 0; i < expected.spans.size(); ++i) {
+        EXPECT_EQ(expected.spans[i].offset, actual.spans[i].offset) << label << ", frame " << i;
+        EXPECT_EQ(expected.spans[i].length, actual.spans[i].length) << label << ", frame " << i;
+        EXPECT_EQ(expected.spans[i].colon, actual.spans[i].colon) << label << ", frame " << i;
+        EXPECT_EQ(expected.spans[i].valid_utf8, actual.spans[i].valid_utf8) << label << ", frame " << i;
+    }
+}
+
+// Every scanner this CPU can run, by name
+std::vector<std::pair<const char *, FrameScanner>> scanners() {
+    std::vector<std::pair<const char *, FrameScanner>> available = {{"scalar", scan_frames_scalar}};
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2")) available.push_back({"sse2", scan_frames_sse2});
+    if (__builtin_cpu_supports("avx2")) available.push_back({"avx2", scan_frames_avx2});
+#endif
+    return available;
+}
+
+void expect_all_scanners_match(const std::string& data, const std::string& label) {
+    Scan expected = reference_scan(data);
+    for (const auto& [name, scanner] : scanners()) {
+        expect_same(expected, run_scanner(scanner, data), label + " (" + name + ")");
+    }
+}
+
+bool valid(const std::string& text) {
+    return utf8_valid((const unsigned char *)text.data(), text.size());
+}
+
+} // namespace
+
+// ====================================================================
+//                            FRAME SCANNING
+// ====================================================================
+
+TEST(FrameScanner, IndexesFramesAndTheirFirstColon) {
+    std::string data = "Beta:hi:there\nno colon\n\n";
+    Scan scan = run_scanner(scan_frames_scalar, data);
+    ASSERT_EQ(scan.spans.size(), 3u);
+    EXPECT_EQ(scan.consumed, data.size());
+    EXPECT_EQ(data.substr(scan.spans[0].offset, scan.spans[0].length), "Beta:hi:there");
+    EXPECT_EQ(scan.spans[0].colon, 4u);
+    EXPECT_EQ(data.substr(scan.spans[1].offset, scan.spans[1].length), "no colon");
+    EXPECT_EQ(scan.spans[1].colon, FrameSpan::NO_COLON);
+    EXPECT_EQ(scan.spans[2].length, 0u);
+    expect_all_scanners_match(data, "basic frames");
+}
+
+TEST(FrameScanner, StripsOnlyTheCarriageReturnBeforeTheNewline) {
+    std::string data = "Beta:hi\r\n\r\na\rb\n";
+    Scan scan = run_scanner(scan_frames_scalar, data);
+    ASSERT_EQ(scan.spans.size(), 3u);
+    EXPECT_EQ(data.substr(scan.spans[0].offset, scan.spans[0].length), "Beta:hi");
+    EXPECT_EQ(scan.spans[1].length, 0u);
+    EXPECT_EQ(data.substr(scan.spans[2].offset, scan.spans[2].length), "a\rb");
+    expect_all_scanners_match(data, "carriage returns");
+}
+
+TEST(FrameScanner, LeavesATrailingPartialFrame) {
+    std::string data = "one\ntwo:partial";
+    Scan scan = run_scanner(scan_frames_scalar, data);
+    ASSERT_EQ(scan.spans.size(), 1u);
+    EXPECT_EQ(scan.consumed, 4u);
+    expect_all_scanners_match(data, "partial frame");
+
+    Scan nothing = run_scanner(scan_frames_scalar, std::string(200, 'x'));
+    EXPECT_TRUE(nothing.spans.empty());
+    EXPECT_EQ(nothing.consumed, 0u);
+}
+
+// Frames, colons and multi-byte sequences on either side of the 16-, 32- and 64-byte
+// lanes the vector scanners work in
+TEST(FrameScanner, BlockBoundariesMatchAcrossScanners) {
+    const size_t boundaries[] = {16, 32, 48, 64, 96, 128};
+    for (size_t boundary : boundaries) {
+        for (size_t shift = 0; shift < 6; ++shift) {
+            size_t at = boundary - 3 + shift;
+
+            std::string newline_at(200, 'a');
+            newline_at[at] = '\n';
+            expect_all_scanners_match(newline_at, "newline at " + std::to_string(at));
+
+            std::string colon_at(200, 'a');
+            colon_at[at] = ':';
+            colon_at[boundary + 40] = '\n';
+            expect_all_scanners_match(colon_at, "colon at " + std::to_string(at));
+
+            std::string crlf_at(200, 'a');
+            crlf_at[at] = '\r';
+            crlf_at[at + 1] = '\n';
+            expect_all_scanners_match(crlf_at, "CRLF at " + std::to_string(at));
+
+            std::string euro_at(200, 'a'); // U+20AC straddling the boundary
+            euro_at.replace(at, 3, "\xE2\x82\xAC");
+            euro_at[190] = '\n';
+            expect_all_scanners_match(euro_at, "sequence at " + std::to_string(at));
+            EXPECT_TRUE(run_scanner(scan_frames_scalar, euro_at).spans[0].valid_utf8);
+        }
+    }
+}
+
+TEST(FrameScanner, RandomInputsMatchAcrossScanners) {
+    const char alphabet[] = {'\n', ':', '\r', 'a', 'b', ' ', '\x80', '\xBF', '\xC3', '\xE2', '\xED', '\xF0', '\xF4'};
+    std::mt19937 random(12345);
+    for (int trial = 0; trial < 5000; ++trial) {
+        std::string data(random() % 300, 'a');
+        for (char& c : data) {
+            // Mostly ASCII, so many frames are valid and the non-ASCII path runs now and then
+            c = random() % 4 ? "abc: \n"[random() % 6] : alphabet[random() % sizeof(alphabet)];
+        }
+        expect_all_scanners_match(data, "trial " + std::to_string(trial));
+        if (HasFailure()) return;
+    }
+}
+
+// ====================================================================
+//                            UTF-8 VALIDATION
+// ====================================================================
+
+TEST(Utf8Valid, AcceptsWellFormedText) {
+    EXPECT_TRUE(valid(""));
+    EXPECT_TRUE(valid("plain ASCII: 100%"));
+    EXPECT_TRUE(valid("caf\xC3\xA9"));                 // U+00E9
+    EXPECT_TRUE(valid("\xE2\x82\xAC 5"));              // U+20AC
+    EXPECT_TRUE(valid("\xF0\x9F\x98\x80"));            // U+1F600
+    EXPECT_TRUE(valid("\xC2\x80\xE0\xA0\x80\xF0\x90\x80\x80")); // Smallest of each length
+    EXPECT_TRUE(valid("\xED\x9F\xBF\xEE\x80\x80"));    // U+D7FF and U+E000 around the surrogates
+    EXPECT_TRUE(valid("\xF4\x8F\xBF\xBF"));            // U+10FFFF
+}
+
+TEST(Utf8Valid, RejectsOverlongEncodings) {
+    EXPECT_FALSE(valid("\xC0\x80"));
+    EXPECT_FALSE(valid("\xC1\xBF"));
+    EXPECT_FALSE(valid("\xE0\x80\x80"));
+    EXPECT_FALSE(valid("\xE0\x9F\xBF"));
+    EXPECT_FALSE(valid("\xF0\x80\x80\x80"));
+    EXPECT_FALSE(valid("\xF0\x8F\xBF\xBF"));
+}
+
+TEST(Utf8Valid, RejectsSurrogates) {
+    EXPECT_FALSE(valid("\xED\xA0\x80"));  // U+D800
+    EXPECT_FALSE(valid("\xED\xBF\xBF"));  // U+DFFF
+}
+
+TEST(Utf8Valid, RejectsCodePointsPastU10FFFF) {
+    EXPECT_FALSE(valid("\xF4\x90\x80\x80"));
+    EXPECT_FALSE(valid("\xF5\x80\x80\x80"));
+    EXPECT_FALSE(valid("\xF8\x88\x80\x80\x80"));
+    EXPECT_FALSE(valid("\xFF"));
+}
+
+TEST(Utf8Valid, RejectsStrayAndMissingContinuationBytes) {
+    EXPECT_FALSE(valid("\x80"));
+    EXPECT_FALSE(valid("a\xBF" "b"));
+    EXPECT_FALSE(valid("\xC3" "a"));
+    EXPECT_FALSE(valid("\xE2\x82" "a"));
+}
+
+TEST(Utf8Valid, RejectsSequencesTruncatedAtTheEnd) {
+    EXPECT_FALSE(valid("caf\xC3"));
+    EXPECT_FALSE(valid("\xE2\x82"));
+    EXPECT_FALSE(valid("\xF0\x9F\x98"));
+}
+
+// A sequence cut off by the '\n' spoils only its own frame
+TEST(Utf8Valid, TruncatedSequenceBeforeTheNewlineMarksOnlyThatFrame) {
+    std::string data = "Beta:caf\xC3\nBeta:caf\xC3\xA9\n";
+    Scan scan = run_scanner(scan_frames_scalar, data);
+    ASSERT_EQ(scan.spans.size(), 2u);
+    EXPECT_FALSE(scan.spans[0].valid_utf8);
+    EXPECT_TRUE(scan.spans[1].valid_utf8);
+    expect_all_scanners_match(data, "truncated sequence");
+}
+
+// ====================================================================
+//                            ROUTED FRAMES
+// ====================================================================
+
+TEST(FormatRoutedMessage, PrefixesTheSenderAndTerminatesTheFrame) {
+    Payload message = format_routed_message("FROM Alpha: ", "hello: world");
+    EXPECT_EQ(std::string_view(*message), "FROM Alpha: hello: world\n");
+    EXPECT_EQ(std::string_view(*format_routed_message("FROM Alpha: ", "")), "FROM Alpha: \n");
+}
@@ -0,0 +1,258 @@
+// Tests for ie_memory.h: the huge-page backed page heap, the size-classed block pool,
+// the pooled payload strings built on it, and the per-batch scratch arena.
+#include "ie_memory.h"
+
+#include <gtest/gtest.h>
+#include <fstream>
+#include <set>
+#include <thread>
+#include <vector>
+
+namespace {
+
+const size_t LARGEST_BLOCK = (size_t)POOL_MIN_BLOCK << (POOL_SIZE_CLASSES - 1);
+
+// Runs 'body' on a thread of its own, whose cache is handed back when it exits
+template <typename Body>
+void on_new_thread(Body body) {
+    std::thread thread(body);
+    thread.join();
+}
+
+// The VmFlags line of the mapping that holds 'address' in /proc/self/smaps
+std::string vm_flags_of(const void *address) {
+    std::ifstream smaps("/proc/self/smaps");
+    std::string line;
+    bool inside = false;
+    while (std::getline(smaps, line)) {
+        unsigned long start, end;
+        if (sscanf(line.c_str(), "%lx-%lx ", &start, &end) == 2 && line.find(':') > line.find(' ')) {
+            inside = start <= (uintptr_t)address && (uintptr_t)address < end;
+        } else if (inside && line.compare(0, 8, "VmFlags:") == 0) {
+            return line;
+        }
+    }
+    return "";
+}
+
+bool thp_enabled_in_sysfs() {
+    std::ifstream setting("/sys/kernel/mm/transparent_hugepage/enabled");
+    std::string modes;
+    std::getline(setting, modes);
+    return !modes.empty() && modes.find("[never]") == std::string::npos;
+}
+
+} // namespace
+
+// ====================================================================
+//                            PAGE HEAP
+// ====================================================================
+
+// Without reserved huge pages, regions are 2 MB-aligned and advised for THP, or plain
+// pages when THP is off; the counters report exactly what was mapped
+TEST(PageHeap, FallsBackWhenHugePagesAreUnavailable) {
+    PageHeap::disable_hugetlb();
+    PageHeap::Backing expected = HUGE_PAGES_ENABLED && thp_enabled_in_sysfs() ? PageHeap::BACKING_THP
+                                                                              : PageHeap::BACKING_SMALL;
+
+    PageHeap::Stats before = PageHeap::stats();
+    char *region = static_cast<char *>(PageHeap::allocate(HUGE_PAGE_BYTES + 1)); // A mapping of its own
+    PageHeap::Stats after = PageHeap::stats();
+    memset(region, 1, HUGE_PAGE_BYTES + 1);
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(region) % HUGE_PAGE_BYTES, 0u);
+    for (int kind = 0; kind < PageHeap::BACKING_KINDS; ++kind) {
+        EXPECT_EQ(after.regions[kind] - before.regions[kind], kind == expected ? 2u : 0u)
+            << PageHeap::backing_name((PageHeap::Backing)kind);
+    }
+    EXPECT_EQ(after.mapped_bytes - before.mapped_bytes, 2u * HUGE_PAGE_BYTES);
+    EXPECT_EQ(after.carved_bytes - before.carved_bytes, HUGE_PAGE_BYTES + 64u); // Rounded to a cache line
+
+    // The kernel agrees: MADV_HUGEPAGE shows as 'hg', a hugetlb mapping would show 'ht'
+    std::string flags = vm_flags_of(region);
+    ASSERT_FALSE(flags.empty());
+    EXPECT_EQ(flags.find(" ht"), std::string::npos) << flags;
+    EXPECT_EQ(flags.find(" hg") != std::string::npos, expected == PageHeap::BACKING_THP) << flags;
+
+    // Small carves share a region; a new one is mapped only when the current one is full
+    before = PageHeap::stats();
+    char *first = static_cast<char *>(PageHeap::allocate(100));
+    char *second = static_cast<char *>(PageHeap::allocate(100));
+    after = PageHeap::stats();
+    EXPECT_EQ(after.carved_bytes - before.carved_bytes, 256u);
+    EXPECT_EQ(after.regions[PageHeap::BACKING_HUGETLB], before.regions[PageHeap::BACKING_HUGETLB]);
+    uint64_t new_regions = after.regions[expected] - before.regions[expected];
+    EXPECT_LE(new_regions, 1u);
+    EXPECT_EQ(after.mapped_bytes - before.mapped_bytes, new_regions * HUGE_PAGE_BYTES);
+    EXPECT_EQ(second - first, 128);
+}
+
+// ====================================================================
+//                            BLOCK POOL
+// ====================================================================
+
+TEST(BlockPool, FreedBlockIsReusedWithinItsClass) {
+    void *first = BlockPool::allocate(100);
+    BlockPool::deallocate(first, 100);
+    void *again = BlockPool::allocate(128); // Same 128-byte class
+    EXPECT_EQ(again, first);
+    BlockPool::deallocate(again, 128);
+
+    void *other = BlockPool::allocate(129); // Next class up: a different block
+    EXPECT_NE(other, first);
+    BlockPool::deallocate(other, 129);
+}
+
+TEST(BlockPool, LiveBlocksNeverOverlap) {
+    const size_t sizes[] = {1, 64, 65, 200, 1000, 3000, LARGEST_BLOCK};
+    std::vector<std::pair<unsigned char *, size_t>> blocks;
+    for (int round = 0; round < 300; ++round) {
+        for (size_t size : sizes) {
+            unsigned char *block = static_cast<unsigned char *>(BlockPool::allocate(size));
+            memset(block, (int)(blocks.size() & 0xFF), size);
+            blocks.push_back({block, size});
+        }
+    }
+    std::set<unsigned char *> distinct;
+    for (size_t i = 0; i < blocks.size(); ++i) {
+        EXPECT_TRUE(distinct.insert(blocks[i].first).second) << "block " << i << " handed out twice";
+        EXPECT_EQ(reinterpret_cast<uintptr_t>(blocks[i].first) % alignof(std::max_align_t), 0u);
+        // A block shared with a later one would have been overwritten by it
+        for (size_t k = 0; k < blocks[i].second; ++k) {
+            if (blocks[i].first[k] != (i & 0xFF)) {
+                ADD_FAILURE() << "block " << i << " overwritten at byte " << k;
+                break;
+            }
+        }
+    }
+    for (auto& [block, size] : blocks) BlockPool::deallocate(block, size);
+}
+
+// Payloads are built on handler threads and freed on the I/O thread: the freeing thread's
+// cache passes the blocks to the depot, and a third thread gets them back from there
+TEST(BlockPool, CrossThreadFreesReturnToTheDepot) {
+    const size_t count = 10 * POOL_SLAB_BYTES / LARGEST_BLOCK; // Ten slabs' worth
+    std::vector<void *> blocks;
+    on_new_thread([&] {
+        for (size_t i = 0; i < count; ++i) blocks.push_back(BlockPool::allocate(LARGEST_BLOCK));
+    });
+    on_new_thread([&] {
+        for (void *block : blocks) BlockPool::deallocate(block, LARGEST_BLOCK);
+    });
+
+    uint64_t slabs_before = BlockPool::stats().slabs;
+    std::vector<void *> reused;
+    on_new_thread([&] {
+        for (size_t i = 0; i < count; ++i) reused.push_back(BlockPool::allocate(LARGEST_BLOCK));
+    });
+    EXPECT_EQ(BlockPool::stats().slabs, slabs_before); // All came from the depot
+    EXPECT_EQ(std::set<void *>(reused.begin(), reused.end()), std::set<void *>(blocks.begin(), blocks.end()));
+    on_new_thread([&] {
+        for (void *block : reused) BlockPool::deallocate(block, LARGEST_BLOCK);
+    });
+}
+
+TEST(BlockPool, CountsHitsRefillsAndOversize) {
+    BlockPool::Stats before = BlockPool::stats();
+    on_new_thread([] {
+        // The first allocation finds the new thread's cache empty; the rest reuse its block
+        for (int i = 0; i < 10; ++i) BlockPool::deallocate(BlockPool::allocate(64), 64);
+        void *large = BlockPool::allocate(LARGEST_BLOCK + 1);
+        BlockPool::deallocate(large, LARGEST_BLOCK + 1);
+    });
+    BlockPool::Stats after = BlockPool::stats(); // Published when the thread exited
+    EXPECT_EQ(after.allocations - before.allocations, 10u);
+    EXPECT_EQ(after.cache_hits - before.cache_hits, 9u);
+    EXPECT_EQ(after.depot_refills - before.depot_refills, 1u);
+    EXPECT_EQ(after.oversize - before.oversize, 1u);
+    EXPECT_LE(after.slabs - before.slabs, 1u);
+}
+
+// ====================================================================
+//                            POOLED PAYLOADS
+// ====================================================================
+
+TEST(Payload, HoldsItsTextAtAnySize) {
+    Payload small = make_payload(std::string_view("FROM Alpha: hi\n"));
+    EXPECT_EQ(std::string_view(*small), "FROM Alpha: hi\n");
+
+    PooledString text;
+    for (int i = 0; i < 1000; ++i) text.append("0123456789"); // Grows through every class and past them
+    Payload large = make_payload(std::move(text));
+    ASSERT_EQ(large->size(), 10000u);
+    EXPECT_EQ(large->substr(9990), "0123456789");
+}
+
+TEST(Payload, SharedCopiesReleaseTheBlockOnce) {
+    Payload payload = make_payload(std::string_view("BROADCAST:fan-out"));
+    std::vector<Payload> queues(50, payload); // One reference per destination queue
+    EXPECT_EQ(payload.use_count(), 51);
+    queues.clear();
+    EXPECT_EQ(payload.use_count(), 1);
+    EXPECT_EQ(std::string_view(*payload), "BROADCAST:fan-out");
+}
+
+TEST(PoolAllocator, BacksStandardContainers) {
+    std::vector<int, PoolAllocator<int>> numbers;
+    for (int i = 0; i < 2000; ++i) numbers.push_back(i);
+    EXPECT_EQ(numbers[1999], 1999);
+    EXPECT_TRUE(PoolAllocator<int>() == PoolAllocator<char>());
+}
+
+// ====================================================================
+//                            ARENA
+// ====================================================================
+
+TEST(Arena, ResetReusesTheFirstBlock) {
+    Arena arena(1024);
+    void *first = arena.allocate(100, 8);
+    arena.allocate(500, 8);
+    size_t reserved = arena.reserved_bytes();
+    EXPECT_EQ(reserved, 1024u);
+
+    arena.reset();
+    EXPECT_EQ(arena.allocate(100, 8), first);
+    EXPECT_EQ(arena.reserved_bytes(), reserved);
+}
+
+TEST(Arena, AllocationsAreAligned) {
+    Arena arena(1024);
+    arena.allocate(1, 1);
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(arena.allocate(8, 8)) % 8, 0u);
+    arena.allocate(3, 1);
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(arena.allocate(16, alignof(std::max_align_t))) % alignof(std::max_align_t), 0u);
+}
+
+TEST(Arena, GrowsPastABlockAndKeepsWhatItGrew) {
+    Arena arena(1024);
+    arena.allocate(100, 8);
+    char *large = static_cast<char *>(arena.allocate(5000, 8)); // Larger than a block
+    memset(large, 'x', 5000);
+    size_t reserved = arena.reserved_bytes();
+    EXPECT_EQ(reserved, 1024u + 5000u);
+
+    // The same batch shape after a reset fits in the blocks already kept
+    arena.reset();
+    arena.allocate(100, 8);
+    EXPECT_EQ(arena.allocate(5000, 8), large);
+    for (int i = 0; i < 3; ++i) arena.allocate(300, 8);
+    EXPECT_EQ(arena.reserved_bytes(), reserved + 1024u); // Only the spill past them is new
+}
+
+TEST(Arena, CopyOutlivesItsSource) {
+    Arena arena;
+    std::string_view copy;
+    {
+        std::string source = "Beta:hello";
+        copy = arena.copy(source);
+        source.assign("overwritten");
+    }
+    EXPECT_EQ(copy, "Beta:hello");
+}
+
+TEST(ArenaVector, GrowsInsideTheArena) {
+    Arena arena(1024);
+    ArenaVector<uint32_t> values{ArenaAllocator<char>(arena)};
+    for (uint32_t i = 0; i < 1000; ++i) values.push_back(i);
+    EXPECT_EQ(values[999], 999u);
+    EXPECT_GT(arena.reserved_bytes(), 1024u); // Outgrew the first block
+}
@@ -0,0 +1,93 @@
+// Tests for ie_phf.h: the minimal perfect hash behind the campus directory.
+#include "ie_phf.h"
+
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Directory-style IDs: not the positions of the names, so a mix-up shows
+std::vector<CampusId> ids_for(size_t count) {
+    std::vector<CampusId> ids(count);
+    for (size_t i = 0; i < count; ++i) ids[i] = (CampusId)(1000 + 7 * i);
+    return ids;
+}
+
+void expect_every_name_found(const PerfectHash& directory, const std::vector<std::string>& names,
+                             const std::vector<CampusId>& ids) {
+    for (size_t i = 0; i < names.size(); ++i) EXPECT_EQ(directory.find(names[i]), ids[i]) << names[i];
+}
+
+} // namespace
+
+TEST(PerfectHash, EveryNameMapsToItsId) {
+    std::vector<std::string> names;
+    for (int i = 0; i < 2000; ++i) names.push_back("Campus-" + std::to_string(i));
+    std::vector<CampusId> ids = ids_for(names.size());
+    PerfectHash directory;
+    ASSERT_TRUE(directory.build(names, ids));
+    EXPECT_EQ(directory.size(), names.size()); // Minimal: one slot per name
+    expect_every_name_found(directory, names, ids);
+}
+
+TEST(PerfectHash, NonMembersAreNotFound) {
+    std::vector<std::string> names = {"Lahore", "Karachi", "Islamabad", "Peshawar", "Faisalabad"};
+    PerfectHash directory;
+    ASSERT_TRUE(directory.build(names, ids_for(names.size())));
+    EXPECT_EQ(directory.find(""), NO_CAMPUS);
+    EXPECT_EQ(directory.find("Multan"), NO_CAMPUS);
+    EXPECT_EQ(directory.find("lahore"), NO_CAMPUS);
+    EXPECT_EQ(directory.find("Lahore "), NO_CAMPUS);
+    EXPECT_EQ(directory.find("Lahor"), NO_CAMPUS);
+    for (int i = 0; i < 1000; ++i) EXPECT_EQ(directory.find("Other-" + std::to_string(i)), NO_CAMPUS);
+}
+
+TEST(PerfectHash, EmptyDirectoryFindsNothing) {
+    PerfectHash directory;
+    EXPECT_EQ(directory.find("Lahore"), NO_CAMPUS); // Before any build
+    ASSERT_TRUE(directory.build({}, {}));
+    EXPECT_EQ(directory.size(), 0u);
+    EXPECT_EQ(directory.find("Lahore"), NO_CAMPUS);
+    EXPECT_EQ(directory.find(""), NO_CAMPUS);
+}
+
+TEST(PerfectHash, SingleName) {
+    PerfectHash directory;
+    ASSERT_TRUE(directory.build({"Lahore"}, {42}));
+    EXPECT_EQ(directory.size(), 1u);
+    EXPECT_EQ(directory.find("Lahore"), 42u);
+    EXPECT_EQ(directory.find("Karachi"), NO_CAMPUS);
+    EXPECT_EQ(directory.find(""), NO_CAMPUS);
+}
+
+// The empty string is an ordinary key once it is in the set
+TEST(PerfectHash, EmptyNameCanBeAMember) {
+    PerfectHash directory;
+    ASSERT_TRUE(directory.build({"", "Lahore"}, {5, 6}));
+    EXPECT_EQ(directory.find(""), 5u);
+    EXPECT_EQ(directory.find("Lahore"), 6u);
+}
+
+TEST(PerfectHash, NamesSharingLongPrefixes) {
+    const std::string prefix(200, 'n');
+    std::vector<std::string> names;
+    for (int i = 0; i < 500; ++i) names.push_back(prefix + std::to_string(i));
+    for (int i = 0; i < 50; ++i) names.push_back(prefix.substr(0, 150 + i)); // Prefixes of one another
+    std::vector<CampusId> ids = ids_for(names.size());
+    PerfectHash directory;
+    ASSERT_TRUE(directory.build(names, ids));
+    expect_every_name_found(directory, names, ids);
+    EXPECT_EQ(directory.find(prefix), NO_CAMPUS);
+    EXPECT_EQ(directory.find(prefix + "500"), NO_CAMPUS);
+    EXPECT_EQ(directory.find(prefix.substr(0, 149)), NO_CAMPUS);
+}
+
+TEST(PerfectHash, RebuildReplacesTheDirectory) {
+    PerfectHash directory;
+    ASSERT_TRUE(directory.build({"Lahore", "Karachi"}, {1, 2}));
+    ASSERT_TRUE(directory.build({"Karachi", "Multan", "Quetta"}, {3, 4, 5}));
+    EXPECT_EQ(directory.find("Lahore"), NO_CAMPUS);
+    EXPECT_EQ(directory.find("Karachi"), 3u);
+    EXPECT_EQ(directory.find("Quetta"), 5u);
+}
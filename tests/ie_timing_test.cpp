@@ -0,0 +1,263 @@
+// Tests for ie_timing.h: the token bucket behind per-campus rate limits and the
+// I/O thread's timer wheel.
+#include "ie_timing.h"
+
+#include <gtest/gtest.h>
+#include <thread>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+// ====================================================================
+//                            TOKEN BUCKET
+// ====================================================================
+
+TEST(TokenBucket, UnconfiguredIsUnlimited) {
+    TokenBucket bucket;
+    bucket.consume(1e9);
+    EXPECT_EQ(bucket.time_until_ready(), 0ns);
+    EXPECT_EQ(bucket.rate(), 0);
+}
+
+TEST(TokenBucket, ZeroRateIsUnlimited) {
+    TokenBucket bucket;
+    bucket.configure(0, 10);
+    bucket.consume(1000);
+    EXPECT_EQ(bucket.time_until_ready(), 0ns);
+}
+
+TEST(TokenBucket, BurstIsAvailableAtOnce) {
+    TokenBucket bucket;
+    bucket.configure(10, 5);
+    EXPECT_EQ(bucket.rate(), 10);
+    bucket.consume(5);
+    EXPECT_EQ(bucket.time_until_ready(), 0ns);
+}
+
+TEST(TokenBucket, DebtIsRepaidAtTheRate) {
+    TokenBucket bucket;
+    bucket.configure(10, 5);
+    bucket.consume(7); // Two tokens in debt at 10/s: 200 ms
+    auto wait = bucket.time_until_ready();
+    EXPECT_GT(wait, 150ms);
+    EXPECT_LE(wait, 200ms + 1ns);
+
+    std::this_thread::sleep_for(wait);
+    EXPECT_EQ(bucket.time_until_ready(), 0ns);
+}
+
+TEST(TokenBucket, RefillStopsAtTheBurst) {
+    TokenBucket bucket;
+    bucket.configure(100, 5);
+    bucket.consume(5);
+    std::this_thread::sleep_for(100ms);
+    EXPECT_EQ(bucket.time_until_ready(), 0ns); // Refills lazily: 10 tokens earned, 5 fit
+    bucket.consume(6);                         // One token in debt at 100/s: 10 ms
+    auto wait = bucket.time_until_ready();
+    EXPECT_GT(wait, 0ns);
+    EXPECT_LE(wait, 10ms + 1ns);
+}
+
+// Byte buckets run at millions of tokens per second; a refill over a few milliseconds
+// at that rate overflows 64 bits of millitoken-nanoseconds
+TEST(TokenBucket, HighRatesDoNotOverflow) {
+    TokenBucket bucket;
+    bucket.configure(1e9, 1e9);
+    bucket.consume(2e9); // One second in debt
+    std::this_thread::sleep_for(20ms);
+    auto wait = bucket.time_until_ready();
+    EXPECT_GT(wait, 500ms);
+    EXPECT_LT(wait, 985ms);
+}
+
+TEST(TokenBucket, ConcurrentConsumersAreAllCharged) {
+    TokenBucket bucket;
+    bucket.configure(1, 1000); // Refills are negligible over the test
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&] {
+            for (int i = 0; i < 500; ++i) bucket.consume(1);
+        });
+    }
+    for (std::thread& thread : threads) thread.join();
+    // 2000 consumed against a 1000 burst: about 1000 s of debt at 1 token/s
+    auto wait = bucket.time_until_ready();
+    EXPECT_GT(wait, 990s);
+    EXPECT_LE(wait, 1000s + 1ns);
+}
+
+// Reconfiguring a live bucket (a LIMIT change) keeps what the sender owes
+TEST(TokenBucket, ReconfigureKeepsTheDebt) {
+    TokenBucket bucket;
+    bucket.configure(10, 5);
+    bucket.consume(25); // Twenty tokens in debt: 2 s at 10/s
+    bucket.configure(10, 5);
+    EXPECT_GT(bucket.time_until_ready(), 1900ms);
+
+    bucket.configure(5, 5); // Tighter: the same debt now takes 4 s
+    auto wait = bucket.time_until_ready();
+    EXPECT_GT(wait, 3800ms);
+    EXPECT_LE(wait, 4000ms + 1ns);
+
+    bucket.configure(1000, 5); // Looser: repaid at the new rate, 20 ms
+    EXPECT_LE(bucket.time_until_ready(), 20ms + 1ns);
+}
+
+TEST(TokenBucket, ReconfigureCapsTheBalanceAtTheNewBurst) {
+    TokenBucket bucket;
+    bucket.configure(10, 100);
+    bucket.configure(10, 5);
+    bucket.consume(6); // Only 5 of the 100 carried over: one token in debt
+    auto wait = bucket.time_until_ready();
+    EXPECT_GT(wait, 50ms);
+    EXPECT_LE(wait, 100ms + 1ns);
+}
+
+// Nothing was metered while the bucket was unlimited, so limiting it starts afresh
+TEST(TokenBucket, LimitingAnUnlimitedBucketStartsWithTheBurst) {
+    TokenBucket bucket;
+    bucket.configure(0, 0);
+    bucket.consume(1000);
+    bucket.configure(10, 5);
+    bucket.consume(5);
+    EXPECT_EQ(bucket.time_until_ready(), 0ns);
+}
+
+// ====================================================================
+//                            TIMER WHEEL
+// ====================================================================
+
+// Drives a wheel one tick at a time on a synthetic clock, recording when timers fire
+struct TickingWheel {
+    TimerWheel wheel;
+    std::chrono::steady_clock::time_point base = std::chrono::steady_clock::now(); // Taken after the wheel's own start
+    uint64_t ticks = 0;
+
+    void tick() { wheel.advance(base + ++ticks * std::chrono::milliseconds(TIMER_TICK_MS)); }
+
+    // Arms 'timer' to record the tick it fires on
+    void arm(Timer& timer, int64_t delay_ms, std::vector<uint64_t>& fired) {
+        timer.callback = [this, &fired] { fired.push_back(ticks); };
+        wheel.schedule(timer, delay_ms);
+    }
+};
+
+TEST(TimerWheel, FiresOnTheTickCoveringItsDelay) {
+    TickingWheel clock;
+    Timer timer;
+    std::vector<uint64_t> fired;
+    clock.arm(timer, 2 * TIMER_TICK_MS + 1, fired); // Rounds up to 3 ticks
+    EXPECT_TRUE(timer.armed());
+    for (int i = 0; i < 5; ++i) clock.tick();
+    EXPECT_EQ(fired, std::vector<uint64_t>{3});
+    EXPECT_FALSE(timer.armed());
+}
+
+TEST(TimerWheel, ZeroDelayWaitsForTheNextTick) {
+    TickingWheel clock;
+    Timer timer;
+    std::vector<uint64_t> fired;
+    clock.arm(timer, 0, fired);
+    clock.wheel.advance(clock.base); // No tick has elapsed yet
+    EXPECT_TRUE(fired.empty());
+    clock.tick();
+    EXPECT_EQ(fired, std::vector<uint64_t>{1});
+}
+
+TEST(TimerWheel, CancelledTimersNeverFire) {
+    TickingWheel clock;
+    Timer timer;
+    std::vector<uint64_t> fired;
+    clock.arm(timer, 5 * TIMER_TICK_MS, fired);
+    clock.wheel.cancel(timer);
+    EXPECT_FALSE(timer.armed());
+    clock.wheel.cancel(timer); // Cancelling twice is harmless
+    for (int i = 0; i < 10; ++i) clock.tick();
+    EXPECT_TRUE(fired.empty());
+}
+
+TEST(TimerWheel, RescheduleReplacesTheDeadline) {
+    TickingWheel clock;
+    Timer timer;
+    std::vector<uint64_t> fired;
+    clock.arm(timer, 5 * TIMER_TICK_MS, fired);
+    clock.tick();
+    clock.wheel.schedule(timer, 10 * TIMER_TICK_MS); // e.g. an idle timer pushed back by traffic
+    for (int i = 0; i < 20; ++i) clock.tick();
+    EXPECT_EQ(fired, std::vector<uint64_t>{11});
+}
+
+// Delays on either side of each level boundary come down the levels and fire on time
+TEST(TimerWheel, CascadedTimersFireOnTime) {
+    const uint64_t level_span = 1ULL << TIMER_WHEEL_BITS;
+    std::vector<uint64_t> delays = {1, level_span - 1, level_span, level_span + 1,
+                                    level_span * level_span - 1, level_span * level_span,
+                                    level_span * level_span + 7, 3 * level_span * level_span + 11,
+                                    level_span * level_span * level_span + 5};
+    TickingWheel clock;
+    std::vector<Timer> timers(delays.size());
+    std::vector<std::vector<uint64_t>> fired(delays.size());
+    for (size_t i = 0; i < delays.size(); ++i) clock.arm(timers[i], delays[i] * TIMER_TICK_MS, fired[i]);
+    while (clock.ticks < delays.back() + 2) clock.tick();
+    for (size_t i = 0; i < delays.size(); ++i) {
+        EXPECT_EQ(fired[i], std::vector<uint64_t>{delays[i]}) << "delay of " << delays[i] << " ticks";
+    }
+}
+
+// Scheduled after the wheel has turned, so the slot indices are not aligned to zero
+TEST(TimerWheel, CascadesFromAnOffsetStart) {
+    TickingWheel clock;
+    for (int i = 0; i < 1000; ++i) clock.tick();
+    Timer timer;
+    std::vector<uint64_t> fired;
+    clock.arm(timer, 5000 * TIMER_TICK_MS, fired);
+    while (clock.ticks < 7000) clock.tick();
+    EXPECT_EQ(fired, std::vector<uint64_t>{6000});
+}
+
+TEST(TimerWheel, CallbacksMayRescheduleThemselves) {
+    TickingWheel clock;
+    Timer heartbeat;
+    std::vector<uint64_t> fired;
+    heartbeat.callback = [&] {
+        fired.push_back(clock.ticks);
+        clock.wheel.schedule(heartbeat, 3 * TIMER_TICK_MS);
+    };
+    clock.wheel.schedule(heartbeat, 3 * TIMER_TICK_MS);
+    for (int i = 0; i < 10; ++i) clock.tick();
+    EXPECT_EQ(fired, (std::vector<uint64_t>{3, 6, 9}));
+}
+
+TEST(TimerWheel, CallbacksMayCancelTimersDueOnTheSameTick) {
+    TickingWheel clock;
+    Timer first, second;
+    int fired = 0;
+    first.callback = [&] { fired++; clock.wheel.cancel(second); };
+    second.callback = [&] { fired++; clock.wheel.cancel(first); };
+    clock.wheel.schedule(first, TIMER_TICK_MS);
+    clock.wheel.schedule(second, TIMER_TICK_MS);
+    clock.tick();
+    EXPECT_EQ(fired, 1);
+    EXPECT_FALSE(first.armed());
+    EXPECT_FALSE(second.armed());
+}
+
+TEST(TimerWheel, CatchesUpOnMissedTicks) {
+    TickingWheel clock;
+    Timer early, late;
+    std::vector<uint64_t> fired;
+    clock.arm(early, 2 * TIMER_TICK_MS, fired);
+    clock.arm(late, 90 * TIMER_TICK_MS, fired);
+    clock.ticks = 100; // One advance() over a long stall runs every elapsed tick
+    clock.wheel.advance(clock.base + clock.ticks * std::chrono::milliseconds(TIMER_TICK_MS));
+    EXPECT_EQ(fired.size(), 2u);
+    EXPECT_GT(clock.wheel.ms_until_next_tick(clock.base + clock.ticks * std::chrono::milliseconds(TIMER_TICK_MS)), 0);
+}
+
+TEST(TimerWheel, NextTickIsAtMostOneTickAway) {
+    TickingWheel clock;
+    int wait = clock.wheel.ms_until_next_tick(clock.base);
+    EXPECT_GT(wait, 0);
+    EXPECT_LE(wait, TIMER_TICK_MS + 1);
+    EXPECT_EQ(clock.wheel.ms_until_next_tick(clock.base + std::chrono::seconds(10)), 0); // Overdue
+}